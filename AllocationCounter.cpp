@@ -0,0 +1,238 @@
+﻿#include "AllocationCounter.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+
+
+namespace alloc {
+
+    namespace {
+
+        constexpr size_t NumofPhases = static_cast<size_t>(Phase::NumofPhases);
+
+        struct Counters {
+            std::atomic<uint64_t> allocations{ 0 };
+            std::atomic<uint64_t> frees{ 0 };
+            std::atomic<uint64_t> bytes{ 0 };
+            std::atomic<int64_t> liveBytes{ 0 };
+            std::atomic<int64_t> peakLiveBytes{ 0 };
+        };
+
+        // constant initialized, so they can be used before main()
+        Counters phaseCounters[NumofPhases];
+        std::atomic<int64_t> totalLiveBytes{ 0 };
+        std::atomic<int64_t> totalPeakLiveBytes{ 0 };
+
+        thread_local Phase threadPhase = Phase::Other;
+        thread_local uint64_t numofThreadAllocations = 0;
+
+#ifdef MIDITOSCORE_COUNT_ALLOCATIONS
+        void updatePeak(std::atomic<int64_t> &peak, int64_t value) {
+            int64_t current = peak.load(std::memory_order_relaxed);
+            while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+        }
+
+        // the size and phase are stored in front of each block, to count the freed memory
+        struct Header {
+            size_t size;
+            Phase phase;
+        };
+
+        constexpr size_t HeaderSize = alignof(std::max_align_t);
+        static_assert(sizeof(Header) <= HeaderSize, "header does not fit in the alignment");
+
+        void *allocate(size_t size) noexcept {
+            char *block = static_cast<char*>(std::malloc(size + HeaderSize));
+            if (!block)
+                return nullptr;
+
+            const Phase phase = threadPhase;
+            new (block) Header{ size, phase };
+
+            auto &c = phaseCounters[static_cast<size_t>(phase)];
+            c.allocations.fetch_add(1, std::memory_order_relaxed);
+            c.bytes.fetch_add(size, std::memory_order_relaxed);
+            updatePeak(c.peakLiveBytes, c.liveBytes.fetch_add(size, std::memory_order_relaxed) + static_cast<int64_t>(size));
+            updatePeak(totalPeakLiveBytes, totalLiveBytes.fetch_add(size, std::memory_order_relaxed) + static_cast<int64_t>(size));
+            numofThreadAllocations++;
+
+            return block + HeaderSize;
+        }
+
+        void deallocate(void *p) noexcept {
+            if (!p)
+                return;
+
+            char *block = static_cast<char*>(p) - HeaderSize;
+            const Header header = *reinterpret_cast<Header*>(block);
+
+            // counted on the phase which allocated the memory
+            auto &c = phaseCounters[static_cast<size_t>(header.phase)];
+            c.frees.fetch_add(1, std::memory_order_relaxed);
+            c.liveBytes.fetch_sub(header.size, std::memory_order_relaxed);
+            totalLiveBytes.fetch_sub(header.size, std::memory_order_relaxed);
+
+            std::free(block);
+        }
+#endif
+
+    }
+
+
+    const char * phaseName(Phase phase) {
+        switch (phase) {
+        case Phase::Other: return "other";
+        case Phase::ReadHeader: return "readHeader";
+        case Phase::ReadTrack: return "readTrack";
+        case Phase::Quantize: return "quantize";
+        case Phase::Prepare: return "prepare";
+        case Phase::WriteScore: return "writeScore";
+        case Phase::CompileScore: return "compileScore";
+        case Phase::Export: return "export";
+        default: return "unknown";
+        }
+    }
+
+    bool isAvailable() {
+#ifdef MIDITOSCORE_COUNT_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    Snapshot snapshot() {
+        Snapshot s;
+        for (size_t i = 0; i < NumofPhases; i++) {
+            const auto &c = phaseCounters[i];
+            auto &p = s.phases[i];
+            p.allocations = c.allocations.load(std::memory_order_relaxed);
+            p.frees = c.frees.load(std::memory_order_relaxed);
+            p.bytes = c.bytes.load(std::memory_order_relaxed);
+            p.liveBytes = c.liveBytes.load(std::memory_order_relaxed);
+            p.peakLiveBytes = c.peakLiveBytes.load(std::memory_order_relaxed);
+        }
+        s.liveBytes = totalLiveBytes.load(std::memory_order_relaxed);
+        s.peakLiveBytes = totalPeakLiveBytes.load(std::memory_order_relaxed);
+
+        return s;
+    }
+
+    void reset() {
+        // the live bytes are kept, because the memory allocated before is freed later
+        for (auto &c : phaseCounters) {
+            c.allocations.store(0, std::memory_order_relaxed);
+            c.frees.store(0, std::memory_order_relaxed);
+            c.bytes.store(0, std::memory_order_relaxed);
+            c.peakLiveBytes.store(c.liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        totalPeakLiveBytes.store(totalLiveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    void writeReport(std::ostream & stream, const Snapshot & snapshot) {
+        using namespace std;
+
+        const auto flags = stream.flags();
+        const auto fill = stream.fill(' ');
+
+        stream << left << setw(14) << "phase" << right
+            << setw(12) << "allocs"
+            << setw(12) << "frees"
+            << setw(14) << "bytes"
+            << setw(14) << "live"
+            << setw(14) << "peak live"
+            << '\n';
+
+        for (size_t i = 0; i < snapshot.phases.size(); i++) {
+            const auto &p = snapshot.phases[i];
+            if (p.allocations == 0 && p.frees == 0)
+                continue;
+
+            stream << left << setw(14) << phaseName(static_cast<Phase>(i)) << right
+                << setw(12) << p.allocations
+                << setw(12) << p.frees
+                << setw(14) << p.bytes
+                << setw(14) << p.liveBytes
+                << setw(14) << p.peakLiveBytes
+                << '\n';
+        }
+
+        stream << left << setw(14) << "total" << right
+            << setw(52) << snapshot.liveBytes
+            << setw(14) << snapshot.peakLiveBytes
+            << '\n';
+
+        stream.flags(flags);
+        stream.fill(fill);
+    }
+
+    uint64_t threadAllocations() {
+        return numofThreadAllocations;
+    }
+
+    Phase currentPhase() {
+        return threadPhase;
+    }
+
+    void setCurrentPhase(Phase phase) {
+        threadPhase = phase;
+    }
+
+}
+
+
+#ifdef MIDITOSCORE_COUNT_ALLOCATIONS
+
+// the replaced operator delete frees the memory of the replaced operator new
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(std::size_t size) {
+    if (void *p = alloc::allocate(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    if (void *p = alloc::allocate(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return alloc::allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return alloc::allocate(size);
+}
+
+void operator delete(void *p) noexcept {
+    alloc::deallocate(p);
+}
+
+void operator delete[](void *p) noexcept {
+    alloc::deallocate(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    alloc::deallocate(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept {
+    alloc::deallocate(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) noexcept {
+    alloc::deallocate(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) noexcept {
+    alloc::deallocate(p);
+}
+
+#endif
@@ -0,0 +1,116 @@
+﻿//
+// AllocationCounter
+// Counts the heap allocations of each phase of the conversion (read, quantize, write...).
+// The global operator new and delete are replaced only when MIDITOSCORE_COUNT_ALLOCATIONS is defined,
+// and the phases are tagged by ALLOC_PHASE on the thread which allocates.
+// Without the definition, ALLOC_PHASE is empty and isAvailable() returns false.
+//
+// --- example -----------------------------
+// alloc::reset();
+// midi.openAndRead(fileName);
+// alloc::writeReport(std::cout, alloc::snapshot());
+//
+// // check that the path does not allocate
+// alloc::ThreadAllocations check;
+// toscore.writeScore(stream, format, notes);
+// if (check.count() > 0) fail();
+// ------------------------------------------
+//
+
+
+#ifndef _ALLOCATION_COUNTER_HPP_
+#define _ALLOCATION_COUNTER_HPP_
+
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+
+
+namespace alloc {
+
+    enum class Phase : int {
+        Other = 0,
+        ReadHeader,
+        ReadTrack,
+        Quantize,
+        Prepare,
+        WriteScore,
+        CompileScore,
+        Export,
+        NumofPhases
+    };
+
+    const char *phaseName(Phase phase);
+
+    struct PhaseCounters {
+        uint64_t allocations = 0;
+        uint64_t frees = 0;
+        uint64_t bytes = 0;
+        // the memory allocated in the phase and not freed yet
+        int64_t liveBytes = 0;
+        int64_t peakLiveBytes = 0;
+    };
+
+    struct Snapshot {
+        std::array<PhaseCounters, static_cast<size_t>(Phase::NumofPhases)> phases;
+        // the whole process
+        int64_t liveBytes = 0;
+        int64_t peakLiveBytes = 0;
+    };
+
+    // true if the operators are replaced
+    bool isAvailable();
+
+    // the counters of all threads
+    Snapshot snapshot();
+
+    // clear the counters. the peaks start from the current live bytes.
+    void reset();
+
+    void writeReport(std::ostream &stream, const Snapshot &snapshot);
+
+    // the number of the allocations on the calling thread
+    uint64_t threadAllocations();
+
+    // the phase of the allocations on the calling thread
+    Phase currentPhase();
+    void setCurrentPhase(Phase phase);
+
+
+    class PhaseScope {
+    public:
+        explicit PhaseScope(Phase phase) : previous(currentPhase()) { setCurrentPhase(phase); }
+        ~PhaseScope() { setCurrentPhase(previous); }
+
+        PhaseScope(const PhaseScope&) = delete;
+        PhaseScope &operator=(const PhaseScope&) = delete;
+
+    private:
+        Phase previous;
+    };
+
+    // count the allocations on the calling thread during the lifetime
+    class ThreadAllocations {
+    public:
+        ThreadAllocations() : begin(threadAllocations()) {}
+
+        uint64_t count() const { return threadAllocations() - begin; }
+
+    private:
+        uint64_t begin;
+    };
+
+}
+
+
+#define ALLOC_CONCAT_IMPL(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT_IMPL(a, b)
+
+#ifdef MIDITOSCORE_COUNT_ALLOCATIONS
+#define ALLOC_PHASE(phase) ::alloc::PhaseScope ALLOC_CONCAT(allocPhase_, __LINE__)(::alloc::Phase::phase)
+#else
+#define ALLOC_PHASE(phase) ((void)0)
+#endif
+
+#endif // !_ALLOCATION_COUNTER_HPP_
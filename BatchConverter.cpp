@@ -0,0 +1,626 @@
+﻿#include "BatchConverter.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "WorkStealingPool.hpp"
+#include "MappedFile.hpp"
+#include "ConversionStats.hpp"
+#include "Trace.hpp"
+
+
+namespace miditoscore {
+
+    namespace fs = std::filesystem;
+
+    namespace {
+
+        std::string trim(const std::string &str) {
+            const auto first = str.find_first_not_of(" \t\r");
+            if (first == std::string::npos)
+                return std::string();
+
+            const auto last = str.find_last_not_of(" \t\r");
+            return str.substr(first, last - first + 1);
+        }
+
+        bool toInt(const std::string &str, int &number) {
+            size_t numEndedPos;
+            try {
+                number = std::stoi(str, &numEndedPos);
+            } catch (const std::exception&) {
+                return false;
+            }
+
+            return numEndedPos == str.length();
+        }
+
+        bool toDouble(const std::string &str, double &number) {
+            size_t numEndedPos;
+            try {
+                number = std::stod(str, &numEndedPos);
+            } catch (const std::exception&) {
+                return false;
+            }
+
+            return numEndedPos == str.length();
+        }
+
+        bool toFraction(const std::string &str, math::Fraction &frac) {
+            const size_t slashPos = str.find('/');
+            if (slashPos == std::string::npos)
+                return false;
+
+            int numer, denom;
+            if (!toInt(str.substr(0, slashPos), numer) || !toInt(str.substr(slashPos + 1), denom))
+                return false;
+            if (denom == 0)
+                return false;
+
+            frac.set(numer, denom);
+
+            return frac > 0;
+        }
+
+        bool toPitchNotation(const std::string &str, midireader::PitchNotation &notation) {
+            if (str == "C-2")
+                notation = midireader::PitchNotation::A3_440Hz;
+            else if (str == "C-1")
+                notation = midireader::PitchNotation::A4_440Hz;
+            else if (str == "C0")
+                notation = midireader::PitchNotation::A5_440Hz;
+            else
+                return false;
+
+            return true;
+        }
+
+        // an entry of the manifest before the note names are resolved
+        struct ManifestEntry {
+            BatchEntry entry;
+            std::vector<std::string> lanes;
+            bool hasProfile = false;
+            int line = 0;
+        };
+
+        bool resolveLanes(const ManifestEntry &manifestEntry, std::vector<int> &laneAllocation) {
+            laneAllocation.clear();
+
+            for (const auto &lane : manifestEntry.lanes) {
+                int n;
+                if (toInt(lane, n)) {
+                    if (n < 0 || n > 127)
+                        return false;
+                    laneAllocation.push_back(n);
+                    continue;
+                }
+
+                if (lane.length() < 2)
+                    return false;
+
+                try {
+                    n = midireader::toNoteNum(lane, manifestEntry.entry.song.pitchNotation);
+                } catch (...) {
+                    return false;
+                }
+
+                if (n < 0 || n > 127)
+                    return false;
+                laneAllocation.push_back(n);
+            }
+
+            return !laneAllocation.empty();
+        }
+
+        bool readFile(const fs::path &path, std::string &data) {
+            fileio::MappedFile file;
+            if (!file.open(path.string()))
+                return false;
+
+            data.assign(file.data(), file.size());
+
+            return true;
+        }
+
+        bool writeFile(const fs::path &path, const std::string &data) {
+            std::ofstream file(path, std::ios::binary);
+            if (!file.is_open())
+                return false;
+
+            file.write(data.data(), data.size());
+
+            return static_cast<bool>(file);
+        }
+
+        struct ReplacedOutput {
+            fs::path target;
+            // the previous output, or empty if there was none
+            fs::path backup;
+        };
+
+        // move the previous target into backupDir and the item to the target.
+        // the previous target is put back if the item cannot be moved.
+        bool replaceOutput(const fs::path &item, const fs::path &target, const fs::path &backupDir, std::vector<ReplacedOutput> &replaced, std::error_code &ec) {
+            ReplacedOutput output{ target, fs::path() };
+
+            // not_found is reported as an error as well
+            const fs::file_status status = fs::symlink_status(target, ec);
+            const bool exists = status.type() != fs::file_type::not_found;
+            if (exists && ec)
+                return false;
+
+            if (exists) {
+                output.backup = backupDir / target.filename();
+                fs::rename(target, output.backup, ec);
+                if (ec)
+                    return false;
+            }
+
+            fs::rename(item, target, ec);
+            if (ec) {
+                std::error_code restoreError;
+                if (!output.backup.empty())
+                    fs::rename(output.backup, target, restoreError);
+                return false;
+            }
+
+            replaced.push_back(std::move(output));
+            return true;
+        }
+
+        // undo replaceOutput() in the reverse order
+        void restoreOutputs(const std::vector<ReplacedOutput> &replaced) {
+            std::error_code ec;
+            for (auto it = replaced.crbegin(); it != replaced.crend(); ++it) {
+                fs::remove_all(it->target, ec);
+                if (!it->backup.empty())
+                    fs::rename(it->backup, it->target, ec);
+            }
+        }
+
+        void fail(BatchResult &result, std::ostream &log, const char *message) {
+            log << message;
+            result.succeeded = false;
+        }
+
+    }
+
+
+    bool readManifest(
+        const fs::path & fileName,
+        const std::vector<OutputProfile> & defaultProfiles,
+        std::vector<BatchEntry> & entries,
+        std::ostream & err) {
+
+        entries.clear();
+
+        std::ifstream manifest(fileName);
+        if (!manifest.is_open()) {
+            err << "[!] マニフェストが開けません: " << fileName.string() << '\n';
+            return false;
+        }
+
+        return readManifest(manifest, fileName.parent_path(), defaultProfiles, entries, err);
+    }
+
+    bool readManifest(
+        std::istream & manifest,
+        const fs::path & baseDir,
+        const std::vector<OutputProfile> & defaultProfiles,
+        std::vector<BatchEntry> & entries,
+        std::ostream & err,
+        bool requireFiles) {
+
+        entries.clear();
+
+        auto resolvePath = [&](const std::string &str) {
+            const fs::path path(str);
+            return path.is_relative() ? baseDir / path : path;
+        };
+
+        std::vector<ManifestEntry> manifestEntries;
+        bool valid = true;
+        std::string line;
+        int lineNum = 0;
+
+        while (std::getline(manifest, line)) {
+            lineNum++;
+
+            line = trim(line);
+            if (line.empty() || line.front() == '#' || line.front() == ';')
+                continue;
+
+            if (line.front() == '[') {
+                if (line.back() != ']') {
+                    err << "[!] " << lineNum << "行目: 曲IDの書式が正しくありません\n";
+                    valid = false;
+                    continue;
+                }
+
+                const std::string id = trim(line.substr(1, line.length() - 2));
+                int n;
+                if (!toInt(id, n) || n < 0) {
+                    err << "[!] " << lineNum << "行目: 曲IDは0以上の半角数字で入力してください\n";
+                    valid = false;
+                }
+
+                // the songs of the same id would share the temporary directory and the outputs
+                const auto same = std::find_if(manifestEntries.cbegin(), manifestEntries.cend(),
+                    [&id](const ManifestEntry &e) { return e.entry.song.id == id; });
+                if (same != manifestEntries.cend()) {
+                    err << "[!] " << lineNum << "行目: 曲ID " << id << " は" << same->line << "行目と重複しています\n";
+                    valid = false;
+                }
+
+                ManifestEntry manifestEntry;
+                manifestEntry.entry.song.id = id;
+                manifestEntry.entry.song.holdMinLength.set(0);
+                manifestEntry.entry.song.intervalAsName = false;
+                manifestEntry.entry.song.pitchNotation = midireader::PitchNotation::A3_440Hz;
+                manifestEntry.entry.song.chorusBegSec = 0;
+                manifestEntry.entry.song.chorusEndSec = 0;
+                manifestEntry.line = lineNum;
+                manifestEntries.push_back(std::move(manifestEntry));
+                continue;
+            }
+
+            const size_t equalPos = line.find('=');
+            if (equalPos == std::string::npos || manifestEntries.empty()) {
+                err << "[!] " << lineNum << "行目: 解釈できない行です\n";
+                valid = false;
+                continue;
+            }
+
+            const std::string key = trim(line.substr(0, equalPos));
+            const std::string value = trim(line.substr(equalPos + 1));
+            auto &current = manifestEntries.back();
+            auto &song = current.entry.song;
+            bool ok = true;
+
+            if (key == "midi") {
+                current.entry.midiFile = resolvePath(value);
+            } else if (key == "music") {
+                current.entry.musicFile = resolvePath(value);
+            } else if (key == "jacket") {
+                current.entry.jacketFile = resolvePath(value);
+            } else if (key == "lanes") {
+                current.lanes.clear();
+                std::istringstream lanes(value);
+                std::string lane;
+                while (std::getline(lanes, lane, ',')) {
+                    current.lanes.push_back(trim(lane));
+                }
+            } else if (key == "notation") {
+                ok = toPitchNotation(value, song.pitchNotation);
+            } else if (key == "hold") {
+                ok = toFraction(value, song.holdMinLength);
+            } else if (key == "chobeg") {
+                ok = toDouble(value, song.chorusBegSec) && song.chorusBegSec >= 0;
+            } else if (key == "choend") {
+                ok = toDouble(value, song.chorusEndSec) && song.chorusEndSec >= 0;
+            } else if (key == "profile") {
+                if (value == "all") {
+                    current.entry.profiles.push_back(buttonProfile());
+                    current.entry.profiles.push_back(wiiProfile());
+                } else {
+                    OutputProfile profile;
+                    ok = findProfile(value, profile);
+                    if (ok)
+                        current.entry.profiles.push_back(profile);
+                }
+                current.hasProfile = true;
+            } else {
+                err << "[!] " << lineNum << "行目: 不明な項目です: " << key << '\n';
+                valid = false;
+                continue;
+            }
+
+            if (!ok) {
+                err << "[!] " << lineNum << "行目: " << key << "の値が正しくありません\n";
+                valid = false;
+            }
+        }
+
+        // check required items
+        for (auto &manifestEntry : manifestEntries) {
+            auto &entry = manifestEntry.entry;
+            const auto header = "[!] 曲ID:" + entry.song.id + "(" + std::to_string(manifestEntry.line) + "行目): ";
+
+            if (!manifestEntry.hasProfile)
+                entry.profiles = defaultProfiles;
+
+            const bool needSongDirectory = std::any_of(
+                entry.profiles.cbegin(),
+                entry.profiles.cend(),
+                [](const OutputProfile &p) { return p.songDirectory; }
+            );
+
+            if (requireFiles && entry.midiFile.empty()) {
+                err << header << "midiが指定されていません\n";
+                valid = false;
+            }
+            if (!resolveLanes(manifestEntry, entry.song.laneAllocation)) {
+                err << header << "lanesの音程が正しくありません\n";
+                valid = false;
+            }
+            entry.song.intervalAsName = std::any_of(
+                manifestEntry.lanes.cbegin(),
+                manifestEntry.lanes.cend(),
+                [](const std::string &lane) { int n; return !toInt(lane, n); }
+            );
+            if (entry.song.holdMinLength <= 0) {
+                err << header << "holdが指定されていません\n";
+                valid = false;
+            }
+            if (needSongDirectory) {
+                if (entry.song.chorusBegSec >= entry.song.chorusEndSec) {
+                    err << header << "chobeg, choendの範囲が無効です\n";
+                    valid = false;
+                }
+                if (requireFiles && (entry.musicFile.empty() || entry.jacketFile.empty())) {
+                    err << header << "music, jacketが指定されていません\n";
+                    valid = false;
+                }
+            }
+
+            entries.push_back(std::move(entry));
+        }
+
+        return valid;
+    }
+
+    BatchResult convertSong(const BatchEntry & entry, const fs::path & outputDir, const BuildCache * cache, midireader::MIDICache * midiCache) {
+        TRACE_SCOPE("convertSong");
+
+        const auto startTime = std::chrono::steady_clock::now();
+
+        BatchResult result;
+        result.id = entry.song.id;
+        result.succeeded = true;
+        result.readStatus = midireader::Status::S_OK;
+        result.scoreStatus = Status::S_OK;
+        result.seconds = 0;
+
+        std::ostringstream log;
+
+        auto finish = [&]() {
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            result.log = log.str();
+            return result;
+        };
+
+        fileio::MappedFile midiFile;
+        if (!midiFile.open(entry.midiFile.string())) {
+            result.readStatus = midireader::Status::E_CANNOT_OPEN_FILE;
+            log << "MIDIファイルを読み込んでいます... ";
+            fail(result, log, "[!] ファイルが開けません.パスを確認して下さい\n");
+            return finish();
+        }
+
+        midireader::MIDIReader midi;
+        midi.setAdjustmentAmplitude(2, 1024);
+        bool midiLoaded = false;
+
+        // the midi file shared with the other songs
+        midireader::MIDICache::Document cachedMidi;
+        const midireader::MIDIReader *parsedMidi = &midi;
+
+        // the midi file is read only when any profile is not in the cache
+        auto loadMidi = [&]() {
+            if (midiCache) {
+                cachedMidi = midiCache->get(entry.midiFile.string(), midi.getAdjustmentAmplitude(), midi.getAdjustmentThreshold(), &result.readStatus);
+                if (cachedMidi)
+                    parsedMidi = cachedMidi.get();
+            } else if (entry.midiFile.extension() == ".mts") {
+                result.readStatus = midi.load(entry.midiFile.string());
+            } else {
+                result.readStatus = midi.openAndRead(entry.midiFile.string());
+            }
+
+            log << "MIDIファイルを読み込んでいます... ";
+
+            if (!printReadStatus(log, result.readStatus, *parsedMidi)) {
+                result.succeeded = false;
+                return false;
+            }
+
+            return true;
+        };
+
+        // write all profiles to the temporary directory
+        const fs::path tempDir = outputDir / (".tmp-" + entry.song.id);
+        std::error_code ec;
+
+        fs::remove_all(tempDir, ec);
+        if (!fs::create_directories(tempDir, ec)) {
+            fail(result, log, "[!] ディレクトリ作成に失敗しました\n");
+            return finish();
+        }
+
+        for (const auto &profile : entry.profiles) {
+            const fs::path scorePath = scoreFilePath(tempDir, entry.song, profile);
+            const fs::path binaryScorePath = binaryScoreFilePath(tempDir, entry.song, profile);
+
+            uint64_t key = 0;
+            const bool cacheable = cache && BuildCache::makeKey(
+                midiFile.data(), midiFile.size(), midi, makeNoteFormat(entry.song, profile), entry.song, profile, key);
+
+            BuildCache::Entry cached;
+            if (cacheable && cache->load(key, cached)) {
+                // restore the outputs without converting
+                if (profile.songDirectory)
+                    fs::create_directories(tempDir / entry.song.id, ec);
+
+                if (!writeFile(scorePath, cached.score) || !writeFile(binaryScorePath, cached.binaryScore)) {
+                    fail(result, log, "[!] 譜面ファイルを作成できません\n");
+                    break;
+                }
+
+                log << "[i] " << profile.name << ": キャッシュから復元しました\n";
+                log << cached.log;
+                result.scoreStatus |= cached.status;
+            } else {
+                if (!midiLoaded) {
+                    if (!loadMidi())
+                        break;
+                    midiLoaded = true;
+                }
+
+                std::ostringstream profileLog;
+                const int ret = exportProfile(tempDir, profileLog, *parsedMidi, entry.song, profile);
+                log << profileLog.str();
+                result.scoreStatus |= ret;
+
+                if ((ret & Status::E_CANNOT_OPEN_FILE) != 0) {
+                    result.succeeded = false;
+                    break;
+                }
+
+                if (cacheable) {
+                    BuildCache::Entry newEntry;
+                    newEntry.status = ret;
+                    newEntry.log = profileLog.str();
+
+                    if (readFile(scorePath, newEntry.score) && readFile(binaryScorePath, newEntry.binaryScore))
+                        cache->store(key, newEntry);
+                }
+            }
+
+            if (!profile.songDirectory)
+                continue;
+
+            const fs::path songDir = tempDir / entry.song.id;
+            fs::copy_file(entry.musicFile, songDir / entry.musicFile.filename(), fs::copy_options::overwrite_existing, ec);
+            if (ec) {
+                log << "[i] " << ec.message() << "\n";
+                fail(result, log, "[!] 音源のコピーに失敗しました\n");
+                break;
+            }
+            fs::copy_file(entry.jacketFile, songDir / entry.jacketFile.filename(), fs::copy_options::overwrite_existing, ec);
+            if (ec) {
+                log << "[i] " << ec.message() << "\n";
+                fail(result, log, "[!] ジャケット写真のコピーに失敗しました\n");
+                break;
+            }
+            if (!writeIniFile(songDir, entry.musicFile, entry.jacketFile)) {
+                fail(result, log, "[!] iniファイルを作成できません\n");
+                break;
+            }
+        }
+
+        // move the outputs to the output directory.
+        // the previous outputs are moved aside first, and put back if any output cannot be moved.
+        if (result.succeeded) {
+            std::vector<fs::path> items;
+            for (const auto &item : fs::directory_iterator(tempDir, ec))
+                items.push_back(item.path());
+
+            const fs::path backupDir = tempDir / ".old";
+            fs::create_directory(backupDir, ec);
+
+            std::vector<ReplacedOutput> replaced;
+            for (const auto &item : items) {
+                if (!replaceOutput(item, outputDir / item.filename(), backupDir, replaced, ec)) {
+                    log << "[i] " << ec.message() << "\n";
+                    fail(result, log, "[!] 出力先への移動に失敗しました\n");
+                    restoreOutputs(replaced);
+                    break;
+                }
+            }
+        }
+
+        fs::remove_all(tempDir, ec);
+        midi.close();
+
+        return finish();
+    }
+
+    std::vector<BatchResult> convertBatch(
+        const std::vector<BatchEntry> & entries,
+        const fs::path & outputDir,
+        size_t numofThreads,
+        const BuildCache * cache,
+        bool collectStats) {
+
+        std::vector<BatchResult> results(entries.size());
+
+        // the songs which use the same midi file read it once
+        midireader::MIDICache midiCache;
+
+        // start the larger midi files first to balance the threads
+        std::vector<std::pair<uintmax_t, size_t>> order;
+        for (size_t i = 0; i < entries.size(); i++) {
+            std::error_code ec;
+            const auto size = fs::file_size(entries[i].midiFile, ec);
+            order.emplace_back(ec ? 0 : size, i);
+        }
+        std::stable_sort(
+            order.begin(),
+            order.end(),
+            [](const auto &a, const auto &b) { return a.first > b.first; }
+        );
+
+        std::vector<WorkStealingPool::Task> tasks;
+        for (const auto &o : order) {
+            const size_t i = o.second;
+            tasks.push_back([&, i]() {
+                stats::enable(collectStats);
+                stats::reset();
+
+                try {
+                    results[i] = convertSong(entries[i], outputDir, cache, &midiCache);
+                } catch (const std::exception &e) {
+                    results[i].id = entries[i].song.id;
+                    results[i].succeeded = false;
+                    results[i].readStatus = midireader::Status::S_OK;
+                    results[i].scoreStatus = Status::S_OK;
+                    results[i].seconds = 0;
+                    results[i].log = std::string("[!] ") + e.what() + "\n";
+                }
+
+                if (collectStats) {
+                    std::ostringstream json;
+                    stats::writeJson(json, stats::current());
+                    results[i].stats = json.str();
+                    stats::enable(false);
+                }
+            });
+        }
+
+        WorkStealingPool pool(numofThreads);
+        pool.run(std::move(tasks));
+
+        return results;
+    }
+
+    void printBatchSummary(std::ostream & out, const std::vector<BatchResult> & results) {
+        size_t numofSucceeded = 0;
+
+        for (const auto &r : results) {
+            out << "\n==== 曲ID:" << r.id << " ====\n";
+            out << r.log;
+
+            if (r.succeeded)
+                numofSucceeded++;
+        }
+
+        out << "\n--変換結果-----\n";
+        for (const auto &r : results) {
+            out << std::setfill(' ') << std::setw(6) << r.id << " | ";
+
+            if (!r.succeeded)
+                out << "失敗";
+            else if (r.scoreStatus != Status::S_OK)
+                out << "警告";
+            else
+                out << "完了";
+
+            out << " | " << std::fixed << std::setprecision(3) << r.seconds << "s\n";
+        }
+        out << "成功:" << numofSucceeded << " 失敗:" << results.size() - numofSucceeded << '\n';
+    }
+
+}
@@ -0,0 +1,113 @@
+﻿//
+// BatchConverter
+// This module converts many songs listed in a manifest file without any prompt.
+//
+// --- manifest -----------------------------
+// # comment
+// [7]                      <- song id
+// midi=song.mid           <- the parsed midi file (.mts) can be used as well
+// lanes=F3,E3,D3,C3        <- pitch of each lane from the left (note name or note number)
+// notation=C-2             <- lowest pitch of the DAW (C-2, C-1 or C0). used for the note names
+// hold=1/4                 <- minimal length of the hold note
+// chobeg=1.5               <- preview position [s]
+// choend=10.0
+// music=music.ogg
+// jacket=jacket.png
+// profile=button           <- button, wii or all (optional)
+// ------------------------------------------
+// relative paths are resolved from the directory of the manifest. the song ids must be unique.
+//
+
+
+#ifndef _BATCH_CONVERTER_HPP_
+#define _BATCH_CONVERTER_HPP_
+
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <filesystem>
+
+#include "ScoreExporter.hpp"
+#include "BuildCache.hpp"
+#include "MIDICache.hpp"
+
+
+namespace miditoscore {
+
+    struct BatchEntry {
+        SongSettings song;
+        std::filesystem::path midiFile;
+        std::filesystem::path musicFile;
+        std::filesystem::path jacketFile;
+        std::vector<OutputProfile> profiles;
+    };
+
+    struct BatchResult {
+        std::string id;
+        // false if the song was not written
+        bool succeeded;
+        midireader::Status readStatus;
+        // status of writeScore() of all sections
+        int scoreStatus;
+        double seconds;
+        // the same messages as the interactive conversion
+        std::string log;
+        // ConversionStats as json. empty if the stats are not collected.
+        std::string stats;
+    };
+
+
+    // read the manifest. the entries without "profile" use defaultProfiles.
+    // return false and print the reason to err if the manifest is invalid.
+    bool readManifest(
+        const std::filesystem::path &fileName,
+        const std::vector<OutputProfile> &defaultProfiles,
+        std::vector<BatchEntry> &entries,
+        std::ostream &err
+    );
+
+    // read the manifest from the stream. relative paths are resolved from baseDir.
+    // if requireFiles is false, midi, music and jacket can be omitted (ex. the job of ConversionDaemon).
+    bool readManifest(
+        std::istream &manifest,
+        const std::filesystem::path &baseDir,
+        const std::vector<OutputProfile> &defaultProfiles,
+        std::vector<BatchEntry> &entries,
+        std::ostream &err,
+        bool requireFiles = true
+    );
+
+    // convert all entries on numofThreads threads (0 means the number of hardware threads).
+    // the larger midi files are started first.
+    // each song is written to a temporary directory and moved to outputDir when it succeeded,
+    // so the previous output is kept if the conversion fails.
+    // if cache is not nullptr, the outputs of the unchanged songs are restored from it.
+    // the songs which use the same midi file share one parse.
+    // the results are in the order of the entries.
+    // if collectStats is true, the stats of each song are stored to BatchResult::stats.
+    // the reading is counted on the song which parsed the shared midi file.
+    std::vector<BatchResult> convertBatch(
+        const std::vector<BatchEntry> &entries,
+        const std::filesystem::path &outputDir,
+        size_t numofThreads = 0,
+        const BuildCache *cache = nullptr,
+        bool collectStats = false
+    );
+
+    // convert a song in the calling thread.
+    // if midiCache is not nullptr, the midi file is read through it.
+    BatchResult convertSong(
+        const BatchEntry &entry,
+        const std::filesystem::path &outputDir,
+        const BuildCache *cache = nullptr,
+        midireader::MIDICache *midiCache = nullptr
+    );
+
+    // print the log of each song and the summary table
+    void printBatchSummary(std::ostream &out, const std::vector<BatchResult> &results);
+
+}
+
+#endif // !_BATCH_CONVERTER_HPP_
@@ -0,0 +1,240 @@
+﻿#include "BinaryScore.hpp"
+
+#include <cstring>
+#include <cstddef>
+#include <fstream>
+
+#include "TempoMap.hpp"
+#include "Checksum.hpp"
+
+
+namespace miditoscore {
+
+    namespace {
+
+        template<class T>
+        void append(std::vector<char> &buffer, const T &value) {
+            const char *p = reinterpret_cast<const char*>(&value);
+            buffer.insert(buffer.end(), p, p + sizeof(T));
+        }
+
+    }
+
+
+    bool writeBinaryScore(std::ostream & stream, const midireader::MIDIReader & midi, const std::vector<CompiledChart>& charts) {
+        using namespace binary;
+
+        const auto &tempoEvent = midi.getTempoEvent();
+        const auto &beatEvent = midi.getBeatEvent();
+        const midireader::TempoMap tempoMap(tempoEvent, midi.getHeader().resolutionUnit);
+
+        size_t numofLane = 0;
+        size_t numofNote = 0;
+        for (const auto &c : charts) {
+            numofLane += c.lanes.size();
+            for (const auto &l : c.lanes) numofNote += l.size();
+        }
+
+        // layout of the tables
+        FileHeader header = {};
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = Version;
+        header.resolutionUnit = static_cast<uint32_t>(midi.getHeader().resolutionUnit);
+        header.numofTempo = static_cast<uint32_t>(tempoEvent.size());
+        header.numofBeat = static_cast<uint32_t>(beatEvent.size());
+        header.numofChart = static_cast<uint32_t>(charts.size());
+        header.tempoOffset = sizeof(FileHeader);
+        header.beatOffset = header.tempoOffset + sizeof(Tempo) * tempoEvent.size();
+        header.chartOffset = header.beatOffset + sizeof(Beat) * beatEvent.size();
+
+        const uint64_t laneOffset = header.chartOffset + sizeof(Chart) * charts.size();
+        const uint64_t noteOffset = laneOffset + sizeof(Lane) * numofLane;
+        header.fileSize = noteOffset + sizeof(Note) * numofNote;
+
+        std::vector<char> buffer;
+        buffer.reserve(static_cast<size_t>(header.fileSize));
+        append(buffer, header);
+
+        for (const auto &e : tempoEvent) {
+            Tempo t = {};
+            t.time = e.time;
+            t.microseconds = tempoMap.toMicroseconds(e.time);
+            t.bar = e.bar;
+            // bounded by the ticks of the bar, as the positions of the notes (see MIDItoScore::compileLastScore)
+            t.posNumer = static_cast<int32_t>(e.posInBar.get().n);
+            t.posDenom = static_cast<int32_t>(e.posInBar.get().d);
+            t.tempo = e.tempo;
+            append(buffer, t);
+        }
+
+        for (const auto &e : beatEvent) {
+            Beat b = {};
+            b.time = e.time;
+            b.microseconds = tempoMap.toMicroseconds(e.time);
+            b.bar = e.bar;
+            // the time signature of SMF is stored in bytes
+            b.numer = static_cast<int32_t>(e.beat.get().n);
+            b.denom = static_cast<int32_t>(e.beat.get().d);
+            append(buffer, b);
+        }
+
+        uint64_t nextLane = laneOffset;
+        for (const auto &c : charts) {
+            Chart chart = {};
+            std::strncpy(chart.name, c.name.c_str(), sizeof(chart.name) - 1);
+            chart.numofLane = static_cast<uint32_t>(c.lanes.size());
+            chart.laneOffset = nextLane;
+            append(buffer, chart);
+
+            nextLane += sizeof(Lane) * c.lanes.size();
+        }
+
+        uint64_t nextNote = noteOffset;
+        for (const auto &c : charts) {
+            for (size_t i = 0; i < c.lanes.size(); i++) {
+                Lane lane = {};
+                lane.interval = (i < c.laneAllocation.size()) ? c.laneAllocation[i] : -1;
+                lane.numofNote = static_cast<uint32_t>(c.lanes[i].size());
+                lane.noteOffset = nextNote;
+                append(buffer, lane);
+
+                nextNote += sizeof(Note) * c.lanes[i].size();
+            }
+        }
+
+        for (const auto &c : charts) {
+            for (const auto &l : c.lanes) {
+                const char *p = reinterpret_cast<const char*>(l.data());
+                buffer.insert(buffer.end(), p, p + sizeof(Note) * l.size());
+            }
+        }
+
+        // fill checksum
+        const uint64_t sum = checksum::hash64(buffer.data() + sizeof(FileHeader), buffer.size() - sizeof(FileHeader));
+        std::memcpy(buffer.data() + offsetof(FileHeader, checksum), &sum, sizeof(sum));
+
+        stream.write(buffer.data(), buffer.size());
+
+        return static_cast<bool>(stream);
+    }
+
+    bool writeBinaryScore(const std::string & fileName, const midireader::MIDIReader & midi, const std::vector<CompiledChart>& charts) {
+        std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+            return false;
+
+        return writeBinaryScore(file, midi, charts);
+    }
+
+
+
+    BinaryScoreView::BinaryScoreView()
+        : base(nullptr), size(0), header(nullptr) {}
+
+    BinaryScoreView::~BinaryScoreView() {
+        close();
+    }
+
+    bool BinaryScoreView::open(const std::string & fileName) {
+        close();
+
+        if (!file.open(fileName))
+            return false;
+
+        if (!assign(file.data(), file.size())) {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    bool BinaryScoreView::assign(const void * data, size_t size) {
+        base = static_cast<const char*>(data);
+        this->size = size;
+        header = reinterpret_cast<const binary::FileHeader*>(data);
+
+        if (!verify()) {
+            base = nullptr;
+            this->size = 0;
+            header = nullptr;
+            return false;
+        }
+
+        return true;
+    }
+
+    void BinaryScoreView::close() {
+        file.close();
+        base = nullptr;
+        size = 0;
+        header = nullptr;
+    }
+
+    BinaryScoreView::Table<binary::Tempo> BinaryScoreView::getTempo() const {
+        return { reinterpret_cast<const binary::Tempo*>(base + header->tempoOffset), header->numofTempo };
+    }
+
+    BinaryScoreView::Table<binary::Beat> BinaryScoreView::getBeat() const {
+        return { reinterpret_cast<const binary::Beat*>(base + header->beatOffset), header->numofBeat };
+    }
+
+    BinaryScoreView::Table<binary::Chart> BinaryScoreView::getCharts() const {
+        return { reinterpret_cast<const binary::Chart*>(base + header->chartOffset), header->numofChart };
+    }
+
+    BinaryScoreView::Table<binary::Lane> BinaryScoreView::getLanes(const binary::Chart & chart) const {
+        return { reinterpret_cast<const binary::Lane*>(base + chart.laneOffset), chart.numofLane };
+    }
+
+    BinaryScoreView::Table<binary::Note> BinaryScoreView::getNotes(const binary::Lane & lane) const {
+        return { reinterpret_cast<const binary::Note*>(base + lane.noteOffset), lane.numofNote };
+    }
+
+    template<class T>
+    bool BinaryScoreView::checkTable(uint64_t offset, uint64_t count) const {
+        if (offset % alignof(uint64_t) != 0)
+            return false;
+        if (offset > size || count > (size - offset) / sizeof(T))
+            return false;
+
+        return true;
+    }
+
+    bool BinaryScoreView::verify() const {
+        using namespace binary;
+
+        if (!base || size < sizeof(FileHeader))
+            return false;
+        if (reinterpret_cast<uintptr_t>(base) % alignof(uint64_t) != 0)
+            return false;
+
+        if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0)
+            return false;
+        if (header->version != Version)
+            return false;
+        if (header->fileSize != size)
+            return false;
+
+        if (header->checksum != checksum::hash64(base + sizeof(FileHeader), size - sizeof(FileHeader)))
+            return false;
+
+        if (!checkTable<Tempo>(header->tempoOffset, header->numofTempo) ||
+            !checkTable<Beat>(header->beatOffset, header->numofBeat) ||
+            !checkTable<Chart>(header->chartOffset, header->numofChart))
+            return false;
+
+        for (const auto &chart : getCharts()) {
+            if (!checkTable<Lane>(chart.laneOffset, chart.numofLane))
+                return false;
+
+            for (const auto &lane : getLanes(chart)) {
+                if (!checkTable<Note>(lane.noteOffset, lane.numofNote))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+}
@@ -0,0 +1,177 @@
+﻿//
+// BinaryScore
+// Compact binary form of the score, written alongside the text score.
+// All tables are aligned to 8 bytes, so that the game client can map the file and use it directly.
+//
+//
+// ################################
+// # about binary score format (little endian)
+//
+// FileHeader
+// Tempo    [numofTempo]   at tempoOffset
+// Beat     [numofBeat]    at beatOffset
+// Chart    [numofChart]   at chartOffset
+// Lane     [...]          at Chart::laneOffset, Chart::numofLane elements for each chart
+// Note     [...]          at Lane::noteOffset, Lane::numofNote elements for each lane, sorted by time
+//
+// checksum is hash64 (see Checksum.hpp) of the bytes after FileHeader.
+//
+
+
+#ifndef _BINARY_SCORE_HPP_
+#define _BINARY_SCORE_HPP_
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include "MIDItoScore.hpp"
+#include "MappedFile.hpp"
+
+
+namespace miditoscore {
+
+    namespace binary {
+
+        constexpr char Magic[4] = { 'M', 'T', 'S', 'B' };
+        constexpr uint32_t Version = 1;
+
+        // the structs are written and mapped in the byte order of the host, so the host must be little endian.
+        // MSVC does not define __BYTE_ORDER__, and its targets are little endian.
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+        static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "the binary score requires a little endian host");
+#endif
+
+        struct FileHeader {
+            char magic[4];
+            uint32_t version;
+            uint64_t checksum;
+            uint64_t fileSize;
+            uint32_t resolutionUnit;
+            uint32_t numofTempo;
+            uint32_t numofBeat;
+            uint32_t numofChart;
+            uint64_t tempoOffset;
+            uint64_t beatOffset;
+            uint64_t chartOffset;
+        };
+
+        struct Tempo {
+            int64_t time;
+            int64_t microseconds;
+            int32_t bar;
+            int32_t posNumer;
+            int32_t posDenom;
+            float tempo;
+        };
+
+        struct Beat {
+            int64_t time;
+            int64_t microseconds;
+            int32_t bar;
+            int32_t numer;
+            int32_t denom;
+            int32_t reserved;
+        };
+
+        struct Chart {
+            char name[16];
+            uint32_t numofLane;
+            uint32_t reserved;
+            uint64_t laneOffset;
+        };
+
+        struct Lane {
+            int32_t interval;
+            uint32_t numofNote;
+            uint64_t noteOffset;
+        };
+
+        // a hold note is expressed by one element whose type is HOLD_BEGIN and length is not zero.
+        // the positions are reduced fractions of a bar, which fit in 32 bit for any midi file.
+        struct Note {
+            int64_t time;
+            int64_t microseconds;
+            int64_t length;
+            int64_t lengthMicroseconds;
+            int32_t bar;
+            int32_t posNumer;
+            int32_t posDenom;
+            uint8_t type;
+            uint8_t channel;
+            uint16_t reserved;
+        };
+
+        static_assert(sizeof(FileHeader) == 64, "unexpected padding in FileHeader");
+        static_assert(sizeof(Tempo) == 32, "unexpected padding in Tempo");
+        static_assert(sizeof(Beat) == 32, "unexpected padding in Beat");
+        static_assert(sizeof(Chart) == 32, "unexpected padding in Chart");
+        static_assert(sizeof(Lane) == 16, "unexpected padding in Lane");
+        static_assert(sizeof(Note) == 48, "unexpected padding in Note");
+
+    }
+
+
+    // a chart compiled by MIDItoScore::compileScore()
+    struct CompiledChart {
+        std::string name;
+        std::vector<int> laneAllocation;
+        std::vector<std::vector<binary::Note>> lanes;
+        // not written to the binary score
+        ChartAnalytics analytics;
+    };
+
+
+    // write the header, the tempo and beat tables of the midi file, and the charts.
+    bool writeBinaryScore(std::ostream &stream, const midireader::MIDIReader &midi, const std::vector<CompiledChart> &charts);
+    bool writeBinaryScore(const std::string &fileName, const midireader::MIDIReader &midi, const std::vector<CompiledChart> &charts);
+
+
+    // read only view of the binary score.
+    class BinaryScoreView {
+    public:
+        template<class T>
+        struct Table {
+            const T *first;
+            size_t count;
+
+            const T *begin() const { return first; }
+            const T *end() const { return first + count; }
+            size_t size() const { return count; }
+            const T &operator[](size_t i) const { return first[i]; }
+        };
+
+        BinaryScoreView();
+        ~BinaryScoreView();
+
+        // map the file, and verify it
+        bool open(const std::string &fileName);
+        // use the data in memory. the data must be aligned to 8 bytes, and must live while this view is used.
+        bool assign(const void *data, size_t size);
+        void close();
+
+        const binary::FileHeader &getHeader() const { return *header; }
+        Table<binary::Tempo> getTempo() const;
+        Table<binary::Beat> getBeat() const;
+        Table<binary::Chart> getCharts() const;
+        Table<binary::Lane> getLanes(const binary::Chart &chart) const;
+        Table<binary::Note> getNotes(const binary::Lane &lane) const;
+
+    private:
+        fileio::MappedFile file;
+        const char *base;
+        size_t size;
+        const binary::FileHeader *header;
+
+        template<class T>
+        bool checkTable(uint64_t offset, uint64_t count) const;
+
+        bool verify() const;
+
+    };
+
+}
+
+#endif // !_BINARY_SCORE_HPP_
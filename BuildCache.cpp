@@ -0,0 +1,197 @@
+﻿#include "BuildCache.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+#include "Checksum.hpp"
+#include "MappedFile.hpp"
+
+
+namespace miditoscore {
+
+    namespace fs = std::filesystem;
+
+    namespace {
+
+        constexpr char Magic[4] = { 'M', 'T', 'S', 'C' };
+
+        struct EntryHeader {
+            char magic[4];
+            uint32_t version;
+            uint64_t key;
+            int32_t status;
+            uint32_t reserved;
+            // size of log, score, binary score
+            uint64_t sizes[3];
+            // hash of the bytes after the header
+            uint64_t checksum;
+        };
+
+        static_assert(sizeof(EntryHeader) == 56, "unexpected size of EntryHeader");
+
+        template<typename T>
+        void appendValue(std::string &str, const T &value) {
+            str.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        void appendString(std::string &str, const std::string &value) {
+            appendValue<uint64_t>(str, value.size());
+            str.append(value);
+        }
+
+    }
+
+
+    BuildCache::BuildCache(const fs::path & directory)
+        : directory(directory) {}
+
+    BuildCache::~BuildCache() {}
+
+    bool BuildCache::makeKey(
+        const char * midiData,
+        size_t midiSize,
+        const midireader::MIDIReader & reader,
+        const NoteFormat & format,
+        const SongSettings & song,
+        const OutputProfile & profile,
+        uint64_t & key) {
+
+        // the decider is an arbitrary function, so it can't be a part of the key
+        if (!format.exNoteClassifier && format.exNoteDecider)
+            return false;
+
+        std::string settings;
+
+        // adjustment settings of the reader
+        appendValue<uint64_t>(settings, reader.getAdjustmentAmplitude());
+        appendValue<uint64_t>(settings, reader.getAdjustmentThreshold());
+
+        // note format
+        appendValue<int64_t>(settings, format.holdMinLength.get().n);
+        appendValue<int64_t>(settings, format.holdMinLength.get().d);
+        appendValue<uint64_t>(settings, format.laneAllocation.size());
+        for (auto lane : format.laneAllocation) {
+            appendValue<int32_t>(settings, lane);
+        }
+        appendValue<uint64_t>(settings, format.allowedLineLength);
+        appendValue<uint8_t>(settings, format.parallelsLimit.has_value());
+        appendValue<uint64_t>(settings, format.parallelsLimit.value_or(0));
+        appendValue<int32_t>(settings, static_cast<int32_t>(format.lineEncoding));
+        appendValue<uint8_t>(settings, format.exNoteClassifier.has_value());
+        appendValue<uint64_t>(settings, format.exNoteClassifier ? format.exNoteClassifier->hash() : 0);
+
+        // song settings
+        appendString(settings, song.id);
+        appendValue<uint8_t>(settings, song.intervalAsName);
+        appendValue<int32_t>(settings, static_cast<int32_t>(song.pitchNotation));
+        appendValue(settings, song.chorusBegSec);
+        appendValue(settings, song.chorusEndSec);
+
+        // profile
+        appendString(settings, profile.name);
+        appendValue<uint64_t>(settings, profile.sections.size());
+        for (const auto &section : profile.sections) {
+            appendString(settings, section.trackName);
+            appendString(settings, section.sectionName);
+            appendString(settings, section.label);
+        }
+        appendValue<uint8_t>(settings, profile.songDirectory);
+        appendString(settings, profile.fileSuffix);
+        appendString(settings, profile.extraHeader);
+
+        key = checksum::combine(
+            checksum::hash64(midiData, midiSize, ConverterVersion),
+            checksum::hash64(settings, ConverterVersion)
+        );
+
+        return true;
+    }
+
+    bool BuildCache::load(uint64_t key, Entry & entry) const {
+        fileio::MappedFile file;
+        if (!file.open(entryPath(key).string()))
+            return false;
+
+        if (file.size() < sizeof(EntryHeader))
+            return false;
+
+        EntryHeader header;
+        std::memcpy(&header, file.data(), sizeof(EntryHeader));
+
+        if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 ||
+            header.version != ConverterVersion ||
+            header.key != key) {
+            return false;
+        }
+
+        const char *body = file.data() + sizeof(EntryHeader);
+        const size_t bodySize = file.size() - sizeof(EntryHeader);
+        if (header.sizes[0] + header.sizes[1] + header.sizes[2] != bodySize)
+            return false;
+        if (checksum::hash64(body, bodySize) != header.checksum)
+            return false;
+
+        entry.status = header.status;
+        entry.log.assign(body, header.sizes[0]);
+        body += header.sizes[0];
+        entry.score.assign(body, header.sizes[1]);
+        body += header.sizes[1];
+        entry.binaryScore.assign(body, header.sizes[2]);
+
+        return true;
+    }
+
+    bool BuildCache::store(uint64_t key, const Entry & entry) const {
+        std::error_code ec;
+        fs::create_directories(directory, ec);
+
+        const std::string body = entry.log + entry.score + entry.binaryScore;
+
+        EntryHeader header;
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = ConverterVersion;
+        header.key = key;
+        header.status = entry.status;
+        header.reserved = 0;
+        header.sizes[0] = entry.log.size();
+        header.sizes[1] = entry.score.size();
+        header.sizes[2] = entry.binaryScore.size();
+        header.checksum = checksum::hash64(body);
+
+        // the name of the temporary file is unique for each thread
+        std::ostringstream tempName;
+        tempName << entryPath(key).filename().string() << '.' << std::this_thread::get_id() << ".tmp";
+        const fs::path tempPath = directory / tempName.str();
+
+        {
+            std::ofstream file(tempPath, std::ios::binary);
+            if (!file.is_open())
+                return false;
+
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(body.data(), body.size());
+
+            if (!file)
+                return false;
+        }
+
+        fs::rename(tempPath, entryPath(key), ec);
+        if (ec) {
+            fs::remove(tempPath, ec);
+            return false;
+        }
+
+        return true;
+    }
+
+    fs::path BuildCache::entryPath(uint64_t key) const {
+        std::ostringstream name;
+        name << std::hex << std::setfill('0') << std::setw(16) << key << ".cache";
+
+        return directory / name.str();
+    }
+
+}
@@ -0,0 +1,65 @@
+﻿//
+// BuildCache
+// This class stores the outputs of a conversion on the disk, keyed by the hash of the midi file and the settings.
+// When the same midi file is converted with the same settings, the outputs are restored from the cache
+// without reading the midi file or writing the score.
+//
+// The key contains ConverterVersion, so the entries made by another version are never hit.
+//
+
+
+#ifndef _BUILD_CACHE_HPP_
+#define _BUILD_CACHE_HPP_
+
+
+#include <string>
+#include <cstdint>
+#include <filesystem>
+
+#include "ScoreExporter.hpp"
+
+
+namespace miditoscore {
+
+    class BuildCache {
+    public:
+        struct Entry {
+            // return value of exportProfile()
+            int status;
+            std::string log;
+            std::string score;
+            std::string binaryScore;
+        };
+
+        explicit BuildCache(const std::filesystem::path &directory);
+        ~BuildCache();
+
+        // make the key from the midi file and all settings which affect the outputs.
+        // return false if the outputs can't be cached (exNoteDecider is used instead of exNoteClassifier).
+        static bool makeKey(
+            const char *midiData,
+            size_t midiSize,
+            const midireader::MIDIReader &reader,
+            const NoteFormat &format,
+            const SongSettings &song,
+            const OutputProfile &profile,
+            uint64_t &key
+        );
+
+        // return false if there is no valid entry of the key
+        bool load(uint64_t key, Entry &entry) const;
+        // the entry is written to a temporary file and renamed, so the other threads never read a broken entry
+        bool store(uint64_t key, const Entry &entry) const;
+
+        const std::filesystem::path &getDirectory() const { return directory; }
+
+    private:
+        std::filesystem::path entryPath(uint64_t key) const;
+
+        std::filesystem::path directory;
+
+    };
+
+}
+
+#endif // !_BUILD_CACHE_HPP_
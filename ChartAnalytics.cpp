@@ -0,0 +1,122 @@
+﻿#include "ChartAnalytics.hpp"
+#include "TempoMap.hpp"
+#include "ChordIndex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+
+namespace miditoscore {
+
+    void ChartAnalyzer::begin(const midireader::TempoMap & tempoMap, double windowSeconds) {
+        clear();
+
+        this->tempoMap = &tempoMap;
+        analytics.windowSeconds = windowSeconds > 0 ? windowSeconds : 1.0;
+    }
+
+    void ChartAnalyzer::clear() {
+        tempoMap = nullptr;
+
+        // the buffers keep their capacity
+        auto curve = std::move(analytics.npsCurve);
+        curve.clear();
+        analytics = ChartAnalytics();
+        analytics.npsCurve = std::move(curve);
+
+        noteSeconds.clear();
+        windowBegin = 0;
+        holds.clear();
+    }
+
+    void ChartAnalyzer::addNote(int64_t midiTime) {
+        const double seconds = tempoMap->toSeconds(midiTime);
+
+        // notes per second
+        const size_t second = static_cast<size_t>(std::max(seconds, 0.0));
+        if (analytics.npsCurve.size() <= second)
+            analytics.npsCurve.resize(second + 1, 0);
+        analytics.npsCurve[second]++;
+
+        // the notes in (seconds - window, seconds]
+        noteSeconds.push_back(seconds);
+        while (noteSeconds[windowBegin] <= seconds - analytics.windowSeconds) {
+            windowBegin++;
+        }
+
+        const size_t windowNotes = noteSeconds.size() - windowBegin;
+        if (windowNotes > analytics.peakWindowNotes) {
+            analytics.peakWindowNotes = windowNotes;
+            analytics.peakWindowBeginSeconds = noteSeconds[windowBegin];
+        }
+
+        if (analytics.numofNotes == 0)
+            analytics.firstNoteSeconds = seconds;
+        analytics.lastNoteSeconds = seconds;
+        analytics.numofNotes++;
+    }
+
+    void ChartAnalyzer::addHold(int64_t beginTime, int64_t endTime) {
+        const double begin = tempoMap->toSeconds(beginTime);
+        const double end = tempoMap->toSeconds(endTime);
+
+        holds.emplace_back(begin, end);
+        analytics.holdSeconds += end - begin;
+        analytics.numofHolds++;
+    }
+
+    const ChartAnalytics & ChartAnalyzer::finish(const ChordIndex & chords) {
+        analytics.numofChords = chords.countChords(2);
+        analytics.maxChordSize = chords.maxLaneCount();
+
+        const double duration = analytics.lastNoteSeconds - analytics.firstNoteSeconds;
+        analytics.averageNps = duration > 0 ? analytics.numofNotes / duration : static_cast<double>(analytics.numofNotes);
+        analytics.peakNps = analytics.peakWindowNotes / analytics.windowSeconds;
+
+        // the union of the holds
+        std::sort(holds.begin(), holds.end());
+
+        double covered = 0;
+        double coveredEnd = analytics.firstNoteSeconds;
+        for (const auto &h : holds) {
+            const double begin = std::max(h.first, coveredEnd);
+            const double end = std::min(h.second, analytics.lastNoteSeconds);
+            if (end > begin)
+                covered += end - begin;
+            coveredEnd = std::max(coveredEnd, h.second);
+        }
+        analytics.holdCoverage = duration > 0 ? covered / duration : 0;
+
+        return analytics;
+    }
+
+    void writeAnalyticsJson(std::ostream & stream, const ChartAnalytics & analytics) {
+        const auto flags = stream.flags();
+        const auto precision = stream.precision();
+        stream << std::fixed << std::setprecision(3);
+
+        stream << "{ \"notes\": " << analytics.numofNotes
+            << ", \"holds\": " << analytics.numofHolds
+            << ", \"chords\": " << analytics.numofChords
+            << ", \"maxChordSize\": " << analytics.maxChordSize
+            << ", \"firstNoteSeconds\": " << analytics.firstNoteSeconds
+            << ", \"lastNoteSeconds\": " << analytics.lastNoteSeconds
+            << ", \"averageNps\": " << analytics.averageNps
+            << ", \"windowSeconds\": " << analytics.windowSeconds
+            << ", \"peakWindowNotes\": " << analytics.peakWindowNotes
+            << ", \"peakWindowBeginSeconds\": " << analytics.peakWindowBeginSeconds
+            << ", \"peakNps\": " << analytics.peakNps
+            << ", \"holdSeconds\": " << analytics.holdSeconds
+            << ", \"holdCoverage\": " << analytics.holdCoverage
+            << ", \"npsCurve\": [";
+        for (size_t i = 0; i < analytics.npsCurve.size(); i++) {
+            stream << (i > 0 ? ", " : "") << analytics.npsCurve[i];
+        }
+        stream << "] }";
+
+        stream.flags(flags);
+        stream.precision(precision);
+    }
+
+}
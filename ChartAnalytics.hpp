@@ -0,0 +1,91 @@
+﻿//
+// ChartAnalytics
+// Density of a chart in real time (notes per second, the peak of a sliding window, chords and holds),
+// which is computed while MIDItoScore groups the notes, so the chart is not read again to rate it.
+//
+
+
+#ifndef _CHART_ANALYTICS_HPP_
+#define _CHART_ANALYTICS_HPP_
+
+
+#include <cstdint>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+
+namespace midireader {
+
+    class TempoMap;
+
+}
+
+
+namespace miditoscore {
+
+    class ChordIndex;
+
+
+    struct ChartAnalytics {
+        // hit, ex hit and hold begin notes
+        size_t numofNotes = 0;
+        size_t numofHolds = 0;
+        // the ticks where the notes are placed on 2 or more lanes
+        size_t numofChords = 0;
+        size_t maxChordSize = 0;
+
+        double firstNoteSeconds = 0;
+        double lastNoteSeconds = 0;
+        // notes per second between the first and last note
+        double averageNps = 0;
+        // number of the notes in each second from the beginning of the song
+        std::vector<uint32_t> npsCurve;
+
+        // the window which contains the most notes
+        double windowSeconds = 1;
+        size_t peakWindowNotes = 0;
+        double peakWindowBeginSeconds = 0;
+        double peakNps = 0;
+
+        // total length of the holds
+        double holdSeconds = 0;
+        // ratio of the time holding any note, between the first and last note
+        double holdCoverage = 0;
+    };
+
+
+    // the notes must be added in the order of the time
+    class ChartAnalyzer {
+    public:
+        void begin(const midireader::TempoMap &tempoMap, double windowSeconds = 1.0);
+        void addNote(int64_t midiTime);
+        void addHold(int64_t beginTime, int64_t endTime);
+        // the chords are counted from the groups of the notes at the same tick
+        const ChartAnalytics &finish(const ChordIndex &chords);
+
+        // discard the analytics. isActive() returns false until the next begin().
+        void clear();
+
+        bool isActive() const { return tempoMap != nullptr; }
+        const ChartAnalytics &get() const { return analytics; }
+
+    private:
+        const midireader::TempoMap *tempoMap = nullptr;
+        ChartAnalytics analytics;
+
+        // the seconds of the notes, and the first note in the sliding window
+        std::vector<double> noteSeconds;
+        size_t windowBegin = 0;
+
+        // (begin, end) seconds
+        std::vector<std::pair<double, double>> holds;
+
+    };
+
+
+    void writeAnalyticsJson(std::ostream &stream, const ChartAnalytics &analytics);
+
+}
+
+#endif // !_CHART_ANALYTICS_HPP_
@@ -0,0 +1,48 @@
+﻿#include "Checksum.hpp"
+
+#include <cstring>
+
+
+namespace checksum {
+
+    // based on MurmurHash64A
+    uint64_t hash64(const void * data, size_t size, uint64_t seed) {
+        constexpr uint64_t m = 0xc6a4a7935bd1e995ull;
+        constexpr int r = 47;
+
+        const unsigned char *p = static_cast<const unsigned char*>(data);
+        uint64_t h = seed ^ (size * m);
+
+        const size_t numofBlocks = size / 8;
+        for (size_t i = 0; i < numofBlocks; i++) {
+            uint64_t k;
+            std::memcpy(&k, p + i * 8, 8);
+
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+
+            h ^= k;
+            h *= m;
+        }
+
+        const unsigned char *tail = p + numofBlocks * 8;
+        switch (size & 7) {
+        case 7: h ^= static_cast<uint64_t>(tail[6]) << 48; [[fallthrough]];
+        case 6: h ^= static_cast<uint64_t>(tail[5]) << 40; [[fallthrough]];
+        case 5: h ^= static_cast<uint64_t>(tail[4]) << 32; [[fallthrough]];
+        case 4: h ^= static_cast<uint64_t>(tail[3]) << 24; [[fallthrough]];
+        case 3: h ^= static_cast<uint64_t>(tail[2]) << 16; [[fallthrough]];
+        case 2: h ^= static_cast<uint64_t>(tail[1]) << 8; [[fallthrough]];
+        case 1: h ^= static_cast<uint64_t>(tail[0]);
+            h *= m;
+        }
+
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+
+        return h;
+    }
+
+}
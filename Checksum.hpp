@@ -0,0 +1,31 @@
+﻿//
+// Checksum
+// Fast non-cryptographic 64-bit hash, used to validate files and to make cache keys.
+//
+
+
+#ifndef _CHECKSUM_HPP_
+#define _CHECKSUM_HPP_
+
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+
+namespace checksum {
+
+    uint64_t hash64(const void *data, size_t size, uint64_t seed = 0);
+
+    inline uint64_t hash64(const std::string &str, uint64_t seed = 0) {
+        return hash64(str.data(), str.size(), seed);
+    }
+
+    // combine two hash values
+    inline uint64_t combine(uint64_t seed, uint64_t value) {
+        return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+    }
+
+}
+
+#endif // !_CHECKSUM_HPP_
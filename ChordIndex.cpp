@@ -0,0 +1,73 @@
+﻿#include "ChordIndex.hpp"
+
+#include <algorithm>
+
+
+namespace miditoscore {
+
+    void ChordIndex::clear() {
+        entries.clear();
+        sorted = true;
+
+        ticks.clear();
+        offsets.clear();
+        laneMasks.clear();
+        laneCounts.clear();
+        maxLanes = 0;
+    }
+
+    void ChordIndex::add(midireader::tick_t time, size_t lane, size_t note) {
+        if (!entries.empty() && time < entries.back().time)
+            sorted = false;
+
+        entries.push_back(Entry{ time, static_cast<uint32_t>(lane), static_cast<uint32_t>(note) });
+    }
+
+    void ChordIndex::build() {
+        if (!sorted) {
+            // keep the order of the notes at the same tick
+            std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.time < b.time; });
+            sorted = true;
+        }
+
+        ticks.clear();
+        offsets.clear();
+        laneMasks.clear();
+        laneCounts.clear();
+        maxLanes = 0;
+
+        for (size_t i = 0; i < entries.size(); i++) {
+            const auto &e = entries[i];
+            if (ticks.empty() || ticks.back() != e.time) {
+                ticks.push_back(e.time);
+                offsets.push_back(static_cast<uint32_t>(i));
+                laneMasks.push_back(0);
+                laneCounts.push_back(0);
+            }
+
+            auto &mask = laneMasks.back();
+            if (e.lane >= MaskLanes) {
+                laneCounts.back()++;
+            } else if (!(mask & (uint64_t(1) << e.lane))) {
+                mask |= uint64_t(1) << e.lane;
+                laneCounts.back()++;
+            }
+
+            maxLanes = std::max<size_t>(maxLanes, laneCounts.back());
+        }
+        offsets.push_back(static_cast<uint32_t>(entries.size()));
+    }
+
+    std::optional<size_t> ChordIndex::find(midireader::tick_t time) const {
+        const auto it = std::lower_bound(ticks.cbegin(), ticks.cend(), time);
+        if (it == ticks.cend() || *it != time)
+            return std::nullopt;
+
+        return static_cast<size_t>(it - ticks.cbegin());
+    }
+
+    size_t ChordIndex::countChords(size_t minLanes) const {
+        return std::count_if(laneCounts.cbegin(), laneCounts.cend(), [minLanes](uint32_t n) { return n >= minLanes; });
+    }
+
+}
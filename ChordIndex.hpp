@@ -0,0 +1,87 @@
+﻿//
+// ChordIndex
+// Groups the note-ons placed at the same tick, and keeps the lanes of each group as a bitmask.
+// The notes are added in the order of the track (sorted by time), and build() groups them in one pass.
+// The ticks are sorted and unique, so a chord at a tick is found by binary search.
+//
+// --- example -----------------------------
+// index.clear();
+// for (each note-on) index.add(note.time, lane, noteIndex);
+// index.build();
+// for (size_t g = 0; g < index.size(); g++) {
+//     if (index.laneCount(g) > limit) ...
+// }
+// ------------------------------------------
+//
+
+
+#ifndef _CHORD_INDEX_HPP_
+#define _CHORD_INDEX_HPP_
+
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "MIDIReader.hpp"
+
+
+namespace miditoscore {
+
+    class ChordIndex {
+    public:
+        // the lanes over this are not in the bitmask, but counted as different lanes
+        static constexpr size_t MaskLanes = 64;
+
+        struct Entry {
+            midireader::tick_t time;
+            uint32_t lane;
+            // index of the note in the source events
+            uint32_t note;
+        };
+
+        void clear();
+        void add(midireader::tick_t time, size_t lane, size_t note);
+        // group the added notes. they are sorted by time if they were not added in order.
+        void build();
+
+        // number of the groups (unique ticks)
+        size_t size() const { return ticks.size(); }
+        bool empty() const { return ticks.empty(); }
+
+        midireader::tick_t tick(size_t group) const { return ticks[group]; }
+        // number of the notes in the group
+        size_t groupSize(size_t group) const { return offsets[group + 1] - offsets[group]; }
+        // number of the different lanes in the group
+        size_t laneCount(size_t group) const { return laneCounts[group]; }
+        uint64_t laneMask(size_t group) const { return laneMasks[group]; }
+        // more than one note on the same lane at the same tick
+        bool hasLaneConflict(size_t group) const { return groupSize(group) > laneCount(group); }
+
+        // the notes of the group, in the order they were added
+        const Entry *begin(size_t group) const { return entries.data() + offsets[group]; }
+        const Entry *end(size_t group) const { return entries.data() + offsets[group + 1]; }
+
+        // the group at the tick
+        std::optional<size_t> find(midireader::tick_t time) const;
+
+        // number of the groups which have minLanes lanes or more
+        size_t countChords(size_t minLanes = 2) const;
+        size_t maxLaneCount() const { return maxLanes; }
+
+    private:
+        std::vector<Entry> entries;
+        bool sorted = true;
+
+        std::vector<midireader::tick_t> ticks;
+        // the notes of group g are entries [offsets[g], offsets[g + 1])
+        std::vector<uint32_t> offsets;
+        std::vector<uint64_t> laneMasks;
+        std::vector<uint32_t> laneCounts;
+        size_t maxLanes = 0;
+
+    };
+
+}
+
+#endif // !_CHORD_INDEX_HPP_
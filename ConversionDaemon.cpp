@@ -0,0 +1,488 @@
+﻿#include "ConversionDaemon.hpp"
+
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+
+#include "ScoreExporter.hpp"
+#include "BatchConverter.hpp"
+#include "BinaryScore.hpp"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+namespace miditoscore {
+
+    namespace {
+
+        constexpr char RequestMagic[4] = { 'M', 'T', 'S', 'J' };
+        constexpr char ResponseMagic[4] = { 'M', 'T', 'S', 'R' };
+        constexpr uint32_t ProtocolVersion = 1;
+
+        constexpr uint32_t MaxJobSize = 64 * 1024;
+        constexpr uint64_t MaxMidiSize = 64 * 1024 * 1024;
+
+        // a client which stops sending is disconnected
+        constexpr int SocketTimeoutSec = 30;
+
+        struct RequestHeader {
+            char magic[4];
+            uint32_t version;
+            uint32_t flags;
+            uint32_t jobSize;
+            uint64_t midiSize;
+        };
+        static_assert(sizeof(RequestHeader) == 24, "unexpected padding");
+
+        struct ResponseHeader {
+            char magic[4];
+            int32_t readStatus;
+            int32_t scoreStatus;
+            uint32_t succeeded;
+            uint64_t textSize;
+            uint64_t binarySize;
+            uint64_t logSize;
+        };
+        static_assert(sizeof(ResponseHeader) == 40, "unexpected padding");
+
+#ifndef _WIN32
+        bool receiveAll(int fd, void *data, size_t size) {
+            char *p = static_cast<char*>(data);
+            while (size > 0) {
+                const ssize_t n = recv(fd, p, size, 0);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return false;
+
+                p += n;
+                size -= static_cast<size_t>(n);
+            }
+
+            return true;
+        }
+
+        bool sendAll(int fd, const void *data, size_t size) {
+#ifdef MSG_NOSIGNAL
+            constexpr int flags = MSG_NOSIGNAL;
+#else
+            constexpr int flags = 0;
+#endif
+            const char *p = static_cast<const char*>(data);
+            while (size > 0) {
+                const ssize_t n = send(fd, p, size, flags);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return false;
+
+                p += n;
+                size -= static_cast<size_t>(n);
+            }
+
+            return true;
+        }
+
+        void setTimeout(int fd) {
+            timeval tv = {};
+            tv.tv_sec = SocketTimeoutSec;
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#ifdef SO_NOSIGPIPE
+            const int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        }
+
+        bool makeAddress(const std::string &socketPath, sockaddr_un &address) {
+            address = {};
+            address.sun_family = AF_UNIX;
+            if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+                return false;
+
+            std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+            return true;
+        }
+
+        bool sendResponse(int fd, const ConversionResponse &response) {
+            ResponseHeader header;
+            std::memcpy(header.magic, ResponseMagic, sizeof(header.magic));
+            header.readStatus = static_cast<int32_t>(response.readStatus);
+            header.scoreStatus = response.scoreStatus;
+            header.succeeded = response.succeeded ? 1 : 0;
+            header.textSize = response.text.size();
+            header.binarySize = response.binary.size();
+            header.logSize = response.log.size();
+
+            return sendAll(fd, &header, sizeof(header)) &&
+                sendAll(fd, response.text.data(), response.text.size()) &&
+                sendAll(fd, response.binary.data(), response.binary.size()) &&
+                sendAll(fd, response.log.data(), response.log.size());
+        }
+#endif
+
+    }
+
+
+    void convertJob(
+        midireader::MIDIReader & reader,
+        MIDItoScore & converter,
+        const std::vector<OutputProfile> & defaultProfiles,
+        const std::string & job,
+        const char * midi,
+        size_t midiSize,
+        uint32_t flags,
+        ConversionResponse & response) {
+
+        response = ConversionResponse();
+
+        std::istringstream jobStream(job);
+        std::ostringstream log;
+        std::vector<BatchEntry> entries;
+        if (!readManifest(jobStream, std::filesystem::path(), defaultProfiles, entries, log, false)) {
+            response.log = log.str();
+            return;
+        }
+        if (entries.size() != 1) {
+            response.log = "[!] ジョブには曲を1つだけ指定してください\n";
+            return;
+        }
+
+        const auto &entry = entries.front();
+        const auto &profile = entry.profiles.front();
+
+        reader.setAdjustmentAmplitude(2, 1024);
+        response.readStatus = reader.readFromMemory(midi, midiSize);
+
+        log << "MIDIファイルを読み込んでいます... ";
+        if (!printReadStatus(log, response.readStatus, reader)) {
+            response.log = log.str();
+            return;
+        }
+
+        std::ostringstream text;
+        std::vector<CompiledChart> charts;
+        response.scoreStatus = writeProfileScore(
+            text, log, reader, entry.song, profile,
+            (flags & RequestBinary) ? &charts : nullptr,
+            nullptr,
+            &converter
+        );
+        response.succeeded = true;
+
+        if (flags & RequestText)
+            response.text = text.str();
+
+        if (flags & RequestBinary) {
+            std::ostringstream binary(std::ios::binary);
+            if (writeBinaryScore(binary, reader, charts)) {
+                response.binary = binary.str();
+            } else {
+                log << "[!] バイナリ譜面の書き出しに失敗しました\n";
+                response.succeeded = false;
+            }
+        }
+
+        response.log = log.str();
+    }
+
+
+#ifndef _WIN32
+
+    ConversionDaemon::ConversionDaemon()
+        : listenFd(-1), wakeFds{ -1, -1 }, stopping(false), queueLimit(0), finished(false) {}
+
+    ConversionDaemon::~ConversionDaemon() {
+        stop();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+        }
+        queueNotEmpty.notify_all();
+
+        for (auto &worker : workers) {
+            if (worker->thread.joinable())
+                worker->thread.join();
+        }
+        for (int fd : queue) {
+            ::close(fd);
+        }
+
+        closeSocket();
+
+        for (int fd : wakeFds) {
+            if (fd >= 0)
+                ::close(fd);
+        }
+    }
+
+    bool ConversionDaemon::open(
+        const std::string & path,
+        const std::vector<OutputProfile> & profiles,
+        size_t numofWorkers,
+        size_t limit,
+        std::ostream & err) {
+
+        if (profiles.empty()) {
+            err << "[!] プロファイルが指定されていません\n";
+            return false;
+        }
+        defaultProfiles = profiles;
+
+        sockaddr_un address;
+        if (!makeAddress(path, address)) {
+            err << "[!] ソケットのパスが正しくありません: " << path << '\n';
+            return false;
+        }
+
+        if (pipe(wakeFds) != 0) {
+            err << "[!] " << std::strerror(errno) << '\n';
+            return false;
+        }
+        fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0) {
+            err << "[!] ソケットを作成できません: " << std::strerror(errno) << '\n';
+            closeSocket();
+            return false;
+        }
+
+        // the socket file of the previous run is replaced
+        ::unlink(path.c_str());
+
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(listenFd, static_cast<int>(limit > 0 ? limit : 16)) != 0) {
+            err << "[!] ソケットを開けません: " << std::strerror(errno) << '\n';
+            closeSocket();
+            return false;
+        }
+        socketPath = path;
+
+        if (numofWorkers == 0)
+            numofWorkers = std::max(1u, std::thread::hardware_concurrency());
+        queueLimit = limit > 0 ? limit : numofWorkers;
+
+        for (size_t i = 0; i < numofWorkers; i++) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (auto &worker : workers) {
+            worker->thread = std::thread(&ConversionDaemon::work, this, std::ref(*worker));
+        }
+
+        return true;
+    }
+
+    void ConversionDaemon::run() {
+        while (!stopping) {
+            // stop accepting while the queue is full.
+            // stop() from a signal handler cannot notify, so the flag is checked periodically.
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (queue.size() >= queueLimit && !stopping) {
+                    queueNotFull.wait_for(lock, std::chrono::milliseconds(100));
+                }
+            }
+
+            pollfd fds[2] = {
+                { listenFd, POLLIN, 0 },
+                { wakeFds[0], POLLIN, 0 }
+            };
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            if (fds[1].revents != 0 || stopping)
+                break;
+            if ((fds[0].revents & POLLIN) == 0)
+                continue;
+
+            const int client = accept(listenFd, nullptr, nullptr);
+            if (client < 0)
+                continue;
+            setTimeout(client);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(client);
+            }
+            queueNotEmpty.notify_one();
+        }
+
+        // finish the queued jobs
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+        }
+        queueNotEmpty.notify_all();
+
+        for (auto &worker : workers) {
+            if (worker->thread.joinable())
+                worker->thread.join();
+        }
+
+        closeSocket();
+    }
+
+    void ConversionDaemon::stop() {
+        stopping = true;
+
+        // write() is async-signal-safe
+        if (wakeFds[1] >= 0) {
+            const char ch = 0;
+            ssize_t n = write(wakeFds[1], &ch, 1);
+            (void)n;
+        }
+    }
+
+    void ConversionDaemon::work(Worker & worker) {
+        while (true) {
+            int client;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                queueNotEmpty.wait(lock, [&]() { return !queue.empty() || finished; });
+                if (queue.empty())
+                    return;
+
+                client = queue.front();
+                queue.pop_front();
+            }
+            queueNotFull.notify_one();
+
+            handle(worker, client);
+            ::close(client);
+        }
+    }
+
+    void ConversionDaemon::handle(Worker & worker, int client) {
+        RequestHeader header;
+        if (!receiveAll(client, &header, sizeof(header)))
+            return;
+
+        ConversionResponse response;
+
+        if (std::memcmp(header.magic, RequestMagic, sizeof(header.magic)) != 0 || header.version != ProtocolVersion) {
+            response.readStatus = midireader::Status::E_INVALID_ARG;
+            response.log = "[!] リクエストの形式が正しくありません\n";
+            sendResponse(client, response);
+            return;
+        }
+        if (header.jobSize > MaxJobSize || header.midiSize > MaxMidiSize) {
+            response.readStatus = midireader::Status::E_INVALID_ARG;
+            response.log = "[!] リクエストが大きすぎます\n";
+            sendResponse(client, response);
+            return;
+        }
+
+        // the buffers of the worker are reused
+        worker.job.resize(header.jobSize);
+        worker.midi.resize(static_cast<size_t>(header.midiSize));
+        if (!receiveAll(client, &worker.job[0], worker.job.size()) ||
+            !receiveAll(client, &worker.midi[0], worker.midi.size()))
+            return;
+
+        try {
+            convertJob(worker.reader, worker.converter, defaultProfiles, worker.job, worker.midi.data(), worker.midi.size(), header.flags, response);
+        } catch (const std::exception &e) {
+            response = ConversionResponse();
+            response.log = std::string("[!] ") + e.what() + "\n";
+        }
+
+        sendResponse(client, response);
+    }
+
+    void ConversionDaemon::closeSocket() {
+        if (listenFd >= 0) {
+            ::close(listenFd);
+            listenFd = -1;
+            if (!socketPath.empty())
+                ::unlink(socketPath.c_str());
+        }
+
+        // the pipe is kept until destruction, so that stop() can be called at any time
+    }
+
+    bool requestConversion(const std::string & socketPath, const ConversionRequest & request, ConversionResponse & response) {
+        sockaddr_un address;
+        if (!makeAddress(socketPath, address))
+            return false;
+
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return false;
+        setTimeout(fd);
+
+        bool ok = connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+
+        if (ok) {
+            RequestHeader header;
+            std::memcpy(header.magic, RequestMagic, sizeof(header.magic));
+            header.version = ProtocolVersion;
+            header.flags = request.flags;
+            header.jobSize = static_cast<uint32_t>(request.job.size());
+            header.midiSize = request.midi.size();
+
+            ok = sendAll(fd, &header, sizeof(header)) &&
+                sendAll(fd, request.job.data(), request.job.size()) &&
+                sendAll(fd, request.midi.data(), request.midi.size());
+        }
+
+        ResponseHeader header;
+        if (ok)
+            ok = receiveAll(fd, &header, sizeof(header)) && std::memcmp(header.magic, ResponseMagic, sizeof(header.magic)) == 0;
+
+        if (ok) {
+            response.readStatus = static_cast<midireader::Status>(header.readStatus);
+            response.scoreStatus = header.scoreStatus;
+            response.succeeded = header.succeeded != 0;
+            response.text.resize(static_cast<size_t>(header.textSize));
+            response.binary.resize(static_cast<size_t>(header.binarySize));
+            response.log.resize(static_cast<size_t>(header.logSize));
+
+            ok = receiveAll(fd, &response.text[0], response.text.size()) &&
+                receiveAll(fd, &response.binary[0], response.binary.size()) &&
+                receiveAll(fd, &response.log[0], response.log.size());
+        }
+
+        ::close(fd);
+
+        return ok;
+    }
+
+#else
+
+    ConversionDaemon::ConversionDaemon()
+        : listenFd(-1), wakeFds{ -1, -1 }, stopping(false), queueLimit(0), finished(false) {}
+
+    ConversionDaemon::~ConversionDaemon() {}
+
+    bool ConversionDaemon::open(const std::string &, const std::vector<OutputProfile> &, size_t, size_t, std::ostream & err) {
+        err << "[!] この環境ではデーモンを使用できません\n";
+        return false;
+    }
+
+    void ConversionDaemon::run() {}
+    void ConversionDaemon::stop() {}
+    void ConversionDaemon::work(Worker &) {}
+    void ConversionDaemon::handle(Worker &, int) {}
+    void ConversionDaemon::closeSocket() {}
+
+    bool requestConversion(const std::string &, const ConversionRequest &, ConversionResponse &) {
+        return false;
+    }
+
+#endif
+
+}
@@ -0,0 +1,152 @@
+﻿//
+// ConversionDaemon
+// This class converts the midi files sent over a unix domain socket, so that tools can convert a file
+// without starting the process for each file. The reader and converter of each worker are reused between the jobs.
+// Only local connections are accepted, and the socket is not available on Windows.
+//
+// --- request ------------------------------
+// char     magic[4]        "MTSJ"
+// uint32   version         1
+// uint32   flags           RequestText | RequestBinary
+// uint32   jobSize
+// uint64   midiSize
+// char     job[jobSize]    one entry of the manifest of BatchConverter (midi, music and jacket are not needed)
+// char     midi[midiSize]  the midi file
+// --- response -----------------------------
+// char     magic[4]        "MTSR"
+// int32    readStatus      midireader::Status
+// int32    scoreStatus     status of writeScore() of all sections
+// uint32   succeeded       1 if the score is written
+// uint64   textSize
+// uint64   binarySize
+// uint64   logSize
+// char     text[textSize], binary[binarySize], log[logSize]
+// ------------------------------------------
+// integers are in the byte order of the host. a connection carries one request.
+// if the job has several profiles, only the first one is converted. the job without "profile" uses the default profile.
+// when all workers are busy and the queue is full, the new connections wait in the backlog of the socket.
+//
+
+
+#ifndef _CONVERSION_DAEMON_HPP_
+#define _CONVERSION_DAEMON_HPP_
+
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <ostream>
+#include <condition_variable>
+
+#include "MIDIReader.hpp"
+#include "MIDItoScore.hpp"
+#include "ScoreExporter.hpp"
+
+
+namespace miditoscore {
+
+    enum RequestFlag : uint32_t {
+        RequestText = 1,
+        RequestBinary = 2
+    };
+
+    struct ConversionRequest {
+        // ex. "[7]\nlanes=F3,E3,D3,C3\nhold=1/4\nprofile=wii\n"
+        std::string job;
+        std::string midi;
+        uint32_t flags = RequestText;
+    };
+
+    struct ConversionResponse {
+        bool succeeded = false;
+        midireader::Status readStatus = midireader::Status::S_OK;
+        int scoreStatus = Status::S_OK;
+        std::string text;
+        std::string binary;
+        // the same messages as the interactive conversion
+        std::string log;
+    };
+
+
+    class ConversionDaemon {
+    public:
+        ConversionDaemon();
+        ~ConversionDaemon();
+
+        ConversionDaemon(const ConversionDaemon&) = delete;
+        ConversionDaemon &operator=(const ConversionDaemon&) = delete;
+
+        // create the socket and start the workers. the existing socket file is replaced.
+        // if numofWorkers is 0, the number of hardware threads is used.
+        // queueLimit is the number of the accepted connections waiting for the workers.
+        bool open(
+            const std::string &socketPath,
+            const std::vector<OutputProfile> &defaultProfiles,
+            size_t numofWorkers,
+            size_t queueLimit,
+            std::ostream &err
+        );
+
+        // accept the connections until stop() is called, and wait for the queued jobs.
+        void run();
+
+        // can be called from the other threads and the signal handlers
+        void stop();
+
+    private:
+        struct Worker {
+            midireader::MIDIReader reader;
+            MIDItoScore converter;
+            std::string job;
+            std::string midi;
+            std::thread thread;
+        };
+
+        void work(Worker &worker);
+        void handle(Worker &worker, int client);
+
+        void closeSocket();
+
+        std::string socketPath;
+        std::vector<OutputProfile> defaultProfiles;
+        int listenFd;
+        // written by stop() to wake up run()
+        int wakeFds[2];
+        std::atomic<bool> stopping;
+
+        std::vector<std::unique_ptr<Worker>> workers;
+
+        std::mutex mutex;
+        std::condition_variable queueNotEmpty;
+        std::condition_variable queueNotFull;
+        std::deque<int> queue;
+        size_t queueLimit;
+        bool finished;
+
+    };
+
+
+    // convert the job with the reader and converter.
+    void convertJob(
+        midireader::MIDIReader &reader,
+        MIDItoScore &converter,
+        const std::vector<OutputProfile> &defaultProfiles,
+        const std::string &job,
+        const char *midi,
+        size_t midiSize,
+        uint32_t flags,
+        ConversionResponse &response
+    );
+
+    // send the request to the daemon and receive the response.
+    // return false if the communication failed.
+    bool requestConversion(const std::string &socketPath, const ConversionRequest &request, ConversionResponse &response);
+
+}
+
+#endif // !_CONVERSION_DAEMON_HPP_
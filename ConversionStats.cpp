@@ -0,0 +1,156 @@
+﻿#include "ConversionStats.hpp"
+
+#include <iomanip>
+#include <algorithm>
+
+
+namespace stats {
+
+    ConversionStats & current() {
+        thread_local ConversionStats stats;
+        return stats;
+    }
+
+    void enable(bool enabled) {
+        current().enabled = enabled;
+    }
+
+    void reset() {
+        auto &stats = current();
+        stats.reader = ReaderStats();
+        stats.writer = WriterStats();
+    }
+
+    void addLineLength(WriterStats & writer, size_t length) {
+        writer.lines++;
+        writer.totalLineLength += length;
+        if (length > writer.maxLineLength)
+            writer.maxLineLength = length;
+
+        size_t bucket = 0;
+        for (size_t limit = 4; bucket + 1 < writer.lineLengthHistogram.size() && length > limit; limit *= 4) {
+            bucket++;
+        }
+        writer.lineLengthHistogram[bucket]++;
+    }
+
+    void accumulate(ConversionStats & total, const ConversionStats & stats) {
+        auto &r = total.reader;
+        const auto &sr = stats.reader;
+        r.bytesRead += sr.bytesRead;
+        r.noteOnEvents += sr.noteOnEvents;
+        r.noteOffEvents += sr.noteOffEvents;
+        r.tempoEvents += sr.tempoEvents;
+        r.timeSignatureEvents += sr.timeSignatureEvents;
+        r.trackNameEvents += sr.trackNameEvents;
+        r.otherMetaEvents += sr.otherMetaEvents;
+        r.otherChannelEvents += sr.otherChannelEvents;
+        r.sysexEvents += sr.sysexEvents;
+        r.runningStatusEvents += sr.runningStatusEvents;
+        r.quantizedNotes += sr.quantizedNotes;
+        r.candidateEvaluations += sr.candidateEvaluations;
+        r.adjustedNotes += sr.adjustedNotes;
+        r.barSteps += sr.barSteps;
+        r.headerSeconds += sr.headerSeconds;
+        r.trackSeconds += sr.trackSeconds;
+        r.quantizeSeconds += sr.quantizeSeconds;
+
+        auto &w = total.writer;
+        const auto &sw = stats.writer;
+        w.sections += sw.sections;
+        w.inputEvents += sw.inputEvents;
+        w.deviatedNotes += sw.deviatedNotes;
+        w.parallelNotes += sw.parallelNotes;
+        w.hitNotes += sw.hitNotes;
+        w.exHitNotes += sw.exHitNotes;
+        w.holdBeginNotes += sw.holdBeginNotes;
+        w.holdEndNotes += sw.holdEndNotes;
+        w.lines += sw.lines;
+        w.denseLines += sw.denseLines;
+        w.sparseLines += sw.sparseLines;
+        w.totalLineLength += sw.totalLineLength;
+        w.maxLineLength = std::max(w.maxLineLength, sw.maxLineLength);
+        w.longLines += sw.longLines;
+        for (size_t i = 0; i < w.lineLengthHistogram.size(); i++) {
+            w.lineLengthHistogram[i] += sw.lineLengthHistogram[i];
+        }
+        w.concurrencyChecks += sw.concurrencyChecks;
+        w.concurrentNotes += sw.concurrentNotes;
+        w.prepareSeconds += sw.prepareSeconds;
+        w.writeSeconds += sw.writeSeconds;
+    }
+
+    void writeJson(std::ostream & stream, const ConversionStats & stats) {
+        const auto &r = stats.reader;
+        const auto &w = stats.writer;
+
+        const auto flags = stream.flags();
+        const auto precision = stream.precision();
+        stream << std::fixed << std::setprecision(6);
+
+        stream << "{\n";
+        stream << "  \"reader\": {\n";
+        stream << "    \"bytesRead\": " << r.bytesRead << ",\n";
+        stream << "    \"events\": {"
+            << " \"noteOn\": " << r.noteOnEvents
+            << ", \"noteOff\": " << r.noteOffEvents
+            << ", \"tempo\": " << r.tempoEvents
+            << ", \"timeSignature\": " << r.timeSignatureEvents
+            << ", \"trackName\": " << r.trackNameEvents
+            << ", \"otherMeta\": " << r.otherMetaEvents
+            << ", \"otherChannel\": " << r.otherChannelEvents
+            << ", \"sysex\": " << r.sysexEvents
+            << ", \"runningStatus\": " << r.runningStatusEvents
+            << " },\n";
+        stream << "    \"quantize\": {"
+            << " \"notes\": " << r.quantizedNotes
+            << ", \"candidateEvaluations\": " << r.candidateEvaluations
+            << ", \"adjustedNotes\": " << r.adjustedNotes
+            << ", \"barSteps\": " << r.barSteps
+            << " },\n";
+        stream << "    \"seconds\": {"
+            << " \"header\": " << r.headerSeconds
+            << ", \"tracks\": " << r.trackSeconds
+            << ", \"quantize\": " << r.quantizeSeconds
+            << " }\n";
+        stream << "  },\n";
+
+        stream << "  \"writer\": {\n";
+        stream << "    \"sections\": " << w.sections << ",\n";
+        stream << "    \"inputEvents\": " << w.inputEvents << ",\n";
+        stream << "    \"deviatedNotes\": " << w.deviatedNotes << ",\n";
+        stream << "    \"parallelNotes\": " << w.parallelNotes << ",\n";
+        stream << "    \"notes\": {"
+            << " \"hit\": " << w.hitNotes
+            << ", \"exHit\": " << w.exHitNotes
+            << ", \"holdBegin\": " << w.holdBeginNotes
+            << ", \"holdEnd\": " << w.holdEndNotes
+            << " },\n";
+        stream << "    \"lines\": {"
+            << " \"count\": " << w.lines
+            << ", \"dense\": " << w.denseLines
+            << ", \"sparse\": " << w.sparseLines
+            << ", \"totalLength\": " << w.totalLineLength
+            << ", \"maxLength\": " << w.maxLineLength
+            << ", \"long\": " << w.longLines
+            << ", \"lengthHistogram\": [";
+        for (size_t i = 0; i < w.lineLengthHistogram.size(); i++) {
+            stream << (i > 0 ? ", " : "") << w.lineLengthHistogram[i];
+        }
+        stream << "] },\n";
+        stream << "    \"concurrency\": {"
+            << " \"checks\": " << w.concurrencyChecks
+            << ", \"found\": " << w.concurrentNotes
+            << " },\n";
+        stream << "    \"seconds\": {"
+            << " \"prepare\": " << w.prepareSeconds
+            << ", \"write\": " << w.writeSeconds
+            << " }\n";
+        stream << "  }\n";
+        stream << "}\n";
+
+        stream.flags(flags);
+        stream.precision(precision);
+    }
+
+}
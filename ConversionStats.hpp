@@ -0,0 +1,116 @@
+﻿//
+// ConversionStats
+// Counters and timings of MIDIReader and MIDItoScore, to find out why a conversion is slow.
+// The stats are recorded per thread, only while they are enabled on the thread,
+// so the counters are plain integers and the disabled stats cost a branch.
+//
+// --- example -----------------------------
+// stats::enable();
+// midi.openAndRead(fileName);
+// toscore.writeScore(stream, format, midi.getNoteEvent(2));
+// stats::writeJson(std::cout, stats::current());
+// stats::reset();
+// ------------------------------------------
+//
+
+
+#ifndef _CONVERSION_STATS_HPP_
+#define _CONVERSION_STATS_HPP_
+
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+
+namespace stats {
+
+    struct ReaderStats {
+        // size of the chunks
+        uint64_t bytesRead = 0;
+
+        // decoded events
+        uint64_t noteOnEvents = 0;
+        uint64_t noteOffEvents = 0;
+        uint64_t tempoEvents = 0;
+        uint64_t timeSignatureEvents = 0;
+        uint64_t trackNameEvents = 0;
+        uint64_t otherMetaEvents = 0;
+        uint64_t otherChannelEvents = 0;
+        uint64_t sysexEvents = 0;
+        // the events whose status byte is omitted
+        uint64_t runningStatusEvents = 0;
+
+        // quantization
+        uint64_t quantizedNotes = 0;
+        // calcScoreTime() called by calcBestScoreTime()
+        uint64_t candidateEvaluations = 0;
+        // the notes moved by the timing adjustment
+        uint64_t adjustedNotes = 0;
+        // the bars walked by calcScoreTime()
+        uint64_t barSteps = 0;
+
+        double headerSeconds = 0;
+        double trackSeconds = 0;
+        double quantizeSeconds = 0;
+    };
+
+    struct WriterStats {
+        // calls of writeScore(), generateScore() and compileScore()
+        uint64_t sections = 0;
+        uint64_t inputEvents = 0;
+        uint64_t deviatedNotes = 0;
+        uint64_t parallelNotes = 0;
+
+        uint64_t hitNotes = 0;
+        uint64_t exHitNotes = 0;
+        uint64_t holdBeginNotes = 0;
+        uint64_t holdEndNotes = 0;
+
+        uint64_t lines = 0;
+        uint64_t denseLines = 0;
+        uint64_t sparseLines = 0;
+        uint64_t totalLineLength = 0;
+        uint64_t maxLineLength = 0;
+        uint64_t longLines = 0;
+        // number of the lines whose length is up to 4, 16, 64, 256, 1024 and more
+        std::array<uint64_t, 6> lineLengthHistogram = {};
+
+        // the positions checked for the concurrent notes, and the concurrent notes found
+        uint64_t concurrencyChecks = 0;
+        uint64_t concurrentNotes = 0;
+
+        double prepareSeconds = 0;
+        double writeSeconds = 0;
+    };
+
+    struct ConversionStats {
+        bool enabled = false;
+        ReaderStats reader;
+        WriterStats writer;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    inline double secondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // the stats of the calling thread
+    ConversionStats &current();
+
+    void enable(bool enabled = true);
+    // clear the counters. the enabled flag is kept.
+    void reset();
+
+    void addLineLength(WriterStats &writer, size_t length);
+
+    // add the counters of stats to total (ex. the stats recorded on the other threads)
+    void accumulate(ConversionStats &total, const ConversionStats &stats);
+
+    void writeJson(std::ostream &stream, const ConversionStats &stats);
+
+}
+
+#endif // !_CONVERSION_STATS_HPP_
@@ -0,0 +1,154 @@
+﻿#include "FileWatcher.hpp"
+
+#include <thread>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+
+namespace fileio {
+
+    namespace fs = std::filesystem;
+
+    namespace {
+
+        constexpr std::chrono::milliseconds PollingInterval(50);
+
+    }
+
+
+    FileWatcher::FileWatcher()
+        : opened(false), lastSize(0)
+#ifdef __linux__
+        , inotifyFd(-1), watchFd(-1)
+#endif
+    {}
+
+    FileWatcher::~FileWatcher() {
+        close();
+    }
+
+    bool FileWatcher::open(const std::string & fileName) {
+        close();
+
+        std::error_code ec;
+        path = fs::absolute(fileName, ec);
+        if (ec || !fs::exists(path, ec))
+            return false;
+
+        lastWriteTime = fs::last_write_time(path, ec);
+        lastSize = fs::file_size(path, ec);
+
+#ifdef __linux__
+        // if inotify is not available, fall back to polling
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd >= 0) {
+            const auto directory = path.parent_path().string();
+            watchFd = inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY);
+            if (watchFd < 0) {
+                ::close(inotifyFd);
+                inotifyFd = -1;
+            }
+        }
+#endif
+
+        opened = true;
+
+        return true;
+    }
+
+    void FileWatcher::close() {
+#ifdef __linux__
+        if (inotifyFd >= 0)
+            ::close(inotifyFd);
+        inotifyFd = -1;
+        watchFd = -1;
+#endif
+
+        opened = false;
+    }
+
+    bool FileWatcher::wait(std::chrono::milliseconds debounce) {
+        if (!opened)
+            return false;
+
+        if (!waitChange(std::chrono::milliseconds(-1)))
+            return false;
+
+        // wait until the writes settle down
+        while (waitChange(debounce)) {}
+
+        return true;
+    }
+
+    bool FileWatcher::waitChange(std::chrono::milliseconds timeout) {
+#ifdef __linux__
+        if (inotifyFd < 0)
+            return pollChange(timeout);
+
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        const std::string fileName = path.filename().string();
+
+        while (true) {
+            int waitTime = -1;
+            if (timeout.count() >= 0) {
+                const auto rest = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                waitTime = static_cast<int>(std::max<std::chrono::milliseconds::rep>(rest.count(), 0));
+            }
+
+            pollfd fd = { inotifyFd, POLLIN, 0 };
+            const int ready = poll(&fd, 1, waitTime);
+            if (ready <= 0)
+                return false;
+
+            // the events of the other files in the directory are ignored
+            alignas(inotify_event) char buffer[4096];
+            bool changed = false;
+            ssize_t length;
+            while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+                for (char *p = buffer; p < buffer + length; ) {
+                    const auto *event = reinterpret_cast<const inotify_event*>(p);
+                    if (event->len > 0 && fileName == event->name)
+                        changed = true;
+
+                    p += sizeof(inotify_event) + event->len;
+                }
+            }
+
+            if (changed)
+                return true;
+        }
+#else
+        return pollChange(timeout);
+#endif
+    }
+
+    bool FileWatcher::pollChange(std::chrono::milliseconds timeout) {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+        while (timeout.count() < 0 || std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(PollingInterval);
+
+            std::error_code ec;
+            const auto writeTime = fs::last_write_time(path, ec);
+            if (ec)
+                continue;
+            const auto size = fs::file_size(path, ec);
+            if (ec)
+                continue;
+
+            if (writeTime != lastWriteTime || size != lastSize) {
+                lastWriteTime = writeTime;
+                lastSize = size;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+}
@@ -0,0 +1,60 @@
+﻿//
+// FileWatcher
+// This class waits until a file is changed.
+// It uses inotify on Linux, and polls the modification time of the file on the other platforms.
+// The directory of the file is watched, so that the file replaced by renaming (as many applications save) is also detected.
+//
+
+
+#ifndef _FILE_WATCHER_HPP_
+#define _FILE_WATCHER_HPP_
+
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+
+
+namespace fileio {
+
+    class FileWatcher {
+    public:
+        FileWatcher();
+        ~FileWatcher();
+
+        FileWatcher(const FileWatcher&) = delete;
+        FileWatcher &operator=(const FileWatcher&) = delete;
+
+        bool open(const std::string &fileName);
+        void close();
+
+        bool is_open() const { return opened; }
+
+        // block until the file is changed.
+        // the changes which follow within debounce are gathered, so a burst of writes is reported once.
+        // return false if the watcher is not open or failed.
+        bool wait(std::chrono::milliseconds debounce = std::chrono::milliseconds(100));
+
+    private:
+        // return true if the file is changed in timeout. negative timeout means infinite.
+        bool waitChange(std::chrono::milliseconds timeout);
+        bool pollChange(std::chrono::milliseconds timeout);
+
+        bool opened;
+        std::filesystem::path path;
+
+        // for polling
+        std::filesystem::file_time_type lastWriteTime;
+        uintmax_t lastSize;
+
+#ifdef __linux__
+        int inotifyFd;
+        int watchFd;
+#endif
+
+    };
+
+}
+
+#endif // !_FILE_WATCHER_HPP_
@@ -1,20 +1,208 @@
 ﻿#include "Fraction.hpp"
 
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
 
 namespace math {
 
-    
-    
+    namespace {
+
+        [[noreturn]] void overflow() {
+            throw std::overflow_error("[class:Fraction] overflow");
+        }
+
+        // the division of 32 bit is much faster than 64 bit, and the usual fractions fit in it
+        inline int64_t divide(int64_t a, int64_t b) {
+            if (((a | b) & ~int64_t(0x7fffffff)) == 0)
+                return static_cast<uint32_t>(a) / static_cast<uint32_t>(b);
+            return a / b;
+        }
+
+        // x must not be 0
+        inline int countTrailingZeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+            return __builtin_ctzll(x);
+#elif defined(_MSC_VER) && defined(_M_X64)
+            unsigned long index;
+            _BitScanForward64(&index, x);
+            return static_cast<int>(index);
+#else
+            int n = 0;
+            while (!(x & 1)) {
+                x >>= 1;
+                n++;
+            }
+            return n;
+#endif
+        }
+
+        // return false if the result overflows
+        bool checkedMul(int64_t a, int64_t b, int64_t &result) {
+#if defined(__GNUC__) || defined(__clang__)
+            return !__builtin_mul_overflow(a, b, &result);
+#else
+            result = static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+            return a == 0 || (result / a == b && !(a == -1 && b == INT64_MIN));
+#endif
+        }
+
+        bool checkedAdd(int64_t a, int64_t b, int64_t &result) {
+#if defined(__GNUC__) || defined(__clang__)
+            return !__builtin_add_overflow(a, b, &result);
+#else
+            if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b))
+                return false;
+            result = a + b;
+            return true;
+#endif
+        }
+
+        bool checkedSub(int64_t a, int64_t b, int64_t &result) {
+#if defined(__GNUC__) || defined(__clang__)
+            return !__builtin_sub_overflow(a, b, &result);
+#else
+            if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b))
+                return false;
+            result = a - b;
+            return true;
+#endif
+        }
+
+        // -INT64_MIN does not fit in 64 bit
+        int64_t negate(int64_t x) {
+            if (x == INT64_MIN)
+                overflow();
+            return -x;
+        }
+
+        // |x| < 2^31. the products and the sums of such values never overflow 64 bit.
+        inline bool isSmall(int64_t x) {
+            return static_cast<uint64_t>(x) + 0x7fffffff < 0xffffffff;
+        }
+
+        // the denominators are positive
+        inline uint32_t gcd32(uint32_t a, uint32_t b) {
+            if (a < b) {
+                uint32_t tmp = a;
+                a = b;
+                b = tmp;
+            }
+
+            uint32_t r = a%b;
+            while (r != 0) {
+                uint32_t tmp = b%r;
+                b = r;
+                r = tmp;
+            }
+
+            return b;
+        }
+
+        // the common denominator of the fractions whose members are small.
+        // the denominators are positive, and the results never overflow.
+        inline bool smallAdjustDenom(int64_t an, int64_t ad, int64_t bn, int64_t bd, int64_t &a_numer, int64_t &b_numer, int64_t &ans_denom) {
+            if (!(isSmall(an) && isSmall(ad) && isSmall(bn) && isSmall(bd)))
+                return false;
+
+            if (ad == bd) {
+                a_numer = an;
+                b_numer = bn;
+                ans_denom = ad;
+                return true;
+            }
+
+            const uint32_t g = gcd32(static_cast<uint32_t>(ad), static_cast<uint32_t>(bd));
+            const uint32_t af = static_cast<uint32_t>(bd) / g, bf = static_cast<uint32_t>(ad) / g;
+            ans_denom = af*ad;
+            a_numer = an*af;
+            b_numer = bn*bf;
+            return true;
+        }
+
+        bool tryLcm(int64_t a, int64_t b, int64_t &result) {
+            const int64_t g = a == b ? a : gcd(a, b);
+            if (g == 0) {
+                result = 0;
+                return true;
+            }
+
+            // divide first, so the result overflows only if the lcm itself does
+            if (!checkedMul(divide(a, g), b, result) || result == INT64_MIN)
+                return false;
+            if (result < 0)
+                result = -result;
+
+            return true;
+        }
+
+        // the numerators on the common denominator.
+        // the fractions are read by the members, because a copy of the whole fraction just stored is slow to load.
+        bool tryAdjustDenom(const Fraction &a, const Fraction &b, int64_t &a_numer, int64_t &b_numer, int64_t &ans_denom) {
+            const int64_t an = a.get().n, ad = a.get().d, bn = b.get().n, bd = b.get().d;
+
+            // the common case, which does not need the division
+            if (ad == bd) {
+                a_numer = an;
+                b_numer = bn;
+                ans_denom = ad;
+                return true;
+            }
+
+            if (smallAdjustDenom(an, ad, bn, bd, a_numer, b_numer, ans_denom))
+                return true;
+
+            if (!tryLcm(ad, bd, ans_denom))
+                return false;
+
+            return checkedMul(divide(ans_denom, ad), an, a_numer) && checkedMul(divide(ans_denom, bd), bn, b_numer);
+        }
+
+        // L + R (or L - R) on the common denominator
+        bool tryAdd(const Fraction &L, const Fraction &R, int sign, Fraction &result) {
+            int64_t ln, rn, d;
+            if (!tryAdjustDenom(L, R, ln, rn, d))
+                return false;
+
+            int64_t n;
+            const bool ok = sign > 0 ? checkedAdd(ln, rn, n) : checkedSub(ln, rn, n);
+            if (!ok)
+                return false;
+
+            result.set(n, d);
+            return true;
+        }
+
+        Fraction addOrReduce(const Fraction &L, const Fraction &R, int sign) {
+            // the sum of the small numerators does not overflow
+            int64_t ln, rn, d;
+            if (smallAdjustDenom(L.get().n, L.get().d, R.get().n, R.get().d, ln, rn, d))
+                return Fraction(sign > 0 ? ln + rn : ln - rn, d);
+
+            Fraction result;
+            if (tryAdd(L, R, sign, result))
+                return result;
+
+            Fraction reducedL(L), reducedR(R);
+            if (tryAdd(reducedL.reduce(), reducedR.reduce(), sign, result))
+                return result;
+
+            overflow();
+        }
+
+    }
+
 
     Fraction::Fraction() {}
 
-    Fraction::Fraction(int n, int d) {
+    Fraction::Fraction(int64_t n, int64_t d) {
         set(n, d);
     }
 
 
 
-    Fraction &Fraction::set(int n, int d) {
+    Fraction &Fraction::set(int64_t n, int64_t d) {
 
         try {
 
@@ -28,8 +216,8 @@ namespace math {
 
 
         if (d < 0) {
-            n *= -1;
-            d *= -1;
+            n = negate(n);
+            d = negate(d);
         }
 
         numer = n;
@@ -44,9 +232,9 @@ namespace math {
 
     Fraction &Fraction::reduce() {
         if (numer != 0) {
-            int lcm_frac = gcd(denom, numer);
-            denom /= lcm_frac;
-            numer /= lcm_frac;
+            int64_t lcm_frac = gcd(denom, numer);
+            denom = divide(denom, lcm_frac);
+            numer = divide(numer, lcm_frac);
         }
 
         return *this;
@@ -57,12 +245,12 @@ namespace math {
     }
 
     Fraction Fraction::operator-() const {
-        Fraction frac(-numer, denom);
+        Fraction frac(negate(numer), denom);
         return frac;
     }
 
 
-    Fraction & Fraction::operator=(int R) {
+    Fraction & Fraction::operator=(int64_t R) {
         return set(R);
     }
 
@@ -73,7 +261,7 @@ namespace math {
         return *this;
     }
 
-    Fraction & Fraction::operator+=(int R) {
+    Fraction & Fraction::operator+=(int64_t R) {
         return this->operator+=(Fraction(R));
     }
 
@@ -83,7 +271,7 @@ namespace math {
         return *this;
     }
 
-    Fraction & Fraction::operator-=(int R) {
+    Fraction & Fraction::operator-=(int64_t R) {
         return this->operator-=(Fraction(R));
     }
 
@@ -93,7 +281,7 @@ namespace math {
         return *this;
     }
 
-    Fraction & Fraction::operator*=(int R) {
+    Fraction & Fraction::operator*=(int64_t R) {
         return this->operator*=(Fraction(R));
     }
 
@@ -103,44 +291,128 @@ namespace math {
         return *this;
     }
 
-    Fraction & Fraction::operator/=(int R) {
+    Fraction & Fraction::operator/=(int64_t R) {
         return this->operator/=(Fraction(R));
     }
 
 
-    int gcd(int a, int b) {
+    int64_t gcd(int64_t a, int64_t b) {
         if (a == 0 || b == 0)
             return 0;
 
-        if (a < b) {
-            int tmp = a;
-            a = b;
-            b = tmp;
+        // the absolute values. INT64_MIN is kept as unsigned
+        uint64_t x = a < 0 ? 0 - static_cast<uint64_t>(a) : static_cast<uint64_t>(a);
+        uint64_t y = b < 0 ? 0 - static_cast<uint64_t>(b) : static_cast<uint64_t>(b);
+
+        // the division of 32 bit is fast enough for the usual fractions
+        if ((x | y) <= UINT32_MAX) {
+            uint32_t x32 = static_cast<uint32_t>(x), y32 = static_cast<uint32_t>(y);
+            if (x32 < y32) {
+                uint32_t tmp = x32;
+                x32 = y32;
+                y32 = tmp;
+            }
+
+            uint32_t r = x32%y32;
+            while (r != 0) {
+                uint32_t tmp = y32%r;
+                y32 = r;
+                r = tmp;
+            }
+
+            return static_cast<int64_t>(y32);
         }
 
-        int r = a%b;
-        while (r != 0) {
-            int tmp = b%r;
-            b = r;
-            r = tmp;
+        // binary gcd, which does not use the slow division of 64 bit
+        const int shift = countTrailingZeros(x | y);
+        x >>= countTrailingZeros(x);
+        do {
+            y >>= countTrailingZeros(y);
+            if (x > y) {
+                uint64_t tmp = x;
+                x = y;
+                y = tmp;
+            }
+            y -= x;
+        } while (y != 0);
+        x <<= shift;
+
+        if (x > static_cast<uint64_t>(INT64_MAX))
+            overflow();
+
+        return static_cast<int64_t>(x);
+    }
+
+    int64_t lcm(int64_t a, int64_t b) {
+        int64_t result;
+        if (!tryLcm(a, b, result))
+            overflow();
+
+        return result;
+    }
+
+    void adjustDenom(Fraction & a, Fraction & b) {
+        int64_t a_numer, b_numer, ans_denom;
+        if (smallAdjustDenom(a.get().n, a.get().d, b.get().n, b.get().d, a_numer, b_numer, ans_denom)) {
+            a.set(a_numer, ans_denom);
+            b.set(b_numer, ans_denom);
+            return;
+        }
+
+        if (!tryAdjustDenom(a, b, a_numer, b_numer, ans_denom)) {
+            a.reduce();
+            b.reduce();
+            if (!tryAdjustDenom(a, b, a_numer, b_numer, ans_denom))
+                overflow();
         }
 
-        return b;
+        a.set(a_numer, ans_denom);
+        b.set(b_numer, ans_denom);
     }
 
-    int lcm(int a, int b) {
-        return  a * b / gcd(a, b);
+    int compare(const Fraction & L, const Fraction & R) {
+        const frac_t l = L.get();
+        const frac_t r = R.get();
+
+        // the denominators are positive, so the order is kept by the cross multiplication
+        int64_t a, b;
+        if (!checkedMul(l.n, r.d, a) || !checkedMul(r.n, l.d, b)) {
+            Fraction fracL(L), fracR(R);
+            adjustDenom(fracL, fracR);
+            a = fracL.get().n;
+            b = fracR.get().n;
+        }
+
+        return (a > b) - (a < b);
     }
 
-    void adjustDenom(Fraction & a, Fraction & b) {	
+    Fraction add(const Fraction & L, const Fraction & R) {
+        return addOrReduce(L, R, +1);
+    }
 
-        int ans_denom = lcm(a.get().d, b.get().d);
+    Fraction subtract(const Fraction & L, const Fraction & R) {
+        return addOrReduce(L, R, -1);
+    }
 
-        int a_numer = (ans_denom/a.get().d)*a.get().n;
-        int b_numer = (ans_denom/b.get().d)*b.get().n;
+    Fraction multiply(const Fraction & L, const Fraction & R) {
+        const frac_t l = L.get();
+        const frac_t r = R.get();
 
-        a.set(a_numer, ans_denom);
-        b.set(b_numer, ans_denom);
+        int64_t n, d;
+        if (checkedMul(l.n, r.n, n) && checkedMul(l.d, r.d, d))
+            return Fraction(n, d);
+
+        // cancel the common factors of the numerators and denominators
+        const int64_t g1 = l.n == 0 ? 1 : gcd(l.n, r.d);
+        const int64_t g2 = r.n == 0 ? 1 : gcd(r.n, l.d);
+        if (checkedMul(l.n / g1, r.n / g2, n) && checkedMul(l.d / g2, r.d / g1, d))
+            return Fraction(n, d);
+
+        overflow();
+    }
+
+    std::ostream & operator<<(std::ostream & stream, const Fraction & fraction) {
+        return stream << fraction.get().n << '/' << fraction.get().d;
     }
 
 
@@ -11,12 +11,14 @@
 
 #include <string>
 #include <exception>
+#include <stdexcept>
 #include <iostream>
+#include <cstdint>
 
 namespace math {
 
     struct frac_t {
-        int n, d;
+        int64_t n, d;
     };
 
 
@@ -24,14 +26,14 @@ namespace math {
 
     public:
         Fraction();
-        Fraction(int n, int d = 1);
+        Fraction(int64_t n, int64_t d = 1);
         ~Fraction();
 
-        Fraction &set(int n, int d = 1);
+        Fraction &set(int64_t n, int64_t d = 1);
         frac_t get() const { return { numer, denom }; }
 
         float to_f() const { return static_cast<float>(numer)/denom; }
-        int to_i() const { return numer/denom; }
+        int64_t to_i() const { return numer/denom; }
 
         std::string get_str() const { return std::to_string(numer) + '/' + std::to_string(denom); }
 
@@ -43,43 +45,50 @@ namespace math {
 
         Fraction operator+() const;
         Fraction operator-() const;
-        Fraction &operator=(int R);
+        Fraction &operator=(int64_t R);
         Fraction &operator+=(const Fraction &R);
-        Fraction &operator+=(int R);
+        Fraction &operator+=(int64_t R);
         Fraction &operator-=(const Fraction &R);
-        Fraction &operator-=(int R);
+        Fraction &operator-=(int64_t R);
         Fraction &operator*=(const Fraction &R);
-        Fraction &operator*=(int R);
+        Fraction &operator*=(int64_t R);
         Fraction &operator/=(const Fraction &R);
-        Fraction &operator/=(int R);
+        Fraction &operator/=(int64_t R);
 
-        explicit operator int() const noexcept { return to_i();}
+        explicit operator int64_t() const noexcept { return to_i();}
         explicit operator float() const noexcept { return to_f();}
 
     private:
-        int numer;
-        int denom;
+        int64_t numer;
+        int64_t denom;
     };
 
 
-    int gcd(int a, int b);
-    int lcm(int a, int b);
+    // the results are not negative. gcd() returns 0 if a or b is 0.
+    int64_t gcd(int64_t a, int64_t b);
+    // divide before multiplying. throw std::overflow_error if the result overflows.
+    int64_t lcm(int64_t a, int64_t b);
 
+    // make the denominators same. the fractions are reduced if the common denominator overflows,
+    // and std::overflow_error is thrown if it still overflows.
     void adjustDenom(Fraction &a, Fraction &b);
 
+    // the arithmetic of the operators. they reduce the operands and try again if the result overflows,
+    // so the result of the small fractions is the same as the plain calculation.
+    Fraction add(const Fraction &L, const Fraction &R);
+    Fraction subtract(const Fraction &L, const Fraction &R);
+    Fraction multiply(const Fraction &L, const Fraction &R);
+    // -1, 0 or 1 by the order of the values
+    int compare(const Fraction &L, const Fraction &R);
 
-    template<class T1, class T2>
-    bool operator==(const T1 &L, const T2 &R) {
-
-        Fraction fracL(L);
-        Fraction fracR(R);
+    // write as "n/d" without the temporary string of get_str()
+    std::ostream &operator<<(std::ostream &stream, const Fraction &fraction);
 
-        if (fracL.get().n == 0 && fracR.get().n == 0)
-            return true;
 
-        adjustDenom(fracL, fracR);
+    template<class T1, class T2>
+    bool operator==(const T1 &L, const T2 &R) {
 
-        return (fracL.get().n == fracR.get().n);
+        return compare(Fraction(L), Fraction(R)) == 0;
     }
 
     template<class T1, class T2>
@@ -92,12 +101,7 @@ namespace math {
 
     template<class T1, class T2>
     bool operator<(const T1 &L, const T2 &R) {
-        Fraction fracL(L);
-        Fraction fracR(R);
-
-        adjustDenom(fracL, fracR);
-
-        return (fracL.get().n < fracR.get().n);
+        return compare(Fraction(L), Fraction(R)) < 0;
     }
 
 
@@ -129,36 +133,18 @@ namespace math {
 
     template<class T1, class T2>
     Fraction operator+(const T1 &L, const T2 &R) {
-        Fraction fracL(L);
-        Fraction fracR(R);
-
-        adjustDenom(fracL, fracR);
-        int ans_numer = fracL.get().n + fracR.get().n;
-
-        return Fraction(ans_numer, fracL.get().d);
+        return add(Fraction(L), Fraction(R));
     }
 
     template<class T1, class T2>
     Fraction operator-(const T1 &L, const T2 &R) {
-        Fraction fracL(L);
-        Fraction fracR(R);
-
-        adjustDenom(fracL, fracR);
-        int ans_numer = fracL.get().n - fracR.get().n;
-
-        return Fraction(ans_numer, fracL.get().d);
+        return subtract(Fraction(L), Fraction(R));
     }
 
 
     template<class T1, class T2>
     Fraction operator*(const T1 &L, const T2 &R) {
-        Fraction fracL(L);
-        Fraction fracR(R);
-
-        int n = fracL.get().n * fracR.get().n;
-        int d = fracL.get().d * fracR.get().d;
-
-        return Fraction(n, d);
+        return multiply(Fraction(L), Fraction(R));
     }
 
     template<class T1, class T2>
@@ -176,10 +162,7 @@ namespace math {
             throw;
         }
 
-        int n = fracL.get().n * fracR.get().d;
-        int d = fracL.get().d * fracR.get().n;
-
-        return Fraction(n, d);
+        return multiply(fracL, Fraction(fracR.get().d, fracR.get().n));
     }
 
 }
@@ -0,0 +1,208 @@
+﻿#include "IncrementalScore.hpp"
+
+#include <iomanip>
+#include <algorithm>
+
+#include "Checksum.hpp"
+
+
+namespace miditoscore {
+
+    namespace {
+
+        // the fields of an event which affect the score line
+        struct EventKey {
+            int64_t posNumer;
+            int64_t posDenom;
+            int32_t bar;
+            int32_t interval;
+            int32_t velocity;
+            int32_t type;
+            int32_t channel;
+            int32_t exNote;
+        };
+
+        uint64_t hashEvent(uint64_t seed, const midireader::NoteEvent &e, bool exNote) {
+            const EventKey key = {
+                e.posInBar.get().n,
+                e.posInBar.get().d,
+                e.bar,
+                e.interval,
+                e.velocity,
+                static_cast<int32_t>(e.type),
+                e.channel,
+                exNote ? 1 : 0
+            };
+
+            return checksum::hash64(&key, sizeof(key), seed);
+        }
+
+        bool sameFormat(const NoteFormat &a, const NoteFormat &b) {
+            if (a.exNoteClassifier.has_value() != b.exNoteClassifier.has_value())
+                return false;
+            if (a.exNoteClassifier && a.exNoteClassifier->hash() != b.exNoteClassifier->hash())
+                return false;
+
+            return a.holdMinLength == b.holdMinLength &&
+                a.laneAllocation == b.laneAllocation &&
+                a.allowedLineLength == b.allowedLineLength &&
+                a.parallelsLimit == b.parallelsLimit &&
+                a.lineEncoding == b.lineEncoding &&
+                static_cast<bool>(a.exNoteDecider) == static_cast<bool>(b.exNoteDecider);
+        }
+
+    }
+
+
+    IncrementalScore::IncrementalScore()
+        : hasLastFormat(false), numofUpdatedLines(0), numofLines(0) {}
+
+    IncrementalScore::~IncrementalScore() {}
+
+    int IncrementalScore::update(const NoteFormat & format, const std::vector<midireader::NoteEvent>& notes) {
+        using namespace midireader;
+
+        if (!hasLastFormat || !sameFormat(format, lastFormat)) {
+            reset();
+            lastFormat = format;
+            hasLastFormat = true;
+        }
+
+        int ret = converter.prepare(format, notes, converter.analyticsTempoMap);
+
+        const auto& laneNotes = converter.scratch.laneNotes;
+        const auto& exNoteFlags = converter.scratch.exNoteFlags;
+        auto& scoreNotes = converter.scratch.scoreNotes;
+
+        const size_t numofLanes = laneNotes.size();
+        lines.resize(numofLanes);
+
+        std::vector<MIDItoScore::noteevent_const_itr_t> beginIterators(numofLanes);
+        std::vector<bool> holdStarted(numofLanes, false);
+        std::vector<MIDItoScore::NoteAggregate> noteAggregate(numofLanes);
+        for (size_t lane = 0; lane < numofLanes; lane++) {
+            beginIterators[lane] = laneNotes[lane].cbegin();
+        }
+
+        numofUpdatedLines = 0;
+        numofLines = 0;
+
+        size_t currentBar = 1;
+
+        while (true) {
+            for (size_t lane = 0; lane < numofLanes; lane++) {
+                auto& beginIt = beginIterators[lane];
+                const auto endIt = converter.barEnd(lane, currentBar, beginIt);
+
+                // hash the events of the bar, and the state which comes from the other bars
+                uint64_t hash = checksum::hash64(&currentBar, sizeof(currentBar), holdStarted[lane] ? 1 : 0);
+                for (auto it = beginIt; it != endIt; it++) {
+                    const size_t index = it - laneNotes[lane].cbegin();
+                    const bool exNote = format.exNoteClassifier.has_value() && exNoteFlags[lane][index];
+                    hash = hashEvent(hash, *it, exNote);
+                }
+                // the last note on event may be a hold note which ends in the following bars
+                if (beginIt != endIt && (endIt - 1)->type == MidiEvent::NoteOn && endIt != laneNotes[lane].cend()) {
+                    hash = hashEvent(hash, *endIt, false);
+                }
+
+                bool started = holdStarted[lane];
+                converter.collectScoreNotes(format, lane, currentBar, beginIt, endIt, started, scoreNotes, &noteAggregate[lane]);
+                holdStarted[lane] = started;
+
+                if (lines[lane].size() <= currentBar)
+                    lines[lane].resize(currentBar + 1);
+
+                auto& line = lines[lane][currentBar];
+                if (!line.valid || line.hash != hash) {
+                    line.hash = hash;
+                    line.valid = true;
+                    line.line.clear();
+                    line.concurrentNotes.clear();
+                    line.status = Status::S_OK;
+
+                    if (scoreNotes.size() > 0) {
+                        const size_t numofConcurrentNotes = converter.concurrentNotes.size();
+
+                        line.status = converter.createScoreLine(format, lane, currentBar, scoreNotes, line.line);
+
+                        // keep the concurrent notes of the line, to report them when the line is reused
+                        line.concurrentNotes.assign(
+                            converter.concurrentNotes.cbegin() + numofConcurrentNotes,
+                            converter.concurrentNotes.cend()
+                        );
+                        numofUpdatedLines++;
+                    }
+                }
+
+                if (!line.line.empty())
+                    numofLines++;
+
+                // ready for next bar
+                beginIt = endIt;
+            }
+
+            // check loop condition
+            size_t numofEndedLanes = 0;
+            for (size_t lane = 0; lane < numofLanes; lane++) {
+                if (beginIterators[lane] == laneNotes[lane].cend()) numofEndedLanes++;
+            }
+            if (numofEndedLanes == numofLanes) {
+                break;
+            }
+
+            currentBar++;
+        }
+
+        // the bars after the end of the notes
+        for (auto& l : lines) {
+            if (l.size() > currentBar + 1)
+                l.resize(currentBar + 1);
+        }
+
+        // collect the diagnostics of all lines in the order of writeScore()
+        converter.concurrentNotes.clear();
+        converter.longLines.clear();
+        for (size_t bar = 1; bar <= currentBar; bar++) {
+            for (size_t lane = 0; lane < numofLanes; lane++) {
+                const auto& line = lines[lane][bar];
+
+                ret |= line.status;
+                converter.concurrentNotes.insert(converter.concurrentNotes.end(), line.concurrentNotes.cbegin(), line.concurrentNotes.cend());
+                if (line.line.size() > format.allowedLineLength)
+                    converter.longLines.emplace_back(static_cast<int>(bar), format.laneAllocation[lane]);
+            }
+        }
+
+        converter.noteAggregate.assign(noteAggregate.cbegin(), noteAggregate.cend());
+
+        return ret;
+    }
+
+    void IncrementalScore::write(std::ostream & stream) const {
+        size_t numofBars = 0;
+        for (const auto& l : lines) {
+            numofBars = std::max(numofBars, l.size());
+        }
+
+        for (size_t bar = 1; bar < numofBars; bar++) {
+            for (size_t lane = 0; lane < lines.size(); lane++) {
+                if (bar >= lines[lane].size() || lines[lane][bar].line.empty())
+                    continue;
+
+                using namespace std;
+                stream << lane << ':'
+                    << setfill('0') << setw(3) << bar << ':'
+                    << lines[lane][bar].line << '\n';
+            }
+        }
+    }
+
+    void IncrementalScore::reset() {
+        lines.clear();
+        hasLastFormat = false;
+        numofUpdatedLines = 0;
+        numofLines = 0;
+    }
+
+}
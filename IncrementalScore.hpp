@@ -0,0 +1,83 @@
+﻿//
+// IncrementalScore
+// This class keeps the score lines of the last conversion, and converts again only the bars which are changed.
+// Each line is identified by a hash of the events in the bar of the lane
+// (bar, posInBar, interval, velocity, type, channel), so a small edit of the midi file re-creates only a few lines.
+//
+// --- example -----------------------------
+// miditoscore::IncrementalScore score;
+// score.update(format, midi.getNoteEvent(trackNum));
+// // ... the midi file is edited and read again
+// score.update(format, midi.getNoteEvent(trackNum));
+// score.write(stream);
+// ------------------------------------------
+//
+// notice: exNoteDecider is assumed to return the same value for the same note.
+//         call reset() when exNoteDecider is replaced.
+//
+
+
+#ifndef _INCREMENTAL_SCORE_HPP_
+#define _INCREMENTAL_SCORE_HPP_
+
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+#include "MIDItoScore.hpp"
+
+
+namespace miditoscore {
+
+    class IncrementalScore {
+    public:
+        IncrementalScore();
+        ~IncrementalScore();
+
+        // convert the notes, reusing the lines whose events are not changed since the last update.
+        // return the same status as MIDItoScore::writeScore().
+        int update(const NoteFormat &format, const std::vector<midireader::NoteEvent> &notes);
+
+        // write all lines in the same form as MIDItoScore::writeScore()
+        void write(std::ostream &stream) const;
+
+        // discard the lines of the last conversion
+        void reset();
+
+        // number of the lines created by the last update
+        size_t getNumofUpdatedLines() const { return numofUpdatedLines; }
+        size_t getNumofLines() const { return numofLines; }
+
+        // the diagnostics of the last update (concurrent notes, long lines, aggregate ...)
+        const MIDItoScore &getConverter() const { return converter; }
+
+        // see MIDItoScore::setAnalyticsTempoMap()
+        void setAnalyticsTempoMap(const midireader::TempoMap *tempoMap, double windowSeconds = 1.0) { converter.setAnalyticsTempoMap(tempoMap, windowSeconds); }
+
+    private:
+        struct Line {
+            uint64_t hash = 0;
+            bool valid = false;
+            int status = Status::S_OK;
+            // empty if the bar of the lane has no notes
+            std::string line;
+            std::vector<midireader::NoteEvent> concurrentNotes;
+        };
+
+        MIDItoScore converter;
+        NoteFormat lastFormat;
+        bool hasLastFormat;
+
+        // lines[lane][bar]
+        std::vector<std::vector<Line>> lines;
+
+        size_t numofUpdatedLines;
+        size_t numofLines;
+
+    };
+
+}
+
+#endif // !_INCREMENTAL_SCORE_HPP_
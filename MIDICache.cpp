@@ -0,0 +1,175 @@
+﻿#include "MIDICache.hpp"
+
+#include <tuple>
+#include <filesystem>
+
+
+namespace midireader {
+
+    namespace fs = std::filesystem;
+
+    bool MIDICache::Key::operator<(const Key & k) const {
+        return std::tie(path, size, writeTime, adjustAmplitude, adjustThreshold) <
+            std::tie(k.path, k.size, k.writeTime, k.adjustAmplitude, k.adjustThreshold);
+    }
+
+
+    MIDICache::MIDICache(size_t memoryBudget)
+        : memoryBudget(memoryBudget), memoryUsage(0) {}
+
+    MIDICache::~MIDICache() {}
+
+    MIDICache::Document MIDICache::get(const std::string & fileName, size_t adjustAmplitude, size_t adjustThreshold, Status * status) {
+        std::error_code ec;
+        const fs::path path = fs::canonical(fileName, ec);
+        const auto size = ec ? 0 : fs::file_size(path, ec);
+        const auto writeTime = ec ? fs::file_time_type() : fs::last_write_time(path, ec);
+        if (ec) {
+            if (status)
+                *status = Status::E_CANNOT_OPEN_FILE;
+            return nullptr;
+        }
+
+        const Key key = {
+            path.string(),
+            size,
+            static_cast<int64_t>(writeTime.time_since_epoch().count()),
+            adjustAmplitude,
+            adjustThreshold
+        };
+
+        std::promise<Result> promise;
+        std::shared_future<Result> future;
+        bool reading = false;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            auto it = entries.find(key);
+            if (it != entries.end()) {
+                order.splice(order.begin(), order, it->second.order);
+                future = it->second.result;
+
+                if (it->second.ready)
+                    statistics.hits++;
+                else
+                    statistics.sharedParses++;
+            } else {
+                statistics.misses++;
+
+                // the older versions of the file are not used any more
+                for (auto o = order.begin(); o != order.end(); ) {
+                    auto e = entries.find(*o);
+                    const bool olderVersion = o->path == key.path &&
+                        o->adjustAmplitude == key.adjustAmplitude &&
+                        o->adjustThreshold == key.adjustThreshold;
+                    if (olderVersion && e->second.ready) {
+                        memoryUsage -= e->second.bytes;
+                        entries.erase(e);
+                        o = order.erase(o);
+                    } else {
+                        o++;
+                    }
+                }
+
+                future = promise.get_future().share();
+                order.push_front(key);
+
+                Entry entry;
+                entry.result = future;
+                entry.order = order.begin();
+                entries.emplace(key, std::move(entry));
+
+                reading = true;
+            }
+        }
+
+        if (reading) {
+            auto midi = std::make_shared<MIDIReader>();
+            midi->setAdjustmentAmplitude(adjustAmplitude, adjustThreshold);
+
+            Result result;
+            try {
+                if (path.extension() == ".mts")
+                    result.status = midi->load(key.path);
+                else
+                    result.status = midi->openAndRead(key.path);
+            } catch (const std::exception&) {
+                result.status = Status::E_INVALID_FILE;
+            }
+            if (Success(result.status))
+                result.document = midi;
+
+            promise.set_value(result);
+
+            std::lock_guard<std::mutex> lock(mutex);
+
+            auto it = entries.find(key);
+            if (it != entries.end()) {
+                if (result.document) {
+                    it->second.bytes = midi->getMemoryUsage();
+                    it->second.ready = true;
+                    memoryUsage += it->second.bytes;
+                    evict();
+                } else {
+                    // the failed file is read again at the next request
+                    order.erase(it->second.order);
+                    entries.erase(it);
+                }
+            }
+        }
+
+        const Result &result = future.get();
+        if (status)
+            *status = result.status;
+
+        return result.document;
+    }
+
+    void MIDICache::clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto o = order.begin(); o != order.end(); ) {
+            auto e = entries.find(*o);
+            if (e->second.ready) {
+                memoryUsage -= e->second.bytes;
+                entries.erase(e);
+                o = order.erase(o);
+            } else {
+                o++;
+            }
+        }
+    }
+
+    size_t MIDICache::getMemoryUsage() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return memoryUsage;
+    }
+
+    size_t MIDICache::size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    MIDICache::Statistics MIDICache::getStatistics() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return statistics;
+    }
+
+    void MIDICache::evict() {
+        auto o = order.end();
+        while (memoryUsage > memoryBudget && o != order.begin()) {
+            o--;
+
+            auto e = entries.find(*o);
+            if (!e->second.ready)
+                continue;
+
+            memoryUsage -= e->second.bytes;
+            entries.erase(e);
+            o = order.erase(o);
+            statistics.evictions++;
+        }
+    }
+
+}
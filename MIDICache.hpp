@@ -0,0 +1,108 @@
+﻿//
+// MIDICache
+// This class keeps the parsed midi files, so that a file opened by several views is read only once.
+// A file is identified by (canonical path, size, modification time, adjustment settings),
+// so the changed file is read again. The least recently used files are discarded when the memory budget is exceeded.
+// The requests for the same file at the same time share one parse.
+//
+// --- example -----------------------------
+// midireader::MIDICache cache(64 * 1024 * 1024);
+// midireader::Status status;
+// auto midi = cache.get("song.mid", 2, 1024, &status);
+// if (midi && midireader::Success(status)) {
+//     midi->getNoteEvent(1);
+// }
+// ------------------------------------------
+//
+
+
+#ifndef _MIDI_CACHE_HPP_
+#define _MIDI_CACHE_HPP_
+
+
+#include <string>
+#include <list>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <future>
+#include <cstdint>
+
+#include "MIDIReader.hpp"
+
+
+namespace midireader {
+
+    class MIDICache {
+    public:
+        using Document = std::shared_ptr<const MIDIReader>;
+
+        struct Statistics {
+            size_t hits = 0;
+            size_t misses = 0;
+            // the requests which waited for the parse of the other thread
+            size_t sharedParses = 0;
+            size_t evictions = 0;
+        };
+
+        explicit MIDICache(size_t memoryBudget = 256 * 1024 * 1024);
+        ~MIDICache();
+
+        MIDICache(const MIDICache&) = delete;
+        MIDICache &operator=(const MIDICache&) = delete;
+
+        // get the parsed midi file (or .mts file). it is read if it is not in the cache.
+        // the status of reading is set to status. the failed files are not kept.
+        // the returned document is valid even after it is discarded from the cache.
+        Document get(const std::string &fileName, size_t adjustAmplitude = 0, size_t adjustThreshold = 256, Status *status = nullptr);
+
+        // discard the files which are not used by the other threads
+        void clear();
+
+        size_t getMemoryUsage() const;
+        size_t getMemoryBudget() const { return memoryBudget; }
+        size_t size() const;
+        Statistics getStatistics() const;
+
+    private:
+        struct Key {
+            std::string path;
+            uintmax_t size;
+            int64_t writeTime;
+            size_t adjustAmplitude;
+            size_t adjustThreshold;
+
+            bool operator<(const Key &k) const;
+        };
+
+        struct Result {
+            Document document;
+            Status status;
+        };
+
+        struct Entry {
+            std::shared_future<Result> result;
+            // 0 while reading
+            size_t bytes = 0;
+            bool ready = false;
+            std::list<Key>::iterator order;
+        };
+
+        // discard the least recently used entries until the usage is in the budget.
+        // notice: the mutex must be locked
+        void evict();
+
+        const size_t memoryBudget;
+
+        mutable std::mutex mutex;
+        std::map<Key, Entry> entries;
+        // the front is the most recently used
+        std::list<Key> order;
+        size_t memoryUsage;
+        Statistics statistics;
+
+    };
+
+}
+
+#endif // !_MIDI_CACHE_HPP_
@@ -1,25 +1,18 @@
 ﻿#include "MIDIReader.hpp"
 
 #include <cmath>
+#include <cstring>
+#include <algorithm>
 
+#include "Checksum.hpp"
+#include "MappedFile.hpp"
+#include "ConversionStats.hpp"
+#include "Trace.hpp"
+#include "AllocationCounter.hpp"
 
-namespace midireader {
-
-
-    // convert byte (stored in std::string) to int
-    int btoi(const std::string &str) {
-        int ans = 0;
 
-        for (auto ch : str) {
-            unsigned higherBit = (ch & 0xf0) >> 4;
-            unsigned lowerBit = (ch & 0x0f);
-
-            ans <<= 8;
-            ans |= ((higherBit << 4) | lowerBit);
-        }
+namespace midireader {
 
-        return ans;
-    }
 
     bool operator==(unsigned char L, MetaEvent R) {
         return (L == static_cast<unsigned char>(R));
@@ -132,8 +125,27 @@ namespace midireader {
         return intervalNum;
     }
 
+    void BarIndex::build(const std::vector<NoteEvent>& events) {
+        numofEvents = events.size();
+
+        const int lastBar = events.empty() ? 0 : std::max(events.back().bar, 0);
+        offsets.resize(static_cast<size_t>(lastBar) + 2);
+
+        // offsets[bar] = the first index whose bar is equal or greater than the bar
+        size_t i = 0;
+        for (size_t bar = 0; bar < offsets.size(); bar++) {
+            while (i < numofEvents && events[i].bar < static_cast<int>(bar)) i++;
+            offsets[bar] = i;
+        }
+    }
+
+    void BarIndex::clear() {
+        offsets.clear();
+        numofEvents = 0;
+    }
+
     MIDIReader::MIDIReader()
-        : adjustAmplitude(0), adjustThreshold(256) {}
+        : memoryStream(&memoryBuffer), input(&midi), adjustAmplitude(0), adjustThreshold(256) {}
 
     MIDIReader::~MIDIReader() {
         close();
@@ -147,17 +159,365 @@ namespace midireader {
         if (fileName.empty())
             return Status::E_INVALID_ARG;
 
-        if (midi.is_open())
-            close();
+        close();
 
 
         midi.open(fileName, std::ios_base::binary);
         if (!midi)
             return Status::E_CANNOT_OPEN_FILE;
 
+        input = &midi;
+
         return readAll();
     }
 
+    Status MIDIReader::readFromMemory(const char * data, size_t size) {
+        if (!data || size == 0)
+            return Status::E_INVALID_ARG;
+
+        close();
+
+        memoryBuffer.assign(data, size);
+        memoryStream.clear();
+        input = &memoryStream;
+
+        const Status ret = readAll();
+
+        // the data is not referred after returning
+        memoryBuffer.assign(nullptr, 0);
+        input = &midi;
+
+        return ret;
+    }
+
+    void MIDIReader::MemoryBuffer::assign(const char * data, size_t size) {
+        char *begin = const_cast<char*>(data);
+        setg(begin, begin, begin + size);
+    }
+
+    MIDIReader::MemoryBuffer::pos_type MIDIReader::MemoryBuffer::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+        if (!(which & std::ios_base::in))
+            return pos_type(off_type(-1));
+
+        off_type base;
+        if (dir == std::ios_base::beg)
+            base = 0;
+        else if (dir == std::ios_base::cur)
+            base = gptr() - eback();
+        else
+            base = egptr() - eback();
+
+        const off_type pos = base + off;
+        if (pos < 0 || pos > egptr() - eback())
+            return pos_type(off_type(-1));
+
+        setg(eback(), eback() + pos, egptr());
+
+        return pos_type(pos);
+    }
+
+    MIDIReader::MemoryBuffer::pos_type MIDIReader::MemoryBuffer::seekpos(pos_type pos, std::ios_base::openmode which) {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+
+    namespace {
+
+        // ################################
+        // # about parsed midi format (.mts, little endian)
+        //
+        // ParsedHeader
+        // title            titleSize bytes, padded to 8 bytes
+        // ParsedTrack      [numofTrackName], each followed by the name padded to 8 bytes
+        // for each track:
+        //   uint64_t       number of the events
+        //   ParsedNote     [number of the events]
+        // ParsedBeat       [numofBeat]
+        // ParsedTempo      [numofTempo]
+        //
+        // checksum is hash64 of the bytes after ParsedHeader.
+
+        constexpr char ParsedMagic[4] = { 'M', 'T', 'S', 'M' };
+        constexpr uint32_t ParsedVersion = 2;
+
+        struct ParsedHeader {
+            char magic[4];
+            uint32_t version;
+            uint64_t checksum;
+            uint64_t fileSize;
+            int32_t format;
+            int32_t numofTrack;
+            int32_t resolutionUnit;
+            uint32_t titleSize;
+            uint64_t adjustAmplitude;
+            uint64_t adjustThreshold;
+            uint32_t numofTrackName;
+            uint32_t numofNoteTrack;
+            uint32_t numofBeat;
+            uint32_t numofTempo;
+        };
+
+        struct ParsedTrack {
+            int32_t trackNum;
+            uint32_t nameSize;
+        };
+
+        struct ParsedNote {
+            int64_t time;
+            int64_t posNumer;
+            int64_t posDenom;
+            int32_t type;
+            int32_t channel;
+            int32_t bar;
+            int32_t interval;
+            int32_t velocity;
+            int32_t reserved;
+        };
+
+        struct ParsedBeat {
+            int64_t time;
+            int64_t numer;
+            int64_t denom;
+            int32_t bar;
+            int32_t reserved;
+        };
+
+        struct ParsedTempo {
+            int64_t time;
+            int64_t posNumer;
+            int64_t posDenom;
+            int32_t bar;
+            float tempo;
+        };
+
+        static_assert(sizeof(ParsedHeader) == 72, "unexpected padding in ParsedHeader");
+        static_assert(sizeof(ParsedTrack) == 8, "unexpected padding in ParsedTrack");
+        static_assert(sizeof(ParsedNote) == 48, "unexpected padding in ParsedNote");
+        static_assert(sizeof(ParsedBeat) == 32, "unexpected padding in ParsedBeat");
+        static_assert(sizeof(ParsedTempo) == 32, "unexpected padding in ParsedTempo");
+
+        template<typename T>
+        void appendValue(std::string &buffer, const T &value) {
+            buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        void appendPadded(std::string &buffer, const std::string &str) {
+            buffer.append(str);
+            buffer.append((8 - str.size() % 8) % 8, '\0');
+        }
+
+        size_t paddedSize(size_t size) {
+            return (size + 7) / 8 * 8;
+        }
+
+        // reads the values from the mapped file with bounds checking
+        class ParsedCursor {
+        public:
+            ParsedCursor(const char *data, size_t size) : data(data), size(size), pos(0) {}
+
+            template<typename T>
+            bool read(T &value) {
+                if (size - pos < sizeof(T))
+                    return false;
+
+                std::memcpy(&value, data + pos, sizeof(T));
+                pos += sizeof(T);
+
+                return true;
+            }
+
+            bool readPadded(std::string &str, size_t length) {
+                if (size - pos < paddedSize(length))
+                    return false;
+
+                str.assign(data + pos, length);
+                pos += paddedSize(length);
+
+                return true;
+            }
+
+            bool remains(size_t count, size_t elementSize) const {
+                return count <= (size - pos) / elementSize;
+            }
+
+        private:
+            const char *data;
+            size_t size;
+            size_t pos;
+        };
+
+    }
+
+    Status MIDIReader::save(const std::string & fileName) const {
+        if (fileName.empty())
+            return Status::E_INVALID_ARG;
+
+        std::string body;
+
+        appendPadded(body, musicTitle);
+
+        for (const auto &t : trackList) {
+            appendValue(body, ParsedTrack{ t.trackNum, static_cast<uint32_t>(t.name.size()) });
+            appendPadded(body, t.name);
+        }
+
+        for (const auto &events : noteEvent) {
+            appendValue<uint64_t>(body, events.size());
+
+            for (const auto &e : events) {
+                ParsedNote note;
+                note.time = e.time;
+                note.type = static_cast<int32_t>(e.type);
+                note.channel = e.channel;
+                note.bar = e.bar;
+                note.posNumer = e.posInBar.get().n;
+                note.posDenom = e.posInBar.get().d;
+                note.interval = e.interval;
+                note.velocity = e.velocity;
+                note.reserved = 0;
+                appendValue(body, note);
+            }
+        }
+
+        for (const auto &e : beatEvent) {
+            appendValue(body, ParsedBeat{ e.time, e.beat.get().n, e.beat.get().d, e.bar, 0 });
+        }
+
+        for (const auto &e : tempoEvent) {
+            appendValue(body, ParsedTempo{ e.time, e.posInBar.get().n, e.posInBar.get().d, e.bar, e.tempo });
+        }
+
+        ParsedHeader parsedHeader;
+        std::memcpy(parsedHeader.magic, ParsedMagic, sizeof(ParsedMagic));
+        parsedHeader.version = ParsedVersion;
+        parsedHeader.checksum = checksum::hash64(body);
+        parsedHeader.fileSize = sizeof(ParsedHeader) + body.size();
+        parsedHeader.format = header.format;
+        parsedHeader.numofTrack = header.numofTrack;
+        parsedHeader.resolutionUnit = header.resolutionUnit;
+        parsedHeader.titleSize = static_cast<uint32_t>(musicTitle.size());
+        parsedHeader.adjustAmplitude = adjustAmplitude;
+        parsedHeader.adjustThreshold = adjustThreshold;
+        parsedHeader.numofTrackName = static_cast<uint32_t>(trackList.size());
+        parsedHeader.numofNoteTrack = static_cast<uint32_t>(noteEvent.size());
+        parsedHeader.numofBeat = static_cast<uint32_t>(beatEvent.size());
+        parsedHeader.numofTempo = static_cast<uint32_t>(tempoEvent.size());
+
+        std::ofstream file(fileName, std::ios_base::binary);
+        if (!file)
+            return Status::E_CANNOT_OPEN_FILE;
+
+        file.write(reinterpret_cast<const char*>(&parsedHeader), sizeof(parsedHeader));
+        file.write(body.data(), body.size());
+
+        if (!file)
+            return Status::E_CANNOT_OPEN_FILE;
+
+        return Status::S_OK;
+    }
+
+    Status MIDIReader::load(const std::string & fileName) {
+        if (fileName.empty())
+            return Status::E_INVALID_ARG;
+
+        close();
+
+        fileio::MappedFile file;
+        if (!file.open(fileName))
+            return Status::E_CANNOT_OPEN_FILE;
+
+        ParsedHeader parsedHeader;
+        if (file.size() < sizeof(ParsedHeader))
+            return Status::E_INVALID_FILE;
+        std::memcpy(&parsedHeader, file.data(), sizeof(ParsedHeader));
+
+        if (std::memcmp(parsedHeader.magic, ParsedMagic, sizeof(ParsedMagic)) != 0)
+            return Status::E_INVALID_FILE;
+        if (parsedHeader.version != ParsedVersion)
+            return Status::E_UNSUPPORTED_FORMAT;
+        if (parsedHeader.fileSize != file.size())
+            return Status::E_INVALID_FILE;
+
+        const char *body = file.data() + sizeof(ParsedHeader);
+        const size_t bodySize = file.size() - sizeof(ParsedHeader);
+        if (checksum::hash64(body, bodySize) != parsedHeader.checksum)
+            return Status::E_INVALID_FILE;
+
+        ParsedCursor cursor(body, bodySize);
+        auto invalid = [this]() {
+            close();
+            return Status::E_INVALID_FILE;
+        };
+
+        header = { parsedHeader.format, parsedHeader.numofTrack, parsedHeader.resolutionUnit };
+        adjustAmplitude = parsedHeader.adjustAmplitude;
+        adjustThreshold = parsedHeader.adjustThreshold;
+
+        if (!cursor.readPadded(musicTitle, parsedHeader.titleSize))
+            return invalid();
+
+        for (uint32_t i = 0; i < parsedHeader.numofTrackName; i++) {
+            ParsedTrack t;
+            std::string name;
+            if (!cursor.read(t) || !cursor.readPadded(name, t.nameSize))
+                return invalid();
+
+            trackList.emplace_back(t.trackNum, name);
+        }
+
+        resizeTracks(parsedHeader.numofNoteTrack);
+        for (auto &events : noteEvent) {
+            uint64_t numofEvents;
+            if (!cursor.read(numofEvents) || !cursor.remains(numofEvents, sizeof(ParsedNote)))
+                return invalid();
+
+            events.resize(numofEvents);
+            for (auto &e : events) {
+                ParsedNote note;
+                cursor.read(note);
+                if (note.posDenom == 0)
+                    return invalid();
+
+                e.type = static_cast<MidiEvent>(note.type);
+                e.channel = note.channel;
+                e.time = note.time;
+                e.bar = note.bar;
+                e.posInBar.set(note.posNumer, note.posDenom);
+                e.interval = note.interval;
+                e.velocity = note.velocity;
+            }
+        }
+
+        if (!cursor.remains(parsedHeader.numofBeat, sizeof(ParsedBeat)))
+            return invalid();
+        for (uint32_t i = 0; i < parsedHeader.numofBeat; i++) {
+            ParsedBeat beat;
+            cursor.read(beat);
+            if (beat.denom == 0)
+                return invalid();
+
+            beatEvent.emplace_back(beat.time, beat.bar, math::Fraction(beat.numer, beat.denom));
+        }
+
+        if (!cursor.remains(parsedHeader.numofTempo, sizeof(ParsedTempo)))
+            return invalid();
+        for (uint32_t i = 0; i < parsedHeader.numofTempo; i++) {
+            ParsedTempo tempo;
+            cursor.read(tempo);
+            if (tempo.posDenom == 0)
+                return invalid();
+
+            tempoEvent.emplace_back(tempo.time, tempo.bar, tempo.tempo);
+            tempoEvent.back().posInBar.set(tempo.posNumer, tempo.posDenom);
+        }
+
+        // the bar index is cheap, so it is built again instead of being saved
+        for (size_t i = 0; i < noteEvent.size(); i++) {
+            barIndex.at(i).build(noteEvent.at(i));
+        }
+
+        return beatEvent.empty() ? Status::S_NO_EMBED_TIMESIGNATURE : Status::S_OK;
+    }
+
     const MIDIHeader & MIDIReader::getHeader() const {
         return header;
     }
@@ -173,6 +533,23 @@ namespace midireader {
         return noteEvent;
     }
 
+    NoteEventRange MIDIReader::getNoteEvent(size_t trackNum, int beginBar, int endBar) const {
+        if (trackNum-1 >= noteEvent.size())
+            return { dummyEvent.data(), dummyEvent.data() };
+
+        const auto &events = noteEvent.at(trackNum-1);
+        const auto range = barIndex.at(trackNum-1).range(beginBar, endBar);
+
+        return { events.data() + range.first, events.data() + range.second };
+    }
+
+    const BarIndex & MIDIReader::getBarIndex(size_t trackNum) const {
+        if (trackNum-1 >= barIndex.size())
+            return dummyBarIndex;
+
+        return barIndex.at(trackNum-1);
+    }
+
     const std::vector<BeatEvent>& MIDIReader::getBeatEvent() const {
         return beatEvent;
     }
@@ -194,14 +571,72 @@ namespace midireader {
         adjustThreshold = threshold;
     }
 
+    size_t MIDIReader::getAdjustmentAmplitude() const {
+        return adjustAmplitude;
+    }
+
+    size_t MIDIReader::getAdjustmentThreshold() const {
+        return adjustThreshold;
+    }
+
+    size_t MIDIReader::getMemoryUsage() const {
+        size_t bytes = sizeof(MIDIReader) + musicTitle.capacity();
+
+        bytes += noteEvent.capacity() * sizeof(std::vector<NoteEvent>);
+        for (const auto &events : noteEvent) {
+            bytes += events.capacity() * sizeof(NoteEvent);
+        }
+        bytes += barIndex.capacity() * sizeof(BarIndex);
+        for (const auto &index : barIndex) {
+            bytes += index.getMemoryUsage();
+        }
+        bytes += trackList.capacity() * sizeof(Track);
+        for (const auto &track : trackList) {
+            bytes += track.name.capacity();
+        }
+        bytes += beatEvent.capacity() * sizeof(BeatEvent);
+        bytes += tempoEvent.capacity() * sizeof(TempoEvent);
+
+        bytes += spareNoteEvent.capacity() * sizeof(std::vector<NoteEvent>);
+        for (const auto &events : spareNoteEvent) {
+            bytes += events.capacity() * sizeof(NoteEvent);
+        }
+        bytes += spareBarIndex.capacity() * sizeof(BarIndex);
+        for (const auto &index : spareBarIndex) {
+            bytes += index.getMemoryUsage();
+        }
+
+        return bytes;
+    }
+
     void MIDIReader::close() {
         midi.close();
         header = { 0, 0, 0 };
         musicTitle.clear();
-        noteEvent.clear();
         beatEvent.clear();
         tempoEvent.clear();
         trackList.clear();
+
+        // keep the buffers of the tracks, to read the next file without allocation
+        for (auto &events : noteEvent) events.clear();
+        for (auto &index : barIndex) index.clear();
+        if (noteEvent.size() > spareNoteEvent.size()) {
+            noteEvent.swap(spareNoteEvent);
+            barIndex.swap(spareBarIndex);
+        }
+        noteEvent.clear();
+        barIndex.clear();
+    }
+
+    void MIDIReader::resizeTracks(size_t numofTracks) {
+        // the buffers kept by close()
+        if (noteEvent.empty()) {
+            noteEvent.swap(spareNoteEvent);
+            barIndex.swap(spareBarIndex);
+        }
+
+        noteEvent.resize(numofTracks);
+        barIndex.resize(numofTracks);
     }
 
 
@@ -211,13 +646,23 @@ namespace midireader {
     Status MIDIReader::readAll() {
         Status ret;
 
+        auto &stats = stats::current();
+        auto phaseStart = stats::Clock::time_point();
+        if (stats.enabled)
+            phaseStart = stats::Clock::now();
+
         // read midi file
         if (Failed(ret = readHeader()))
             return ret;
 
+        if (stats.enabled) {
+            stats.reader.headerSeconds += stats::secondsSince(phaseStart);
+            phaseStart = stats::Clock::now();
+        }
+
 
         // ready for std::vector of note event
-        noteEvent.resize(header.numofTrack);
+        resizeTracks(header.numofTrack);
 
 
         // read tracks
@@ -226,21 +671,40 @@ namespace midireader {
                 return ret;
         }
 
+        if (stats.enabled) {
+            stats.reader.trackSeconds += stats::secondsSince(phaseStart);
+            phaseStart = stats::Clock::now();
+        }
+
 
 
         // calculate bar and posInBar, and add them to event.
-        for (auto &tracknote : noteEvent) {
-            for (auto &note : tracknote) {
+        {
+            TRACE_SCOPE("quantize");
+            ALLOC_PHASE(Quantize);
 
-                // find the most suitable fraction which express position of the note.
-                ScoreTime scoreTime = calcBestScoreTime(note.time, adjustThreshold);
+            for (auto &tracknote : noteEvent) {
+                for (auto &note : tracknote) {
 
-                note.bar = scoreTime.bar;
-                note.posInBar = scoreTime.posInBar;
+                    // find the most suitable fraction which express position of the note.
+                    ScoreTime scoreTime = calcBestScoreTime(note.time, adjustThreshold);
 
+                    note.bar = scoreTime.bar;
+                    note.posInBar = scoreTime.posInBar;
+
+                }
             }
         }
 
+        if (stats.enabled) {
+            stats.reader.quantizeSeconds += stats::secondsSince(phaseStart);
+        }
+
+        // build bar index of each track
+        for (size_t i = 0; i < noteEvent.size(); i++) {
+            barIndex.at(i).build(noteEvent.at(i));
+        }
+
         for (auto &e : beatEvent) {
             auto ret = calcScoreTime(e.time);
             e.bar = ret.bar;
@@ -268,7 +732,7 @@ namespace midireader {
 
         size_t i;
         for (i = 0; i < byte; i++) {
-            midi.read(&ch, 1);
+            input->read(&ch, 1);
             str += ch;
         }
 
@@ -276,14 +740,41 @@ namespace midireader {
         return i;
     }
 
-    size_t MIDIReader::readVariableLenNumber(long & num) {
+    int64_t MIDIReader::readNumber(size_t byte) {
+        int64_t num = 0;
+
+        for (size_t i = 0; i < byte; i++) {
+            char ch;
+            input->read(&ch, 1);
+
+            num <<= 8;
+            num |= static_cast<unsigned char>(ch);
+        }
+
+        return num;
+    }
+
+    bool MIDIReader::readChunkName(const char * name) {
+        char chunk[4] = {};
+        input->read(chunk, 4);
+
+        return std::memcmp(chunk, name, 4) == 0;
+    }
+
+    void MIDIReader::skip(int64_t byte) {
+        input->ignore(static_cast<std::streamsize>(byte));
+    }
+
+    size_t MIDIReader::readVariableLenNumber(int64_t & num) {
         num = 0;
         size_t byteCnt = 0;
 
         while (true) {
             char ch;
 
-            midi.read(&ch, 1);
+            input->read(&ch, 1);
+            if (!*input)
+                break;
             byteCnt++;
 
             num <<= 7;
@@ -298,7 +789,7 @@ namespace midireader {
         return byteCnt;
     }
 
-    MIDIReader::ScoreTime MIDIReader::calcScoreTime(long midiTime) {
+    MIDIReader::ScoreTime MIDIReader::calcScoreTime(tick_t midiTime) {
         MIDIReader::ScoreTime ans(0, math::Fraction(0));
 
         if (beatEvent.empty())
@@ -308,21 +799,21 @@ namespace midireader {
         // ---------------------------
         // count the bar
         ans.bar = 1;
-        auto resolution = static_cast<int>(4 * header.resolutionUnit * getBeat(0));
-        long time = 0;
+        tick_t resolution = barLength(0);
+        tick_t time = 0;
 
         while (midiTime - time >= resolution) {
             time += resolution;
             ans.bar++;
 
             // get resolutin unit for next bar
-            resolution = static_cast<int>(4 * header.resolutionUnit * getBeat(time));
+            resolution = barLength(time);
         }
 
 
         // ---------------------------
         // calculation position in bar
-        ans.posInBar = { static_cast<int>(midiTime - time), resolution };
+        ans.posInBar = { midiTime - time, resolution };
         ans.posInBar.reduce();
         if (ans.posInBar == 0) {
             ans.posInBar.set(0);
@@ -332,11 +823,12 @@ namespace midireader {
         return ans;
     }
 
-    MIDIReader::ScoreTime MIDIReader::calcBestScoreTime(long &midiTime, size_t threshold) {
+    MIDIReader::ScoreTime MIDIReader::calcBestScoreTime(tick_t &midiTime, size_t threshold) {
         int amplitude_i = static_cast<int>(adjustAmplitude);
-        long origin = midiTime;
+        tick_t origin = midiTime;
 
         ScoreTime bestAns = calcScoreTime(origin);
+        size_t evaluations = 1;
 
         if (static_cast<size_t>(bestAns.posInBar.get().d) > threshold) {
 
@@ -346,6 +838,7 @@ namespace midireader {
                 if (offset == 0) continue;
 
                 auto scoreTime = calcScoreTime(origin + offset);
+                evaluations++;
                 if (scoreTime.posInBar.get().d < bestAns.posInBar.get().d) {
                     bestAns = scoreTime;
                     midiTime = origin + offset;
@@ -354,11 +847,21 @@ namespace midireader {
 
         }
 
+        auto &stats = stats::current();
+        if (stats.enabled) {
+            stats.reader.quantizedNotes++;
+            stats.reader.candidateEvaluations += evaluations;
+            // each evaluation walks the bars from the beginning
+            stats.reader.barSteps += evaluations * static_cast<size_t>(std::max(bestAns.bar, 1));
+            if (midiTime != origin)
+                stats.reader.adjustedNotes++;
+        }
+
 
         return bestAns;
     }
 
-    const math::Fraction & MIDIReader::getBeat(long miditime) {
+    const math::Fraction & MIDIReader::getBeat(tick_t miditime) {
         for (auto rit = beatEvent.crbegin(); rit != beatEvent.crend(); rit++) {
             if (rit->time <= miditime)
                 return rit->beat;
@@ -367,33 +870,40 @@ namespace midireader {
         return beatEvent.cbegin()->beat;
     }
 
+    tick_t MIDIReader::barLength(tick_t miditime) {
+        // 4 quarter notes x beat, truncated in the same way as the fraction
+        const math::frac_t beat = getBeat(miditime).get();
+        const tick_t length = 4 * static_cast<tick_t>(header.resolutionUnit) * beat.n / beat.d;
+
+        // the bars never be empty, so that the bar counting always advances
+        return std::max<tick_t>(length, 1);
+    }
+
     void MIDIReader::eraseAll(std::string & str) {
         str.erase(str.cbegin(), str.cend());
     }
 
     Status MIDIReader::readHeader() {
-        std::string tmp;
+        TRACE_SCOPE("readHeader");
+        ALLOC_PHASE(ReadHeader);
 
 
         // move file pointer
-        midi.seekg(0, std::ios_base::beg);
+        input->seekg(0, std::ios_base::beg);
 
         // get chunk name
-        std::string chunk;
-        read(chunk, 4);
+        const bool isHeader = readChunkName("MThd");
 
         // get chunk length
-        read(tmp, 4);
-        int chunkLength = btoi(tmp);
+        int chunkLength = static_cast<int>(readNumber(4));
 
 
-        if (chunk != "MThd")
+        if (!isHeader)
             return Status::E_INVALID_FILE;
 
 
         // check midi format
-        read(tmp, 2);
-        int format = btoi(tmp);
+        int format = static_cast<int>(readNumber(2));
         if (format == 2) {
             // [SMF error] SMF FORMAT 2 is unsupported.
             return Status::E_UNSUPPORTED_FORMAT;
@@ -401,13 +911,11 @@ namespace midireader {
 
 
         // get the number of tracks
-        read(tmp, 2);
-        int numofTrack = btoi(tmp);
+        int numofTrack = static_cast<int>(readNumber(2));
 
 
         // check the resolution unit
-        read(tmp, 2);
-        int resolutionUnit = btoi(tmp);
+        int resolutionUnit = static_cast<int>(readNumber(2));
         if (resolutionUnit >> 15) {
             // [SMF error] this TIME UNIT FORMAT is unsupported.
             return Status::E_UNSUPPORTED_FORMAT;
@@ -419,34 +927,34 @@ namespace midireader {
         header.numofTrack = numofTrack;
         header.resolutionUnit = resolutionUnit;
 
+        auto &stats = stats::current();
+        if (stats.enabled)
+            stats.reader.bytesRead += 8 + chunkLength;
+
 
 
         return Status::S_OK;
     }
 
     Status MIDIReader::readTrack(int trackNum) {
+        TRACE_SCOPE_ARG("readTrack", "track", trackNum);
+        ALLOC_PHASE(ReadTrack);
 
         if (trackNum < 1)
             return Status::E_INVALID_ARG;
 
-        std::string tmp;
-
 
         // move file pointer
-        midi.seekg(0, std::ios_base::beg);
+        input->seekg(0, std::ios_base::beg);
 
         for (int i = 0; i < trackNum; i++) {
-            read(tmp, 4); // chunk name
-
-            if ((i == 0 && tmp != "MThd") ||
-                (i > 0  && tmp != "MTrk"))
+            // chunk name
+            if (!readChunkName(i == 0 ? "MThd" : "MTrk"))
                 return Status::E_INVALID_FILE;
 
-            eraseAll(tmp);
-            read(tmp, 4); // data length
-            long chunklength = btoi(tmp);
+            int64_t chunklength = readNumber(4); // data length
 
-            midi.seekg(chunklength, std::ios_base::cur);
+            input->seekg(chunklength, std::ios_base::cur);
         }
 
 
@@ -455,15 +963,13 @@ namespace midireader {
 
 
         // get chunk name
-        std::string chunk;
-        read(chunk, 4);
+        const bool isTrack = readChunkName("MTrk");
 
         // get chunk data length
-        read(tmp, 4);
-        long chunkLength = btoi(tmp);
+        int64_t chunkLength = readNumber(4);
 
 
-        if (chunk != "MTrk")
+        if (!isTrack)
             return Status::E_INVALID_FILE;
 
 
@@ -471,22 +977,53 @@ namespace midireader {
         // add track
         trackList.push_back(Track(trackNum, ""));
 
+        // counters are updated only when the stats are enabled on this thread
+        auto &stats = stats::current();
+        const bool recording = stats.enabled;
+        auto &counter = stats.reader;
+        if (recording)
+            counter.bytesRead += 8 + chunkLength;
 
 
-        long totalTime = 0;
+
+        tick_t totalTime = 0;
+        // status of the last channel message, which is used when the status byte is omitted
+        unsigned char runningStatus = 0;
         while (1) {
 
             // get delta time
-            long deltaTime;
+            int64_t deltaTime;
             readVariableLenNumber(deltaTime);
 
             totalTime += deltaTime;
 
             // get status byte
-            read(tmp, 1);
-            unsigned char status = btoi(tmp);
+            unsigned char status = static_cast<unsigned char>(readNumber(1));
+
+            // the track is cut before the end of track event
+            if (!*input)
+                return Status::E_INVALID_FILE;
+
+            if (status < 0x80) {
+                // running status. the byte is the first data byte of the event
+                if (runningStatus != 0) {
+                    input->seekg(-1, std::ios_base::cur);
+                    status = runningStatus;
+                    if (recording)
+                        counter.runningStatusEvents++;
+                }
+            } else if (status < 0xf0) {
+                runningStatus = status;
+            } else {
+                // meta and sysex events cancel the running status
+                runningStatus = 0;
+            }
+
             unsigned char status_upper = status >> 4;
 
+            if (recording && 0xa <= status_upper && status_upper <= 0xe)
+                counter.otherChannelEvents++;
+
             
             // Note On/Off
             if (status_upper == 0x9 || status_upper == 0x8) {
@@ -495,29 +1032,30 @@ namespace midireader {
 
                 evt.channel = status & 0x0f;
                 // get note number
-                read(tmp, 1);
-                evt.interval = btoi(tmp);
+                evt.interval = static_cast<int>(readNumber(1));
                 // get velocity
-                read(tmp, 1);
-                evt.velocity = btoi(tmp);
+                evt.velocity = static_cast<int>(readNumber(1));
 
                 evt.time = totalTime;
 
-                if (status_upper == 0x9)
+                // note on with velocity 0 is note off
+                if (status_upper == 0x9 && evt.velocity > 0)
                     evt.type = MidiEvent::NoteOn;
                 else
                     evt.type = MidiEvent::NoteOff;
 
+                if (recording)
+                    (evt.type == MidiEvent::NoteOn ? counter.noteOnEvents : counter.noteOffEvents)++;
+
                 event_it->push_back(evt);
             
             // Meta Event
             } else if (status == 0xff) {
 
                 // get event type
-                read(tmp, 1);
-                unsigned char eventType = btoi(tmp);
+                unsigned char eventType = static_cast<unsigned char>(readNumber(1));
                 // get data length
-                long dataLength;
+                int64_t dataLength;
                 readVariableLenNumber(dataLength);
 
 
@@ -526,6 +1064,9 @@ namespace midireader {
                     std::string instName;
                     read(instName, dataLength);
 
+                    if (recording)
+                        counter.trackNameEvents++;
+
                     // search a element which has same track number 
                     size_t subscript = findTrack(trackNum) - trackList.cbegin();
 
@@ -546,8 +1087,10 @@ namespace midireader {
 
                 } else if (eventType == MetaEvent::Tempo) {
 
-                    read(tmp, dataLength);
-                    float tempo = 60.0f*1e6f/btoi(tmp);
+                    float tempo = 60.0f*1e6f/static_cast<int>(readNumber(dataLength));
+
+                    if (recording)
+                        counter.tempoEvents++;
 
                     tempoEvent.push_back(
                         TempoEvent(totalTime, 0, tempo)
@@ -555,13 +1098,14 @@ namespace midireader {
 
                 } else if (eventType == MetaEvent::TimeSignature) {
 
-                    read(tmp, 1);
-                    int numer = btoi(tmp);
-                    read(tmp, 1);
-                    int denom = static_cast<int>(std::pow(2, btoi(tmp)));
+                    int numer = static_cast<int>(readNumber(1));
+                    int denom = static_cast<int>(std::pow(2, readNumber(1)));
 
                     // nothing to do
-                    read(tmp, 2);
+                    skip(2);
+
+                    if (recording)
+                        counter.timeSignatureEvents++;
 
                     beatEvent.push_back(
                         BeatEvent(totalTime, 0, math::Fraction(numer, denom))
@@ -570,7 +1114,10 @@ namespace midireader {
                 } else {
 
                     // nothing to do
-                    read(tmp, dataLength);
+                    skip(dataLength);
+
+                    if (recording)
+                        counter.otherMetaEvents++;
 
                 } // metaEvent
 
@@ -579,33 +1126,34 @@ namespace midireader {
             // nothing to do in following events
             } else if (status_upper == 0xa) {
                 // polyphonic key pressure
-                read(tmp, 2);
+                skip(2);
             } else if (status_upper == 0xb) {
                 // controll change
-                read(tmp, 1);
-                unsigned char ctrlNum = btoi(tmp);
-                read(tmp, 1);
+                unsigned char ctrlNum = static_cast<unsigned char>(readNumber(1));
+                skip(1);
                 
                 if (0x78 <= ctrlNum && ctrlNum <= 0x7f) {
-                    read(tmp, 1);
-                    unsigned char mode = btoi(tmp);
+                    unsigned char mode = static_cast<unsigned char>(readNumber(1));
                     if (mode == 4)	// MIDI mode to be mode 4(OMNI OFF / MONO)
-                        midi.seekg(-1, std::ios::cur);
+                        input->seekg(-1, std::ios::cur);
                 }
             } else if (status_upper == 0xc) {
                 // program change
-                read(tmp, 1);
+                skip(1);
             } else if (status_upper == 0xd) {
                 // channel pressure
-                read(tmp, 1);
+                skip(1);
             } else if (status_upper == 0xe) {
                 // pitch bend
-                read(tmp, 2);
+                skip(2);
             } else if (status == 0xf0 || status == 0xf7) {
                 // SysEx event
-                long dataLength;
+                int64_t dataLength;
                 readVariableLenNumber(dataLength);
 
+                if (recording)
+                    counter.sysexEvents++;
+
             } // midiEvent
 
         } // while (1)
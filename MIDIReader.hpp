@@ -14,6 +14,9 @@
 #include <string>
 #include <vector>
 #include <fstream>
+#include <istream>
+#include <streambuf>
+#include <limits>
 
 #include "Fraction.hpp"
 
@@ -48,6 +51,10 @@ namespace midireader {
     bool Failed(Status s);
 
 
+    // midi time (tick). it is 64 bit, so that the long songs with high resolution do not overflow.
+    using tick_t = int64_t;
+
+
     struct MIDIHeader {
         int format;
         int numofTrack;
@@ -55,7 +62,7 @@ namespace midireader {
     };
 
     struct BeatEvent {
-        BeatEvent(long time, int bar, math::Fraction beat) {
+        BeatEvent(tick_t time, int bar, math::Fraction beat) {
             this->time = time;
             this->bar = bar;
             this->beat = beat;
@@ -63,20 +70,20 @@ namespace midireader {
 
         ~BeatEvent() {};
 
-        long time;
+        tick_t time;
         int bar;
         math::Fraction beat;
     };
 
 
     struct TempoEvent {
-        TempoEvent(long time, int bar, float tempo) {
+        TempoEvent(tick_t time, int bar, float tempo) {
             this->time = time;
             this->bar = bar;
             this->tempo = tempo;
         }
 
-        long time;
+        tick_t time;
         int bar;
         float tempo;
         math::Fraction posInBar;
@@ -85,7 +92,7 @@ namespace midireader {
     struct NoteEvent {
         MidiEvent type;
         int channel;
-        long time;
+        tick_t time;
         int bar;
         math::Fraction posInBar;
 
@@ -93,6 +100,47 @@ namespace midireader {
         int velocity;
     };
 
+    // a range of the note events, which refers to the events held by MIDIReader
+    struct NoteEventRange {
+        const NoteEvent *first;
+        const NoteEvent *last;
+
+        const NoteEvent *begin() const { return first; }
+        const NoteEvent *end() const { return last; }
+        size_t size() const { return static_cast<size_t>(last - first); }
+        bool empty() const { return first == last; }
+    };
+
+    // offset table from the bar number to the first event in the bar.
+    // notice: the events must be sorted by time.
+    class BarIndex {
+    public:
+        void build(const std::vector<NoteEvent> &events);
+        void clear();
+
+        // index of the first event whose bar is equal or greater than the bar
+        size_t first(int bar) const {
+            if (bar < 0) return 0;
+            if (static_cast<size_t>(bar) >= offsets.size()) return numofEvents;
+            return offsets[bar];
+        }
+
+        // range of the indices of the events in bars [beginBar, endBar]
+        std::pair<size_t, size_t> range(int beginBar, int endBar) const {
+            if (endBar < beginBar) return { first(beginBar), first(beginBar) };
+            return { first(beginBar), first(endBar == std::numeric_limits<int>::max() ? endBar : endBar + 1) };
+        }
+
+        int lastBar() const { return offsets.empty() ? 0 : static_cast<int>(offsets.size()) - 2; }
+
+        size_t getMemoryUsage() const { return offsets.capacity() * sizeof(size_t); }
+
+    private:
+        // offsets[bar] is the index of the first event in the bar
+        std::vector<size_t> offsets;
+        size_t numofEvents = 0;
+    };
+
     struct Track {
         Track(int trackNum, std::string name) {
             this->trackNum = trackNum;
@@ -114,7 +162,12 @@ namespace midireader {
     int toNoteNum(const std::string& noteName, PitchNotation style);
 
 
+    // gives benchmark.cpp the access to each stage of reading
+    struct ReaderBenchmark;
+
     class MIDIReader {
+        friend struct ReaderBenchmark;
+
     public:
         MIDIReader();
         MIDIReader(const std::string &fileName);
@@ -122,11 +175,22 @@ namespace midireader {
         ~MIDIReader();
 
         Status openAndRead(const std::string &fileName);
+        // read the midi file on memory. the data is not copied, and not used after this function returns.
+        Status readFromMemory(const char *data, size_t size);
+
+        // save the parsed state (header, title, tracks, quantized events and adjustment settings) to the file (.mts).
+        // load() restores it by mapping the file, without reading and quantizing the midi file again.
+        // notice: the .mts file is not updated when the midi file is changed
+        Status save(const std::string &fileName) const;
+        Status load(const std::string &fileName);
 
         const MIDIHeader &getHeader() const;
         // notice: When you want to get the note event of 1st track, call as "getNoteEvent(1)"
         const std::vector<NoteEvent> &getNoteEvent(size_t trackNum) const;
         const std::vector<std::vector<NoteEvent>> &getNoteEvent() const;
+        // get the note events in bars [beginBar, endBar] of the track in constant time.
+        NoteEventRange getNoteEvent(size_t trackNum, int beginBar, int endBar) const;
+        const BarIndex &getBarIndex(size_t trackNum) const;
         const std::vector<BeatEvent> &getBeatEvent() const;
         const std::vector<TempoEvent> &getTempoEvent() const;
         const std::vector<Track> &getTracks() const;
@@ -135,12 +199,31 @@ namespace midireader {
         // set amplitude in adjusting timing of the note event
         // notice : When you call this function, please call it before openAndRead()
         void setAdjustmentAmplitude(size_t midiTime, size_t threshold = 256);
+        size_t getAdjustmentAmplitude() const;
+        size_t getAdjustmentThreshold() const;
+
+        // approximate size of the parsed data in bytes
+        size_t getMemoryUsage() const;
 
         void close();
 
     private:
 
+        // stream buffer which reads the bytes on memory without copying them
+        class MemoryBuffer : public std::streambuf {
+        public:
+            void assign(const char *data, size_t size);
+
+        protected:
+            pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+            pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+        };
+
         std::ifstream midi;
+        MemoryBuffer memoryBuffer;
+        std::istream memoryStream;
+        // the stream being read (midi or memoryStream)
+        std::istream *input;
 
         MIDIHeader header;
         std::string musicTitle;
@@ -148,6 +231,11 @@ namespace midireader {
         std::vector<BeatEvent> beatEvent;
         std::vector<TempoEvent> tempoEvent;
         std::vector<Track> trackList;
+        // bar index of each track. it is built after the note events are quantized.
+        std::vector<BarIndex> barIndex;
+        // the cleared buffers of the previous file, which are reused by resizeTracks()
+        std::vector<std::vector<NoteEvent>> spareNoteEvent;
+        std::vector<BarIndex> spareBarIndex;
 
         // for amplitude in adjusting timing of the note event.
         // default value : 0
@@ -156,13 +244,22 @@ namespace midireader {
 
         // for out of range access
         const std::vector<NoteEvent> dummyEvent;
+        const BarIndex dummyBarIndex;
 
 
         // read whole midi file
         Status readAll();
 
+        // resize noteEvent and barIndex, reusing the buffers of the previous file
+        void resizeTracks(size_t numofTracks);
+
         size_t read(std::string &str, size_t byte);
-        size_t readVariableLenNumber(long &num);
+        size_t readVariableLenNumber(int64_t &num);
+        // read a big endian number without any temporary buffer
+        int64_t readNumber(size_t byte);
+        // read 4 bytes and return true if they are equal to the name
+        bool readChunkName(const char *name);
+        void skip(int64_t byte);
 
         struct ScoreTime {
             ScoreTime(int bar, math::Fraction posInBar) {
@@ -174,11 +271,13 @@ namespace midireader {
             math::Fraction posInBar;
         };
 
-        ScoreTime calcScoreTime(long midiTime);
-        ScoreTime calcBestScoreTime(long &midiTime, size_t threshold);
+        ScoreTime calcScoreTime(tick_t midiTime);
+        ScoreTime calcBestScoreTime(tick_t &midiTime, size_t threshold);
 
 
-        const math::Fraction &getBeat(long miditime);
+        const math::Fraction &getBeat(tick_t miditime);
+        // the length of the bar which begins at the time, without narrowing
+        tick_t barLength(tick_t miditime);
 
         void eraseAll(std::string &str);
 
@@ -1,18 +1,52 @@
 ﻿#include "MIDItoScore.hpp"
+#include "ScoreWriter.hpp"
+#include "ScoreLineGenerator.hpp"
+#include "BinaryScore.hpp"
+#include "TempoMap.hpp"
+#include "ConversionStats.hpp"
+#include "Trace.hpp"
+#include "AllocationCounter.hpp"
 
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
 #include <numeric>
+#include <charconv>
 
 namespace miditoscore {
 
+    namespace {
+
+        size_t countDigits(size_t n) {
+            size_t digits = 1;
+            while (n >= 10) {
+                n /= 10;
+                digits++;
+            }
+
+            return digits;
+        }
+
+        void appendNumber(std::string &str, size_t n) {
+            char buffer[20];
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), n);
+            str.append(buffer, result.ptr);
+        }
+
+        // the note type and the channel, which is expressed as a character in the dense form
+        size_t noteValue(const ScoreNote &note) {
+            return static_cast<size_t>(note.type) + (note.evt->channel << 3);
+        }
+
+    }
+
 
     MIDItoScore::MIDItoScore() {}
 
     MIDItoScore::~MIDItoScore() {}
 
 
+
     int MIDItoScore::writeScore(const std::string & fileName, const NoteFormat & format, const std::vector<midireader::NoteEvent> &notes) {
         std::ofstream scoreFile(fileName.c_str(), std::ios::app);
         if (!scoreFile.is_open())
@@ -22,23 +56,135 @@ namespace miditoscore {
     }
 
     int MIDItoScore::writeScore(std::ostream & stream, const NoteFormat & format, const std::vector<midireader::NoteEvent> &notes) {
+        TRACE_SCOPE("writeScore");
+
+        int ret = Status::S_OK;
+
+        ret |= prepare(format, notes, analyticsTempoMap);
+
+        ALLOC_PHASE(WriteScore);
+
+        auto &stats = stats::current();
+        if (stats.enabled) {
+            const auto start = stats::Clock::now();
+            ret |= writeLanes(stream, format);
+            stats.writer.writeSeconds += stats::secondsSince(start);
+        } else {
+            ret |= writeLanes(stream, format);
+        }
+
+        return ret;
+    }
+
+    ScoreLineGenerator MIDItoScore::generateScore(const NoteFormat & format, const std::vector<midireader::NoteEvent>& notes, int beginBar, int endBar) {
+        int ret = prepare(format, notes, analyticsTempoMap);
+
+        return ScoreLineGenerator(*this, ret, beginBar, endBar);
+    }
+
+    int MIDItoScore::compileScore(const NoteFormat & format, const std::vector<midireader::NoteEvent>& notes, const midireader::TempoMap & tempoMap, CompiledChart & chart) {
+        using namespace midireader;
+
+        TRACE_SCOPE("compileScore");
+        ALLOC_PHASE(CompileScore);
+
+        int ret = prepare(format, notes, &tempoMap);
+
+        compileLastScore(format, tempoMap, chart);
+
+        return ret;
+    }
+
+    void MIDItoScore::compileLastScore(const NoteFormat & format, const midireader::TempoMap & tempoMap, CompiledChart & chart) const {
         using namespace midireader;
 
+        TRACE_SCOPE("compileLastScore");
+        ALLOC_PHASE(CompileScore);
+
+        const auto& laneNotes = scratch.laneNotes;
+
+        chart.laneAllocation = format.laneAllocation;
+        chart.lanes.resize(laneNotes.size());
+
+        for (size_t lane = 0; lane < laneNotes.size(); lane++) {
+            auto& compiled = chart.lanes[lane];
+            compiled.clear();
+
+            for (auto it = laneNotes[lane].cbegin(); it != laneNotes[lane].cend(); it++) {
+                if (it->type != MidiEvent::NoteOn)
+                    continue;
+
+                binary::Note note = {};
+                note.time = it->time;
+                note.microseconds = tempoMap.toMicroseconds(it->time);
+                note.bar = it->bar;
+                // the position is (ticks from the bar) / (ticks of the bar), and the bar is at most
+                // 4 x 32767 (15 bit resolution of SMF) x 255 (8 bit beat numerator) ticks, so it fits in 32 bit
+                note.posNumer = static_cast<int32_t>(it->posInBar.get().n);
+                note.posDenom = static_cast<int32_t>(it->posInBar.get().d);
+                note.channel = static_cast<uint8_t>(it->channel);
+
+                if (isHoldNote(format, lane, it)) {
+                    note.type = static_cast<uint8_t>(NoteType::HOLD_BEGIN);
+                    note.length = (it + 1)->time - it->time;
+                    note.lengthMicroseconds = tempoMap.toMicroseconds((it + 1)->time) - note.microseconds;
+                } else {
+                    note.type = static_cast<uint8_t>(hitType(format, lane, it));
+                }
+
+                compiled.push_back(note);
+            }
+        }
+
+        chart.analytics = analyzer.get();
+    }
+
+    int MIDItoScore::prepare(const NoteFormat & format, const std::vector<midireader::NoteEvent>& notes, const midireader::TempoMap *tempoMap) {
+        using namespace midireader;
+
+        TRACE_SCOPE("prepare");
+        ALLOC_PHASE(Prepare);
+
         int ret = Status::S_OK;
 
+        auto &stats = stats::current();
+        auto start = stats::Clock::time_point();
+        if (stats.enabled)
+            start = stats::Clock::now();
+
         clear();
 
         noteFormat = format;
         noteAggregate.resize(format.laneAllocation.size());
-        std::vector<std::vector<NoteEvent>> laneNotes(format.laneAllocation.size());
+
+        auto& laneNotes = scratch.laneNotes;
+        laneNotes.resize(format.laneAllocation.size());
+        for (auto& l : laneNotes) l.clear();
+
+        if (tempoMap)
+            analyzer.begin(*tempoMap, analyticsWindowSeconds);
+        else
+            analyzer.clear();
+
+        auto& chords = scratch.chords;
+        chords.clear();
 
         // group by lane number and handle invalid notes
-        int64_t prevTime = notes.front().time;
-        size_t counter = 1;
-        for (const auto& note : notes) {
+        for (size_t i = 0; i < notes.size(); i++) {
+            const auto& note = notes[i];
             int laneIndex = selectNoteLane(format, note);
             if (laneIndex >= 0) {
-                laneNotes.at(laneIndex).push_back(note);
+                auto& lane = laneNotes.at(laneIndex);
+                lane.push_back(note);
+
+                if (tempoMap) {
+                    if (note.type == MidiEvent::NoteOn)
+                        analyzer.addNote(note.time);
+
+                    // the previous note of the lane is decided to be a hold by this event
+                    if (lane.size() >= 2 && isHoldNote(format, laneIndex, lane.cend() - 2))
+                        analyzer.addHold((lane.cend() - 2)->time, note.time);
+                }
             }
 
             if (note.type == midireader::MidiEvent::NoteOn) {
@@ -48,23 +194,12 @@ namespace miditoscore {
                     ret |= Status::S_EXIST_DEVIATEDNOTES;
                 }
 
-                // check number of lanes where exists parallel notes
-                if (format.parallelsLimit.has_value()) {
-                    if (prevTime != note.time) {
-                        counter = 1;
-                    } else {
-                        counter++;
-                        if (counter > format.parallelsLimit) {
-                            parallelNotes.push_back(note);
-                            ret |= Status::E_MANY_PARALLELS;
-                        }
-                    }
-
-                    prevTime = note.time;
+                if (laneIndex >= 0) {
+                    chords.add(note.time, laneIndex, i);
                 }
 
                 // add exsiting channels
-                if (std::find(channels.cbegin(), channels.cend(), note.channel) != channels.cend()) {
+                if (std::find(channels.cbegin(), channels.cend(), note.channel) == channels.cend()) {
                     channels.push_back(note.channel);
                 }
             }
@@ -72,112 +207,233 @@ namespace miditoscore {
 
         std::sort(channels.begin(), channels.end(), std::less<int>());
 
-        std::string scoreString;
-        size_t currentBar = 1;
-        std::vector<noteevent_const_itr_t> beginIterators(format.laneAllocation.size());
-        std::vector<noteevent_const_itr_t> endIterators(format.laneAllocation.size());
-        for (size_t i = 0; i < format.laneAllocation.size(); i++) {
-            beginIterators.at(i) = laneNotes.at(i).cbegin();
-            endIterators.at(i) = laneNotes.at(i).cbegin();
+        chords.build();
+
+        // check number of lanes where exists parallel notes
+        if (format.parallelsLimit.has_value()) {
+            const size_t limit = *format.parallelsLimit;
+            for (size_t g = 0; g < chords.size(); g++) {
+                if (chords.laneCount(g) <= limit)
+                    continue;
+
+                // the first limit lanes of the group are allowed, and the notes on the other lanes are reported.
+                // a lane can have several notes in the group, so the lanes are counted once.
+                auto &allowedLanes = scratch.chordLanes;
+                allowedLanes.clear();
+                for (auto e = chords.begin(g); e != chords.end(g); e++) {
+                    if (std::find(allowedLanes.cbegin(), allowedLanes.cend(), e->lane) != allowedLanes.cend())
+                        continue;
+
+                    if (allowedLanes.size() < limit)
+                        allowedLanes.push_back(e->lane);
+                    else
+                        parallelNotes.push_back(notes[e->note]);
+                }
+                ret |= Status::E_MANY_PARALLELS;
+            }
+        }
+
+        if (tempoMap)
+            analyzer.finish(chords);
+
+        // build bar index of each lane
+        scratch.laneBarIndex.resize(laneNotes.size());
+        for (size_t lane = 0; lane < laneNotes.size(); lane++) {
+            scratch.laneBarIndex[lane].build(laneNotes[lane]);
         }
-        std::vector<bool> holdStarted(format.laneAllocation.size(), false);
 
-        while (true) {
+        // classify EX notes of each lane at once
+        auto& exNoteFlags = scratch.exNoteFlags;
+        exNoteFlags.resize(format.laneAllocation.size());
+        if (format.exNoteClassifier.has_value()) {
             for (size_t lane = 0; lane < format.laneAllocation.size(); lane++) {
-                auto& beginIt = beginIterators.at(lane);
-                auto& endIt = endIterators.at(lane);
-
-                // calculate range of current bar
-                for (endIt = beginIt; endIt != laneNotes.at(lane).cend(); endIt++) {
-                    if (endIt->bar != currentBar) break;
-                };
-
-                // enumerate useable events to write score
-                std::vector<ScoreNote> scoreNotes;
-                for (auto it = beginIt; it != endIt; it++) {
-                    if (it == beginIt && holdStarted.at(lane)) {
-                        scoreNotes.emplace_back(NoteType::HOLD_END, &*it);
-                        holdStarted.at(lane) = false;
-
-                        // aggregate
-                        noteAggregate.at(lane).increment(scoreNotes.back().type);
-                    } else if (it->type == MidiEvent::NoteOn) {
-                        // calculate note length
-                        const math::Fraction end = (it + 1)->bar + (it + 1)->posInBar;
-                        const math::Fraction beg = it->bar + it->posInBar;
-                        const math::Fraction length = end - beg;
-
-                        const bool isHold = (length >= format.holdMinLength);
-
-                        if (isHold) {
-                            scoreNotes.emplace_back(NoteType::HOLD_BEGIN, &*it);
-                            if ((it + 1)->bar == currentBar) {
-                                // hold end is in current bar
-                                scoreNotes.emplace_back(NoteType::HOLD_END, &*(it+1));
-                            } else {
-                                // hold end is out of current bar
-                                holdStarted.at(lane) = true;
-                            }
-                        } else {
-                            NoteType type = NoteType::HIT;
-                            if (format.exNoteDecider) {
-                                if (format.exNoteDecider(&*it))
-                                    type = NoteType::EX_HIT;
-                                else
-                                    type = NoteType::HIT;
-                            }
-                            scoreNotes.emplace_back(type, &*it);
-                        }
-
-                        // aggregate
-                        noteAggregate.at(lane).increment(scoreNotes.back().type);
-                    }
-                }
+                format.exNoteClassifier->classify(laneNotes.at(lane), exNoteFlags.at(lane));
+            }
+        }
 
-                if (scoreNotes.size() > 0) {
-                    ret |= createScoreString(scoreNotes, scoreString);
+        if (stats.enabled) {
+            stats.writer.sections++;
+            stats.writer.inputEvents += notes.size();
+            stats.writer.deviatedNotes += deviatedNotes.size();
+            stats.writer.parallelNotes += parallelNotes.size();
+            stats.writer.prepareSeconds += stats::secondsSince(start);
+        }
 
-                    if (scoreString.size() > format.allowedLineLength) {
-                        longLines.emplace_back(currentBar, format.laneAllocation.at(lane));
-                        ret |= Status::E_EXIST_LONGLINES;
-                    }
+        return ret;
+    }
 
-                    // write the score data to file.
-                    using namespace std;
-                    stream << lane << ':'
-                        << setfill('0') << setw(3) << currentBar << ':'
-                        << scoreString << endl;
+    void MIDItoScore::setAnalyticsTempoMap(const midireader::TempoMap * tempoMap, double windowSeconds) {
+        analyticsTempoMap = tempoMap;
+        analyticsWindowSeconds = windowSeconds;
+    }
+
+    bool MIDItoScore::isHoldNote(const NoteFormat & format, size_t lane, noteevent_const_itr_t it) const {
+        if (it->type != midireader::MidiEvent::NoteOn || it + 1 == scratch.laneNotes[lane].cend())
+            return false;
+
+        // calculate note length
+        const math::Fraction end = (it + 1)->bar + (it + 1)->posInBar;
+        const math::Fraction beg = it->bar + it->posInBar;
+        const math::Fraction length = end - beg;
+
+        return (length >= format.holdMinLength);
+    }
+
+    NoteType MIDItoScore::hitType(const NoteFormat & format, size_t lane, noteevent_const_itr_t it) const {
+        if (format.exNoteClassifier.has_value()) {
+            if (scratch.exNoteFlags[lane][it - scratch.laneNotes[lane].cbegin()])
+                return NoteType::EX_HIT;
+        } else if (format.exNoteDecider) {
+            if (format.exNoteDecider(&*it))
+                return NoteType::EX_HIT;
+        }
+
+        return NoteType::HIT;
+    }
+
+    MIDItoScore::noteevent_const_itr_t MIDItoScore::barEnd(size_t lane, size_t bar, noteevent_const_itr_t beginIt) const {
+        const auto endIt = scratch.laneNotes[lane].cbegin() + scratch.laneBarIndex[lane].first(static_cast<int>(bar) + 1);
+
+        return std::max(beginIt, endIt);
+    }
+
+    void MIDItoScore::collectScoreNotes(
+        const NoteFormat & format,
+        size_t lane,
+        size_t bar,
+        noteevent_const_itr_t beginIt,
+        noteevent_const_itr_t endIt,
+        bool & holdStarted,
+        std::vector<ScoreNote>& scoreNotes,
+        NoteAggregate * aggregate) {
+
+        using namespace midireader;
+
+        scoreNotes.clear();
+
+        for (auto it = beginIt; it != endIt; it++) {
+            if (it == beginIt && holdStarted) {
+                scoreNotes.emplace_back(NoteType::HOLD_END, &*it);
+                holdStarted = false;
+
+                // aggregate
+                if (aggregate) aggregate->increment(scoreNotes.back().type);
+            } else if (it->type == MidiEvent::NoteOn) {
+                if (isHoldNote(format, lane, it)) {
+                    scoreNotes.emplace_back(NoteType::HOLD_BEGIN, &*it);
+                    if ((it + 1)->bar == bar) {
+                        // hold end is in current bar
+                        scoreNotes.emplace_back(NoteType::HOLD_END, &*(it+1));
+                    } else {
+                        // hold end is out of current bar
+                        holdStarted = true;
+                    }
+                } else {
+                    scoreNotes.emplace_back(hitType(format, lane, it), &*it);
                 }
 
-                // ready for next bar
-                beginIt = endIt;
+                // aggregate
+                if (aggregate) aggregate->increment(scoreNotes.back().type);
             }
+        }
 
-            // check loop condition
-            size_t numofEndedLanes = 0;
-            for (size_t lane = 0; lane < format.laneAllocation.size(); lane++) {
-                if (beginIterators.at(lane) == laneNotes.at(lane).cend()) numofEndedLanes++;
-            }
-            if (numofEndedLanes == format.laneAllocation.size()) {
-                break;
+        auto &stats = stats::current();
+        if (stats.enabled) {
+            for (const auto &note : scoreNotes) {
+                switch (note.type) {
+                case NoteType::HIT: stats.writer.hitNotes++; break;
+                case NoteType::EX_HIT: stats.writer.exHitNotes++; break;
+                case NoteType::HOLD_BEGIN: stats.writer.holdBeginNotes++; break;
+                case NoteType::HOLD_END: stats.writer.holdEndNotes++; break;
+                default: break;
+                }
             }
+        }
+    }
+
+    int MIDItoScore::createScoreLine(const NoteFormat & format, size_t lane, size_t bar, const std::vector<ScoreNote>& scoreNotes, std::string & scoreString) {
+        int ret = createScoreString(scoreNotes, scoreString, format.lineEncoding);
 
-            currentBar++;
+        const bool isLong = scoreString.size() > format.allowedLineLength;
+        if (isLong) {
+            longLines.emplace_back(static_cast<int>(bar), format.laneAllocation[lane]);
+            ret |= Status::E_EXIST_LONGLINES;
         }
 
+        auto &stats = stats::current();
+        if (stats.enabled) {
+            stats::addLineLength(stats.writer, scoreString.size());
+            if (isLong)
+                stats.writer.longLines++;
+        }
 
         return ret;
     }
 
-    int MIDItoScore::createScoreString(const std::vector<ScoreNote>& scoreNotes, std::string& scoreString) {
+    int MIDItoScore::createScoreString(const std::vector<ScoreNote>& scoreNotes, std::string& scoreString, LineEncoding encoding) {
         int ret = Status::S_OK;
 
+        auto &stats = stats::current();
+        const size_t concurrentBefore = concurrentNotes.size();
+
         // calculate line length of score data
         size_t mininalUnit = 1;
         for (auto it = scoreNotes.cbegin(); it != scoreNotes.cend(); it++) {
             mininalUnit = std::lcm(mininalUnit, it->evt->posInBar.get().d);
         }
 
+        if (encoding == LineEncoding::AUTO) {
+            // calculate note offsets, and sort them
+            auto& noteOffsets = scratch.noteOffsets;
+            noteOffsets.clear();
+            for (size_t i = 0; i < scoreNotes.size(); i++) {
+                const auto pos = scoreNotes[i].evt->posInBar.get();
+                noteOffsets.emplace_back(pos.n * (mininalUnit / pos.d), i);
+            }
+            std::sort(noteOffsets.begin(), noteOffsets.end());
+
+            // length of the sparse form
+            size_t sparseLength = countDigits(mininalUnit);
+            for (size_t i = 0; i < noteOffsets.size(); i++) {
+                if (i + 1 < noteOffsets.size() && noteOffsets[i].first == noteOffsets[i + 1].first)
+                    continue;
+
+                sparseLength += 1 + countDigits(noteOffsets[i].first) + 1 + countDigits(noteValue(scoreNotes[noteOffsets[i].second]));
+            }
+
+            if (sparseLength < mininalUnit) {
+                scoreString.clear();
+                appendNumber(scoreString, mininalUnit);
+
+                bool firstNote = true;
+                for (size_t i = 0; i < noteOffsets.size(); i++) {
+                    // check concurrent notes
+                    if (i > 0 && noteOffsets[i - 1].first == noteOffsets[i].first) {
+                        concurrentNotes.push_back(*(scoreNotes[noteOffsets[i].second].evt));
+                        ret |= Status::E_EXIST_CONCURRENTNOTES;
+                    }
+
+                    // the last note is written on the same position, like the dense form
+                    if (i + 1 < noteOffsets.size() && noteOffsets[i].first == noteOffsets[i + 1].first)
+                        continue;
+
+                    scoreString.push_back(firstNote ? ':' : ',');
+                    firstNote = false;
+                    appendNumber(scoreString, noteOffsets[i].first);
+                    scoreString.push_back('=');
+                    appendNumber(scoreString, noteValue(scoreNotes[noteOffsets[i].second]));
+                }
+
+                if (stats.enabled) {
+                    stats.writer.sparseLines++;
+                    stats.writer.concurrencyChecks += noteOffsets.size();
+                    stats.writer.concurrentNotes += concurrentNotes.size() - concurrentBefore;
+                }
+
+                return ret;
+            }
+        }
+
         // create empty score data
         scoreString.resize(mininalUnit);
         for (auto it = scoreString.begin(); it != scoreString.end(); it++) *it = '0';
@@ -200,6 +456,12 @@ namespace miditoscore {
             scoreString.at(offset) = '0' + static_cast<int>(it->type) + (it->evt->channel << 3);
         }
 
+        if (stats.enabled) {
+            stats.writer.denseLines++;
+            stats.writer.concurrencyChecks += scoreNotes.size();
+            stats.writer.concurrentNotes += concurrentNotes.size() - concurrentBefore;
+        }
+
         return ret;
     }
 
@@ -226,11 +488,33 @@ namespace miditoscore {
         return static_cast<int>(lane_it - format.laneAllocation.cbegin());
     }
 
+    void MIDItoScore::releaseScratch() {
+        scratch = Scratch();
+        dynamicWriter.reset();
+    }
+
+    int MIDItoScore::writeLanes(std::ostream & stream, const NoteFormat & format) {
+        switch (scratch.laneNotes.size()) {
+        case 4: return BasicScoreWriter<4>(*this).write(stream, format);
+        case 5: return BasicScoreWriter<5>(*this).write(stream, format);
+        case 6: return BasicScoreWriter<6>(*this).write(stream, format);
+        case 7: return BasicScoreWriter<7>(*this).write(stream, format);
+        case 8: return BasicScoreWriter<8>(*this).write(stream, format);
+        default:
+            if (!dynamicWriter)
+                dynamicWriter = std::make_unique<BasicScoreWriter<0>>(*this);
+
+            return dynamicWriter->write(stream, format);
+        }
+    }
+
     void MIDItoScore::clear() {
         concurrentNotes.clear();
         deviatedNotes.clear();
         noteAggregate.clear();
         parallelNotes.clear();
+        longLines.clear();
+        channels.clear();
     }
 
     bool Success(int s) { return s >= 0; };
@@ -22,6 +22,20 @@
  lane			:0
  note position	:20th bar and offset 16th-note x 4,
  note type		:1
+
+
+ --- sparse score data format -----
+ s:nnn:d:o=t,o=t...
+ ----------------------------------
+ d		:denominator of the note position (length of kk... in the dense form)
+ o		:offset of the note in 1/d unit
+ t		:the note type (same value as kk... in the dense form, in decimal)
+
+ The sparse form is written when NoteFormat::lineEncoding is AUTO and it is shorter than the dense form.
+ It is distinguished from the dense form by '=', which never appears in kk...
+
+ --- example sparse score data ----
+ 0:020:192:5=1,97=2
  */
 
 
@@ -32,19 +46,40 @@
 
 #include <optional>
 #include <functional>
+#include <memory>
+#include <limits>
 
 #include "MIDIReader.hpp"
+#include "NoteClassifier.hpp"
+#include "ChartAnalytics.hpp"
+#include "ChordIndex.hpp"
+
+
+namespace midireader {
+
+    class TempoMap;
+
+}
 
 
 namespace miditoscore {
 
 
+    enum class LineEncoding {
+        DENSE = 0,
+        // use the sparse form if it is shorter than the dense form
+        AUTO,
+    };
+
     struct NoteFormat {
         math::Fraction holdMinLength;
         std::vector<int> laneAllocation;
         size_t allowedLineLength;
         std::optional<size_t> parallelsLimit;
+        // exNoteClassifier is used if it is set, otherwise exNoteDecider is called for each note.
+        std::optional<NoteClassifier> exNoteClassifier;
         std::function<bool(const midireader::NoteEvent* note)> exNoteDecider;
+        LineEncoding lineEncoding = LineEncoding::DENSE;
     };
 
     enum class NoteType {
@@ -63,6 +98,10 @@ namespace miditoscore {
             type(_type), evt(_evt) {};
     };
 
+    // version of the conversion. increase it when the output of the same input is changed,
+    // so that the cached outputs are invalidated.
+    constexpr uint32_t ConverterVersion = 6;
+
     namespace Status {
         constexpr int S_OK                      = 0b00000;
         constexpr int E_EXIST_CONCURRENTNOTES   = 0b00001;
@@ -78,8 +117,23 @@ namespace miditoscore {
 
 
 
+    template<size_t Lanes>
+    class BasicScoreWriter;
+
+    class ScoreLineGenerator;
+    class IncrementalScore;
+
+    struct CompiledChart;
+
+
     class MIDItoScore {
+        template<size_t Lanes>
+        friend class BasicScoreWriter;
+        friend class ScoreLineGenerator;
+        friend class IncrementalScore;
+
         using noteevent_const_itr_t = std::vector<midireader::NoteEvent>::const_iterator;
+
         struct scoreline_t {
             int bar, interval;
             scoreline_t(int b, int i) : bar(b), interval(i) {}
@@ -89,7 +143,7 @@ namespace miditoscore {
             NoteAggregate() : hit(0), hold(0), exhit(0) {}
             ~NoteAggregate() {}
 
-            void reset() { hit = 0, hold = 0; }
+            void reset() { hit = 0, exhit = 0, hold = 0; }
             void increment(NoteType type) {
                 switch (type) {
                 case miditoscore::NoteType::HIT: hit++; break;
@@ -105,6 +159,22 @@ namespace miditoscore {
             size_t hold;
         };
 
+        // working buffers of writeScore.
+        // they are reused by every call and keep their capacity, so that the steady-state conversion does not allocate.
+        struct Scratch {
+            std::vector<std::vector<midireader::NoteEvent>> laneNotes;
+            std::vector<midireader::BarIndex> laneBarIndex;
+            std::vector<std::vector<uint8_t>> exNoteFlags;
+            std::vector<ScoreNote> scoreNotes;
+            std::string scoreString;
+            // (offset, index of scoreNotes) for the sparse form
+            std::vector<std::pair<size_t, size_t>> noteOffsets;
+            // the note-ons in the lanes, grouped by tick
+            ChordIndex chords;
+            // the lanes allowed in a group by parallelsLimit
+            std::vector<uint32_t> chordLanes;
+        };
+
 
     public:
         MIDItoScore();
@@ -113,7 +183,28 @@ namespace miditoscore {
         int writeScore(const std::string &fileName, const NoteFormat &format, const std::vector<midireader::NoteEvent> &notes);
         int writeScore(std::ostream &stream, const NoteFormat &format, const std::vector<midireader::NoteEvent> &notes);
 
-        int createScoreString(const std::vector<ScoreNote>& scoreNotes, std::string& scoreString);
+        // create a generator which yields the score lines of bars [beginBar, endBar] on demand.
+        // notice: the generator refers to this object, so it is invalidated by the next writeScore() or generateScore().
+        ScoreLineGenerator generateScore(
+            const NoteFormat &format,
+            const std::vector<midireader::NoteEvent> &notes,
+            int beginBar = 1,
+            int endBar = std::numeric_limits<int>::max()
+        );
+
+        // compile the notes into time sorted arrays of each lane, for the binary score (see BinaryScore.hpp).
+        // the analytics of the chart are computed with the tempo map, and stored in chart.analytics.
+        int compileScore(
+            const NoteFormat &format,
+            const std::vector<midireader::NoteEvent> &notes,
+            const midireader::TempoMap &tempoMap,
+            CompiledChart &chart
+        );
+        // compile the notes of the last conversion without converting them again.
+        // chart.analytics are those of the last conversion, so the tempo map should be set by setAnalyticsTempoMap() before it.
+        void compileLastScore(const NoteFormat &format, const midireader::TempoMap &tempoMap, CompiledChart &chart) const;
+
+        int createScoreString(const std::vector<ScoreNote>& scoreNotes, std::string& scoreString, LineEncoding encoding = LineEncoding::DENSE);
 
         const std::vector<midireader::NoteEvent>& getConcurrentNotes() const { return concurrentNotes; }
         const std::vector<midireader::NoteEvent>& getDeviatedNotes() const { return deviatedNotes; }
@@ -122,6 +213,17 @@ namespace miditoscore {
         const std::vector<int>& getChannels() const { return channels; }
         NoteAggregate getNoteAggregate(int interval) const;
 
+        // compute the analytics by writeScore(), generateScore() and IncrementalScore with the tempo map.
+        // nullptr disables them. the tempo map must be alive while it is set.
+        void setAnalyticsTempoMap(const midireader::TempoMap *tempoMap, double windowSeconds = 1.0);
+        // the analytics of the last conversion, which are empty if no tempo map is given
+        const ChartAnalytics& getAnalytics() const { return analyzer.get(); }
+        // the note-ons of the last conversion grouped by tick. the note indices refer to the notes given to it.
+        const ChordIndex& getChordIndex() const { return scratch.chords; }
+
+        // free the memory held by the working buffers
+        void releaseScratch();
+
     private:
 
         NoteFormat noteFormat;
@@ -132,8 +234,46 @@ namespace miditoscore {
         std::vector<NoteAggregate> noteAggregate;
         std::vector<int>  channels;
 
+        const midireader::TempoMap *analyticsTempoMap = nullptr;
+        double analyticsWindowSeconds = 1.0;
+        ChartAnalyzer analyzer;
+
+        Scratch scratch;
+        // BasicScoreWriter<0> is kept to reuse its lane state
+        std::unique_ptr<BasicScoreWriter<0>> dynamicWriter;
+
         int selectNoteLane(const NoteFormat &format, const midireader::NoteEvent &note);
 
+        // group the notes by lane into the scratch, and check invalid notes.
+        // the analytics are computed in the same pass if the tempo map is given.
+        int prepare(const NoteFormat &format, const std::vector<midireader::NoteEvent> &notes, const midireader::TempoMap *tempoMap);
+
+        bool isHoldNote(const NoteFormat &format, size_t lane, noteevent_const_itr_t it) const;
+        // HIT or EX_HIT
+        NoteType hitType(const NoteFormat &format, size_t lane, noteevent_const_itr_t it) const;
+
+        // the end of the events in the bar, which begins from beginIt
+        noteevent_const_itr_t barEnd(size_t lane, size_t bar, noteevent_const_itr_t beginIt) const;
+
+        // enumerate the score notes of the lane from the events [beginIt, endIt) in the bar.
+        // holdStarted tells that a hold note continues from the previous bar, and it is updated for the next bar.
+        void collectScoreNotes(
+            const NoteFormat &format,
+            size_t lane,
+            size_t bar,
+            noteevent_const_itr_t beginIt,
+            noteevent_const_itr_t endIt,
+            bool &holdStarted,
+            std::vector<ScoreNote> &scoreNotes,
+            NoteAggregate *aggregate
+        );
+
+        // create the score string of a line, and check its length.
+        int createScoreLine(const NoteFormat &format, size_t lane, size_t bar, const std::vector<ScoreNote> &scoreNotes, std::string &scoreString);
+
+        // select the specialization of BasicScoreWriter by the number of lanes, and write the score lines.
+        int writeLanes(std::ostream &stream, const NoteFormat &format);
+
         void clear();
 
 
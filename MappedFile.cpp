@@ -0,0 +1,127 @@
+﻿#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+namespace fileio {
+
+#ifdef _WIN32
+
+    MappedFile::MappedFile()
+        : opened(false), address(nullptr), length(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr) {}
+
+    bool MappedFile::open(const std::string & fileName) {
+        close();
+
+        fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize)) {
+            close();
+            return false;
+        }
+
+        length = static_cast<size_t>(fileSize.QuadPart);
+        opened = true;
+
+        // an empty file cannot be mapped
+        if (length == 0)
+            return true;
+
+        mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mappingHandle) {
+            close();
+            return false;
+        }
+
+        address = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+        if (!address) {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (address)
+            UnmapViewOfFile(address);
+        if (mappingHandle)
+            CloseHandle(mappingHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE)
+            CloseHandle(fileHandle);
+
+        opened = false;
+        address = nullptr;
+        length = 0;
+        fileHandle = INVALID_HANDLE_VALUE;
+        mappingHandle = nullptr;
+    }
+
+#else
+
+    MappedFile::MappedFile()
+        : opened(false), address(nullptr), length(0) {}
+
+    bool MappedFile::open(const std::string & fileName) {
+        close();
+
+        int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+
+        length = static_cast<size_t>(st.st_size);
+        opened = true;
+
+        // an empty file cannot be mapped
+        if (length == 0) {
+            ::close(fd);
+            return true;
+        }
+
+        void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if (p == MAP_FAILED) {
+            opened = false;
+            length = 0;
+            return false;
+        }
+
+        address = static_cast<const char*>(p);
+
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (address)
+            munmap(const_cast<char*>(address), length);
+
+        opened = false;
+        address = nullptr;
+        length = 0;
+    }
+
+#endif
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+}
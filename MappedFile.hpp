@@ -0,0 +1,45 @@
+﻿//
+// MappedFile
+// This class maps a whole file into memory for reading.
+//
+
+
+#ifndef _MAPPED_FILE_HPP_
+#define _MAPPED_FILE_HPP_
+
+
+#include <string>
+
+
+namespace fileio {
+
+    class MappedFile {
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile &operator=(const MappedFile&) = delete;
+
+        bool open(const std::string &fileName);
+        void close();
+
+        bool is_open() const { return opened; }
+        const char *data() const { return address; }
+        size_t size() const { return length; }
+
+    private:
+        bool opened;
+        const char *address;
+        size_t length;
+
+#ifdef _WIN32
+        void *fileHandle;
+        void *mappingHandle;
+#endif
+
+    };
+
+}
+
+#endif // !_MAPPED_FILE_HPP_
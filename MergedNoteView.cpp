@@ -0,0 +1,90 @@
+﻿#include "MergedNoteView.hpp"
+
+#include <algorithm>
+
+
+namespace midireader {
+
+    namespace {
+
+        // the heap is ordered by (time, track), and the smallest one is at the front
+        template<class T>
+        bool laterThan(const T &a, const T &b) {
+            if (a.it->time != b.it->time)
+                return a.it->time > b.it->time;
+            return a.track > b.track;
+        }
+
+    }
+
+
+    MergedNoteView::MergedNoteView(const std::vector<std::vector<NoteEvent>>& tracks) : numofEvents(0) {
+        for (size_t i = 0; i < tracks.size(); i++) {
+            addTrack(tracks[i], i + 1);
+        }
+        reset();
+    }
+
+    MergedNoteView::MergedNoteView(const MIDIReader & midi) : MergedNoteView(midi.getNoteEvent()) {}
+
+    MergedNoteView::MergedNoteView(const MIDIReader & midi, const std::vector<size_t>& trackNums) : numofEvents(0) {
+        const auto &all = midi.getNoteEvent();
+        for (size_t trackNum : trackNums) {
+            if (trackNum >= 1 && trackNum <= all.size())
+                addTrack(all[trackNum - 1], trackNum);
+        }
+        reset();
+    }
+
+    MergedNoteView::~MergedNoteView() {}
+
+    bool MergedNoteView::next(MergedNote & note) {
+        if (heap.empty())
+            return false;
+
+        auto &top = heap.front();
+        note.evt = top.it;
+        note.track = top.track;
+
+        // replace the top with its next event, or with the last track if it is finished
+        if (++top.it == top.end) {
+            top = heap.back();
+            heap.pop_back();
+        }
+
+        // sift down the top. it is cheap when the same track continues.
+        const size_t size = heap.size();
+        size_t i = 0;
+        while (true) {
+            const size_t left = 2 * i + 1;
+            if (left >= size)
+                break;
+
+            size_t child = left;
+            if (left + 1 < size && laterThan(heap[left], heap[left + 1]))
+                child = left + 1;
+            if (!laterThan(heap[i], heap[child]))
+                break;
+
+            std::swap(heap[i], heap[child]);
+            i = child;
+        }
+
+        return true;
+    }
+
+    void MergedNoteView::reset() {
+        heap.clear();
+        for (const auto &cursor : tracks) {
+            if (cursor.it != cursor.end)
+                heap.push_back(cursor);
+        }
+        std::make_heap(heap.begin(), heap.end(), laterThan<Cursor>);
+    }
+
+    void MergedNoteView::addTrack(const std::vector<NoteEvent>& events, size_t trackNum) {
+        tracks.push_back(Cursor{ events.data(), events.data() + events.size(), trackNum });
+        numofEvents += events.size();
+    }
+
+}
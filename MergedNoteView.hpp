@@ -0,0 +1,102 @@
+﻿//
+// MergedNoteView
+// This class yields the note events of several tracks in the order of (time, track), without copying them.
+// The events of each track are already sorted by time, so they are merged by a heap of the tracks.
+// The events of the same track and time keep their order in the track.
+//
+// --- example -----------------------------
+// midireader::MergedNoteView view(midi);        // all tracks
+// midireader::MergedNoteView view(midi, {2, 3}); // the tracks 2 and 3
+// for (const auto &note : view) {
+//     // note.track, *note.evt
+// }
+// ------------------------------------------
+//
+
+
+#ifndef _MERGED_NOTE_VIEW_HPP_
+#define _MERGED_NOTE_VIEW_HPP_
+
+
+#include <iterator>
+#include <vector>
+
+#include "MIDIReader.hpp"
+
+
+namespace midireader {
+
+    struct MergedNote {
+        const NoteEvent *evt;
+        // the track number given to MIDIReader::getNoteEvent(trackNum)
+        size_t track;
+    };
+
+
+    class MergedNoteView {
+    public:
+        // input iterator, which advances the view
+        class iterator {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = MergedNote;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const MergedNote*;
+            using reference = const MergedNote&;
+
+            iterator() : view(nullptr), note{ nullptr, 0 } {}
+
+            reference operator*() const { return note; }
+            pointer operator->() const { return &note; }
+            iterator &operator++() { if (!view->next(note)) view = nullptr; return *this; }
+
+            bool operator==(const iterator &other) const { return view == other.view; }
+            bool operator!=(const iterator &other) const { return view != other.view; }
+
+        private:
+            friend class MergedNoteView;
+            explicit iterator(MergedNoteView *v) : view(v), note{ nullptr, 0 } { ++*this; }
+
+            MergedNoteView *view;
+            MergedNote note;
+        };
+
+        // the events of all tracks. the track numbers start from 1.
+        explicit MergedNoteView(const std::vector<std::vector<NoteEvent>> &tracks);
+        explicit MergedNoteView(const MIDIReader &midi);
+        // the events of the tracks. the tracks which do not exist are ignored.
+        MergedNoteView(const MIDIReader &midi, const std::vector<size_t> &trackNums);
+        ~MergedNoteView();
+
+        // get the next event. return false if all events are yielded.
+        bool next(MergedNote &note);
+
+        // restart from the first event
+        void reset();
+
+        // the view is consumed by the iteration
+        iterator begin() { return iterator(this); }
+        iterator end() { return iterator(); }
+
+        // the total number of the events
+        size_t size() const { return numofEvents; }
+
+    private:
+        struct Cursor {
+            const NoteEvent *it;
+            const NoteEvent *end;
+            size_t track;
+        };
+
+        // the tracks to merge, and the heap of the tracks which have remaining events
+        std::vector<Cursor> tracks;
+        std::vector<Cursor> heap;
+        size_t numofEvents;
+
+        void addTrack(const std::vector<NoteEvent> &events, size_t trackNum);
+
+    };
+
+}
+
+#endif // !_MERGED_NOTE_VIEW_HPP_
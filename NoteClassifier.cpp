@@ -0,0 +1,66 @@
+﻿#include "NoteClassifier.hpp"
+
+#include "Checksum.hpp"
+
+
+namespace miditoscore {
+
+    NoteClassifier::NoteClassifier() {
+        clear();
+    }
+
+    NoteClassifier::~NoteClassifier() {}
+
+    bool NoteClassifier::addRule(const NoteRule & rule) {
+        if (numofRules >= MaxRules)
+            return false;
+
+        if (rule.minVelocity > rule.maxVelocity || rule.minInterval > rule.maxInterval)
+            return false;
+
+        const uint32_t bit = 1u << numofRules;
+
+        for (int v = 0; v < 128; v++) {
+            if (rule.minVelocity <= v && v <= rule.maxVelocity)
+                velocityTable[v] |= bit;
+            if (rule.minInterval <= v && v <= rule.maxInterval)
+                intervalTable[v] |= bit;
+        }
+
+        for (int ch = 0; ch < 16; ch++) {
+            if ((rule.channelMask >> ch) & 1)
+                channelTable[ch] |= bit;
+        }
+
+        numofRules++;
+
+        return true;
+    }
+
+    void NoteClassifier::clear() {
+        velocityTable.fill(0);
+        intervalTable.fill(0);
+        channelTable.fill(0);
+        numofRules = 0;
+    }
+
+    void NoteClassifier::classify(const std::vector<midireader::NoteEvent>& notes, std::vector<uint8_t>& result) const {
+        result.resize(notes.size());
+
+        // three table lookups for each note, instead of calling exNoteDecider for each note.
+        // the lookups are gathers, so the loop is not vectorized.
+        const size_t size = notes.size();
+        for (size_t i = 0; i < size; i++) {
+            result[i] = match(notes[i]) ? 1 : 0;
+        }
+    }
+
+    uint64_t NoteClassifier::hash(uint64_t seed) const {
+        seed = checksum::hash64(velocityTable.data(), sizeof(velocityTable), seed);
+        seed = checksum::hash64(intervalTable.data(), sizeof(intervalTable), seed);
+        seed = checksum::hash64(channelTable.data(), sizeof(channelTable), seed);
+
+        return seed;
+    }
+
+}
@@ -0,0 +1,72 @@
+﻿//
+// NoteClassifier
+// This class decides whether a note is an EX note by declarative rules (velocity, channel, interval).
+// The rules are compiled into lookup tables once, and then the notes of a lane are classified in one loop
+// without calling a function for each note.
+//
+
+
+#ifndef _NOTE_CLASSIFIER_HPP_
+#define _NOTE_CLASSIFIER_HPP_
+
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+#include "MIDIReader.hpp"
+
+
+namespace miditoscore {
+
+    // a note matches the rule when all of the conditions are satisfied.
+    struct NoteRule {
+        int minVelocity = 0;
+        int maxVelocity = 127;
+        int minInterval = 0;
+        int maxInterval = 127;
+        // bit n is for the channel n
+        uint16_t channelMask = 0xffff;
+    };
+
+
+    class NoteClassifier {
+    public:
+        static constexpr size_t MaxRules = 32;
+
+        NoteClassifier();
+        ~NoteClassifier();
+
+        // a note is classified as EX note when it matches any of the rules.
+        // return false if the rule is invalid or the number of rules is over MaxRules.
+        bool addRule(const NoteRule &rule);
+        void clear();
+
+        bool empty() const { return numofRules == 0; }
+        size_t size() const { return numofRules; }
+
+        bool match(const midireader::NoteEvent &note) const {
+            return (velocityTable[note.velocity & 0x7f] &
+                    intervalTable[note.interval & 0x7f] &
+                    channelTable[note.channel & 0x0f]) != 0;
+        }
+
+        // result[i] is 1 if notes[i] is EX note, otherwise 0.
+        void classify(const std::vector<midireader::NoteEvent> &notes, std::vector<uint8_t> &result) const;
+
+        // hash of the compiled tables. the classifiers which classify the notes in the same way have the same hash.
+        uint64_t hash(uint64_t seed = 0) const;
+
+    private:
+        // bit n of each table is set when the value satisfies the condition of n-th rule.
+        std::array<uint32_t, 128> velocityTable;
+        std::array<uint32_t, 128> intervalTable;
+        std::array<uint32_t, 16> channelTable;
+
+        size_t numofRules;
+
+    };
+
+}
+
+#endif // !_NOTE_CLASSIFIER_HPP_
@@ -0,0 +1,471 @@
+﻿#include "ScoreExporter.hpp"
+
+#include <iomanip>
+#include <fstream>
+
+#include "BinaryScore.hpp"
+#include "TempoMap.hpp"
+#include "Trace.hpp"
+#include "AllocationCounter.hpp"
+
+
+namespace miditoscore {
+
+    namespace fs = std::filesystem;
+
+    namespace {
+
+        int searchTrack(const std::vector<midireader::Track>& tracks, const std::string& searchName) {
+            int trackNum = -1;
+
+            for (const auto &t : tracks) {
+                if (t.name == searchName) {
+                    trackNum = t.trackNum;
+                    break;
+                }
+            }
+
+            return trackNum;
+        }
+
+        bool isInclude(int val, int flag) {
+            return (val & flag) == flag;
+        }
+
+        std::string intervalString(int interval, const SongSettings &song) {
+            return song.intervalAsName ?
+                midireader::toNoteName(interval, song.pitchNotation) : std::to_string(interval);
+        }
+
+        void printNotes(std::ostream &log, const std::vector<midireader::NoteEvent> &notes, const SongSettings &song) {
+            int cnt = 0;
+            for (const auto &n : notes) {
+                using namespace std;
+                log << "小節:"
+                    << setfill('0') << setw(3) << n.bar
+                    << " 小節内位置:"
+                    << n.posInBar
+                    << " 音程:"
+                    << intervalString(n.interval, song)
+                    << '\n';
+
+                if (++cnt >= 10)
+                    break;
+            }
+
+            if (notes.size() > 10)
+                log << "...他" << notes.size() - 10 << "コ\n";
+
+            log << '\n';
+        }
+
+    }
+
+
+    OutputProfile buttonProfile() {
+        OutputProfile profile;
+        profile.name = "button";
+        profile.sections = {
+            { "1", "easy", "easy" },
+            { "2", "normal", "normal" },
+            { "3", "hard", "hard" },
+        };
+        profile.songDirectory = true;
+
+        return profile;
+    }
+
+    OutputProfile wiiProfile() {
+        OutputProfile profile;
+        profile.name = "wii";
+        profile.sections = {
+            { "4", "easy-wii", "easy(wii)" },
+            { "5", "normal-wii", "normal(wii)" },
+            { "6", "hard-wii", "hard(wii)" },
+        };
+        profile.parallelsLimit = 2;
+        profile.songDirectory = false;
+        profile.fileSuffix = "_wii";
+        profile.extraHeader = u8"begin:header-wii\n\nlevel:0:0:0\n\nend\n\n";
+
+        return profile;
+    }
+
+    bool findProfile(const std::string & name, OutputProfile & profile) {
+        if (name == "button") {
+            profile = buttonProfile();
+            return true;
+        } else if (name == "wii") {
+            profile = wiiProfile();
+            return true;
+        }
+
+        return false;
+    }
+
+    NoteFormat makeNoteFormat(const SongSettings & song, const OutputProfile & profile) {
+        NoteFormat format;
+        format.holdMinLength = song.holdMinLength;
+        format.laneAllocation = song.laneAllocation;
+        format.allowedLineLength = 1024;
+        format.parallelsLimit = profile.parallelsLimit;
+
+        NoteRule exNoteRule;
+        exNoteRule.minVelocity = 110;
+        format.exNoteClassifier.emplace();
+        format.exNoteClassifier->addRule(exNoteRule);
+
+        return format;
+    }
+
+    fs::path scoreFilePath(const fs::path & outputDir, const SongSettings & song, const OutputProfile & profile) {
+        if (profile.songDirectory)
+            return outputDir / song.id / "score.txt";
+
+        return outputDir / (song.id + profile.fileSuffix + ".txt");
+    }
+
+    fs::path binaryScoreFilePath(const fs::path & outputDir, const SongSettings & song, const OutputProfile & profile) {
+        if (profile.songDirectory)
+            return outputDir / song.id / "score.bin";
+
+        return outputDir / (song.id + profile.fileSuffix + ".bin");
+    }
+
+    int writeProfileScore(
+        std::ostream & score,
+        std::ostream & log,
+        const midireader::MIDIReader & midi,
+        const SongSettings & song,
+        const OutputProfile & profile,
+        std::vector<CompiledChart>* charts,
+        ExportState * state,
+        MIDItoScore * converter) {
+
+        int result = Status::S_OK;
+
+        score << u8"begin:header\n\n";
+        score << u8"id:" << song.id << '\n';
+
+        if (profile.songDirectory) {
+            score << u8"title:曲名" << '\n';
+            score << u8"artist:アーティスト名" << '\n';
+            score << std::fixed << std::setprecision(3);
+            score << u8"chobeg:" << song.chorusBegSec << "\n";
+            score << u8"choend:" << song.chorusEndSec << "\n";
+        }
+
+        // write tempo
+        log << "テンポ情報\n";
+        score << '\n';
+
+        for (const auto &t : midi.getTempoEvent()) {
+            using namespace std;
+
+            // ex. tempo:001:1/0:120.000
+            score << "tempo:"
+                << setfill('0') << setw(3) << t.bar
+                << ':'
+                << t.posInBar
+                << ':'
+                << setw(6) << fixed << setprecision(3) << t.tempo
+                << '\n';
+
+            log << "小節:"
+                << setfill('0') << setw(3) << t.bar
+                << " 小節内位置:"
+                << t.posInBar
+                << " テンポ:"
+                << setw(6) << fixed << setprecision(3) << t.tempo
+                << '\n';
+        }
+
+        // write time signature
+        log << "\n拍子情報\n";
+
+        for (const auto &b : midi.getBeatEvent()) {
+            using namespace std;
+
+            // ex. beat:001:4/4
+            score << "beat:"
+                << setfill('0') << setw(3) << b.bar
+                << ':'
+                << b.beat
+                << '\n';
+
+            log << "小節:"
+                << setfill('0') << setw(3) << b.bar
+                << " 拍子:"
+                << b.beat
+                << '\n';
+        }
+
+        score << u8"\nend\n\n";
+        score << profile.extraHeader;
+
+        const NoteFormat format = makeNoteFormat(song, profile);
+        const midireader::TempoMap tempoMap(midi.getTempoEvent(), midi.getHeader().resolutionUnit);
+        std::unique_ptr<MIDItoScore> ownConverter;
+        if (!converter) {
+            ownConverter = std::make_unique<MIDItoScore>();
+            converter = ownConverter.get();
+        }
+        MIDItoScore &toscore = *converter;
+
+        if (state) {
+            state->sections.resize(profile.sections.size());
+            for (auto &section : state->sections) {
+                if (!section)
+                    section = std::make_unique<IncrementalScore>();
+            }
+        }
+
+        // write note position
+        for (size_t i = 0; i < profile.sections.size(); i++) {
+            const auto &section = profile.sections[i];
+            const int trackNum = searchTrack(midi.getTracks(), section.trackName);
+            if (trackNum < 0) {
+                continue;
+            }
+
+            log << '\n';
+            log << section.label << "譜面を作成中です... ";
+            score << "begin:" << section.sectionName << "\n\n";
+
+            // the analytics of the chart are computed by the same pass as the text score
+            const midireader::TempoMap *analyticsTempoMap = charts ? &tempoMap : nullptr;
+
+            int ret;
+            if (state) {
+                auto &incremental = *state->sections[i];
+                incremental.setAnalyticsTempoMap(analyticsTempoMap);
+                ret = incremental.update(format, midi.getNoteEvent(trackNum));
+                incremental.setAnalyticsTempoMap(nullptr);
+                incremental.write(score);
+            } else {
+                toscore.setAnalyticsTempoMap(analyticsTempoMap);
+                ret = toscore.writeScore(score, format, midi.getNoteEvent(trackNum));
+                toscore.setAnalyticsTempoMap(nullptr);
+            }
+            result |= ret;
+
+            const MIDItoScore &sectionConverter = state ? state->sections[i]->getConverter() : toscore;
+
+            score << "\nend\n\n";
+
+            // print return value
+            if (ret == Status::S_OK)
+                log << "完了\n";
+            else {
+                log << "エラー\n";
+                printDiagnostics(log, ret, sectionConverter, format, song);
+            }
+
+            printNoteAggregate(log, sectionConverter, song);
+
+            if (charts) {
+                CompiledChart chart;
+                chart.name = section.sectionName;
+                sectionConverter.compileLastScore(format, tempoMap, chart);
+                charts->push_back(std::move(chart));
+            }
+        }
+
+        return result;
+    }
+
+    int exportProfile(
+        const fs::path & outputDir,
+        std::ostream & log,
+        const midireader::MIDIReader & midi,
+        const SongSettings & song,
+        const OutputProfile & profile,
+        ExportState * state,
+        std::vector<CompiledChart> * compiledCharts) {
+
+        TRACE_SCOPE("exportProfile");
+        ALLOC_PHASE(Export);
+
+        if (profile.songDirectory && state) {
+            // keep the files in the directory
+            std::error_code ec;
+            fs::create_directories(outputDir / song.id, ec);
+        } else if (profile.songDirectory) {
+            // create empty directory
+            const auto songDir = outputDir / song.id;
+
+            try {
+                if (fs::exists(songDir))
+                    fs::remove_all(songDir);
+            } catch (const std::exception&) {
+                log << "[!] ディレクトリの削除に失敗しました\n";
+                return Status::E_CANNOT_OPEN_FILE;
+            }
+
+            try {
+                fs::create_directories(songDir);
+            } catch (const std::exception&) {
+                log << "[!] ディレクトリ作成に失敗しました\n";
+                return Status::E_CANNOT_OPEN_FILE;
+            }
+        }
+
+        std::ofstream score(scoreFilePath(outputDir, song, profile));
+        if (!score.is_open()) {
+            log << "[!] 譜面ファイルを作成できません\n";
+            return Status::E_CANNOT_OPEN_FILE;
+        }
+
+        std::vector<CompiledChart> charts;
+        int ret = writeProfileScore(score, log, midi, song, profile, &charts, state);
+
+        {
+            TRACE_SCOPE("flushScore");
+            score.close();
+        }
+
+        TRACE_SCOPE("writeBinaryScore");
+        if (!writeBinaryScore(binaryScoreFilePath(outputDir, song, profile).string(), midi, charts)) {
+            log << "[!] バイナリ譜面の書き出しに失敗しました\n";
+            ret |= Status::E_CANNOT_OPEN_FILE;
+        }
+
+        if (compiledCharts)
+            *compiledCharts = std::move(charts);
+
+        return ret;
+    }
+
+    bool writeIniFile(const fs::path & songDir, const fs::path & musicFile, const fs::path & jacketFile) {
+        std::basic_ofstream<char32_t> ini;
+        ini.open(songDir / "score.ini");
+        if (!ini.is_open())
+            return false;
+
+        ini << U"jacket=\"" << jacketFile.filename().u32string() << U"\"\n";
+        ini << U"music=\"" << musicFile.filename().u32string() << U"\"\n";
+        ini << U"score=\"" << U"score.txt" << U"\"\n";
+        ini << U"musicEx=\"" << U"\"\n";
+
+        return true;
+    }
+
+    bool printReadStatus(std::ostream & log, midireader::Status ret, const midireader::MIDIReader & midi) {
+        switch (ret) {
+        case midireader::Status::E_CANNOT_OPEN_FILE:
+        case midireader::Status::E_INVALID_ARG:
+            log << "[!] ファイルが開けません.パスを確認して下さい\n";
+            return false;
+        case midireader::Status::E_UNSUPPORTED_FORMAT:
+            log << "[!] このフォーマットはサポートされていません.\n";
+            return false;
+        case midireader::Status::E_INVALID_FILE:
+            log << "[!] MIDIファイルが破損しています\n";
+            return false;
+        case midireader::Status::S_NO_EMBED_TIMESIGNATURE:
+            log << "[!] MIDIファイルに拍子情報が埋め込まれていません.\n";
+            return false;
+        default:
+            log << "読み込み完了\n\n";
+            break;
+        }
+
+        if (midi.getTempoEvent().empty()) {
+            log << "[!] MIDIファイルにテンポ情報が埋め込まれていません.\n";
+            return false;
+        }
+
+        return true;
+    }
+
+    void printDiagnostics(std::ostream & log, int ret, const MIDItoScore & toscore, const NoteFormat & format, const SongSettings & song) {
+        if (isInclude(ret, Status::E_EXIST_CONCURRENTNOTES)) {
+            log << "[!] 同じタイミングのノーツが存在しています．\n";
+            log << "  ->長押しの後にあるノーツと繋がっていないかチェックしてください\n";
+            log << "  ->ノーツが重なっていないかチェックしてください\n";
+            log << "-- 問題のあるノーツ --\n";
+
+            printNotes(log, toscore.getConcurrentNotes(), song);
+        }
+        if (isInclude(ret, Status::E_MANY_PARALLELS)) {
+            log << "[!] " << format.parallelsLimit.value_or(0) + 1 << "レーン以上の同時ノーツが存在しています．\n";
+            log << "-- 問題のあるノーツ --\n";
+
+            printNotes(log, toscore.getParallelNotes(), song);
+        }
+        if (isInclude(ret, Status::S_EXIST_DEVIATEDNOTES)) {
+            log << "[!] 指定された音程に当てはまらないノーツが存在しています.\n";
+            log << "-- 問題のあるノーツ --\n";
+
+            printNotes(log, toscore.getDeviatedNotes(), song);
+        }
+        if (isInclude(ret, Status::E_EXIST_LONGLINES)) {
+            log << "[!] 譜面データの1行がとても長くなっています.\n";
+            log << "  -> 許容できる1行の文字数は" << format.allowedLineLength << "です\n";
+            log << "  -> 該当する箇所のノーツをDAW上でクォンタイズしてください．\n";
+            log << "-- 該当する箇所 --\n";
+
+            int cnt = 0;
+            const auto &lines = toscore.getLongLines();
+            for (const auto &l : lines) {
+                using namespace std;
+                log << "小節:"
+                    << setfill('0') << setw(3) << l.bar
+                    << " 音程:"
+                    << intervalString(l.interval, song)
+                    << '\n';
+
+                if (++cnt >= 10)
+                    break;
+            }
+
+            if (lines.size() > 10)
+                log << "...他" << lines.size() - 10 << "コ\n";
+
+            log << '\n';
+        }
+    }
+
+    void printNoteAggregate(std::ostream & log, const MIDItoScore & toscore, const SongSettings & song) {
+        log << "--ノーツ内訳-----\n";
+        log << "lane |";
+        for (size_t lane = 0; lane < song.laneAllocation.size(); lane++) {
+            log << std::setfill(' ') << std::setw(4) << lane << '|';
+        }
+        log << '\n';
+        log << "hit  |";
+        for (auto i : song.laneAllocation) {
+            log << std::setfill(' ') << std::setw(4) << toscore.getNoteAggregate(i).hit << '|';
+        }
+        log << '\n';
+        log << "exhit|";
+        for (auto i : song.laneAllocation) {
+            log << std::setfill(' ') << std::setw(4) << toscore.getNoteAggregate(i).exhit << '|';
+        }
+        log << '\n';
+        log << "hold |";
+        for (auto i : song.laneAllocation) {
+            log << std::setfill(' ') << std::setw(4) << toscore.getNoteAggregate(i).hold << '|';
+        }
+        log << '\n';
+
+        size_t totalNoteCnt = 0;
+        log << "all  |";
+        for (auto i : song.laneAllocation) {
+            log << std::setfill(' ') << std::setw(4) << toscore.getNoteAggregate(i).total() << '|';
+            totalNoteCnt += toscore.getNoteAggregate(i).total();
+        }
+        log << '\n';
+        log << "total:" << totalNoteCnt << '\n';
+    }
+
+    void writeChartAnalyticsJson(std::ostream & stream, const std::vector<CompiledChart>& charts) {
+        stream << '{';
+        for (size_t i = 0; i < charts.size(); i++) {
+            stream << (i > 0 ? ",\n  \"" : "\n  \"") << charts[i].name << "\": ";
+            writeAnalyticsJson(stream, charts[i].analytics);
+        }
+        stream << "\n}";
+    }
+
+}
@@ -0,0 +1,126 @@
+﻿//
+// ScoreExporter
+// This module writes the score files of a song from the parsed midi file.
+// The layout of the output (track names, sections, header, file names) is given by OutputProfile at runtime,
+// so that one parse of the midi file can be shared by several profiles.
+//
+
+
+#ifndef _SCORE_EXPORTER_HPP_
+#define _SCORE_EXPORTER_HPP_
+
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <memory>
+#include <ostream>
+#include <filesystem>
+
+#include "MIDItoScore.hpp"
+#include "IncrementalScore.hpp"
+
+
+namespace miditoscore {
+
+    // a difficulty of the score
+    struct SectionProfile {
+        // name of the midi track which has the notes
+        std::string trackName;
+        // ex. "easy" for "begin:easy"
+        std::string sectionName;
+        // name printed to the log
+        std::string label;
+    };
+
+    struct OutputProfile {
+        std::string name;
+        std::vector<SectionProfile> sections;
+        std::optional<size_t> parallelsLimit;
+
+        // if true, the score is written to "<id>/score.txt" with the song information (title, chorus, ini file).
+        // otherwise, it is written to "<id><fileSuffix>.txt".
+        bool songDirectory;
+        std::string fileSuffix;
+
+        // additional header sections written after "begin:header"
+        std::string extraHeader;
+    };
+
+    OutputProfile buttonProfile();
+    OutputProfile wiiProfile();
+
+    // find the profile by name ("button" or "wii"). return false if there is no such profile.
+    bool findProfile(const std::string &name, OutputProfile &profile);
+
+
+    struct SongSettings {
+        std::string id;
+        math::Fraction holdMinLength;
+        std::vector<int> laneAllocation;
+
+        // used to print the interval in the log
+        bool intervalAsName;
+        midireader::PitchNotation pitchNotation;
+
+        double chorusBegSec;
+        double chorusEndSec;
+    };
+
+
+    // the state kept between the exports of the same song (ex. watch mode).
+    // the sections are converted incrementally, and the existing song directory is not removed.
+    struct ExportState {
+        std::vector<std::unique_ptr<IncrementalScore>> sections;
+    };
+
+
+    NoteFormat makeNoteFormat(const SongSettings &song, const OutputProfile &profile);
+
+    // path of the score file of the profile
+    std::filesystem::path scoreFilePath(const std::filesystem::path &outputDir, const SongSettings &song, const OutputProfile &profile);
+    std::filesystem::path binaryScoreFilePath(const std::filesystem::path &outputDir, const SongSettings &song, const OutputProfile &profile);
+
+    // write the header and all sections of the profile to the stream, and print the diagnostics to the log.
+    // if charts is not nullptr, the compiled charts for the binary score are added to it.
+    // if converter is not nullptr, it is used instead of a temporary one, so its buffers are reused.
+    int writeProfileScore(
+        std::ostream &score,
+        std::ostream &log,
+        const midireader::MIDIReader &midi,
+        const SongSettings &song,
+        const OutputProfile &profile,
+        std::vector<CompiledChart> *charts = nullptr,
+        ExportState *state = nullptr,
+        MIDItoScore *converter = nullptr
+    );
+
+    // create the output directory or files of the profile, and write the text and binary score.
+    // if charts is not nullptr, the compiled charts (with their analytics) are moved to it.
+    int exportProfile(
+        const std::filesystem::path &outputDir,
+        std::ostream &log,
+        const midireader::MIDIReader &midi,
+        const SongSettings &song,
+        const OutputProfile &profile,
+        ExportState *state = nullptr,
+        std::vector<CompiledChart> *charts = nullptr
+    );
+
+    // write the ini file in the song directory
+    bool writeIniFile(const std::filesystem::path &songDir, const std::filesystem::path &musicFile, const std::filesystem::path &jacketFile);
+
+    // print the result of reading the midi file.
+    // return false if the midi file cannot be converted.
+    bool printReadStatus(std::ostream &log, midireader::Status ret, const midireader::MIDIReader &midi);
+
+    // print the diagnostics of writeScore()
+    void printDiagnostics(std::ostream &log, int ret, const MIDItoScore &toscore, const NoteFormat &format, const SongSettings &song);
+    void printNoteAggregate(std::ostream &log, const MIDItoScore &toscore, const SongSettings &song);
+
+    // write the analytics of the charts as a json object keyed by the section name
+    void writeChartAnalyticsJson(std::ostream &stream, const std::vector<CompiledChart> &charts);
+
+}
+
+#endif // !_SCORE_EXPORTER_HPP_
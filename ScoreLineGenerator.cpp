@@ -0,0 +1,77 @@
+﻿#include "ScoreLineGenerator.hpp"
+
+
+namespace miditoscore {
+
+    ScoreLineGenerator::ScoreLineGenerator(MIDItoScore & owner, int ret, int beginBar, int endBar)
+        : owner(owner), ret(ret), endBar(endBar) {
+
+        seek(beginBar);
+    }
+
+    ScoreLineGenerator::~ScoreLineGenerator() {}
+
+    bool ScoreLineGenerator::next(ScoreLine & line) {
+        const auto& laneNotes = owner.scratch.laneNotes;
+        auto& scoreNotes = owner.scratch.scoreNotes;
+
+        while (currentBar <= endBar) {
+            for (; currentLane < laneNotes.size(); currentLane++) {
+                const size_t lane = currentLane;
+                auto& beginIt = laneIterators[lane];
+
+                // calculate range of current bar
+                const auto endIt = owner.barEnd(lane, currentBar, beginIt);
+
+                bool started = holdStarted[lane];
+                owner.collectScoreNotes(owner.noteFormat, lane, currentBar, beginIt, endIt, started, scoreNotes, nullptr);
+                holdStarted[lane] = started;
+
+                // ready for next bar
+                beginIt = endIt;
+
+                if (scoreNotes.size() > 0) {
+                    ret |= owner.createScoreLine(owner.noteFormat, lane, currentBar, scoreNotes, line.line);
+                    line.lane = lane;
+                    line.bar = currentBar;
+
+                    currentLane++;
+                    return true;
+                }
+            }
+
+            // check loop condition
+            size_t numofEndedLanes = 0;
+            for (size_t lane = 0; lane < laneNotes.size(); lane++) {
+                if (laneIterators[lane] == laneNotes[lane].cend()) numofEndedLanes++;
+            }
+            if (numofEndedLanes == laneNotes.size()) {
+                break;
+            }
+
+            currentLane = 0;
+            currentBar++;
+        }
+
+        return false;
+    }
+
+    void ScoreLineGenerator::seek(int bar) {
+        const auto& laneNotes = owner.scratch.laneNotes;
+
+        currentBar = bar;
+        currentLane = 0;
+        laneIterators.resize(laneNotes.size());
+        holdStarted.resize(laneNotes.size());
+
+        for (size_t lane = 0; lane < laneNotes.size(); lane++) {
+            const auto it = laneNotes[lane].cbegin() + owner.scratch.laneBarIndex[lane].first(bar);
+
+            laneIterators[lane] = it;
+
+            // a hold note which begins before the bar and ends after it
+            holdStarted[lane] = (it != laneNotes[lane].cbegin() && owner.isHoldNote(owner.noteFormat, lane, it - 1));
+        }
+    }
+
+}
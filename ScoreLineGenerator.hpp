@@ -0,0 +1,69 @@
+﻿//
+// ScoreLineGenerator
+// This class yields the score lines one by one on demand, instead of writing the whole score to a stream.
+// The lines are formatted only when next() is called, so the caller can read a part of the score cheaply.
+//
+// --- example -----------------------------
+// auto generator = midiToScore.generateScore(format, notes, 10, 20);
+// miditoscore::ScoreLine line;
+// while (generator.next(line)) {
+//     // line.lane, line.bar, line.line
+// }
+// ------------------------------------------
+//
+
+
+#ifndef _SCORE_LINE_GENERATOR_HPP_
+#define _SCORE_LINE_GENERATOR_HPP_
+
+
+#include <string>
+#include <vector>
+
+#include "MIDItoScore.hpp"
+
+
+namespace miditoscore {
+
+    struct ScoreLine {
+        size_t lane;
+        int bar;
+        // express the note position and the note type (kk... in the score format)
+        std::string line;
+    };
+
+
+    class ScoreLineGenerator {
+        friend class MIDItoScore;
+
+        using noteevent_const_itr_t = std::vector<midireader::NoteEvent>::const_iterator;
+
+    public:
+        ~ScoreLineGenerator();
+
+        // get the next line. return false if there are no more lines in the range.
+        bool next(ScoreLine &line);
+
+        // restart from the bar. it costs constant time per lane by the bar index.
+        void seek(int bar);
+
+        // the status of the preparation and the lines generated so far
+        int status() const { return ret; }
+
+    private:
+        ScoreLineGenerator(MIDItoScore &owner, int ret, int beginBar, int endBar);
+
+        MIDItoScore &owner;
+        int ret;
+        int endBar;
+
+        int currentBar;
+        size_t currentLane;
+        std::vector<noteevent_const_itr_t> laneIterators;
+        std::vector<bool> holdStarted;
+
+    };
+
+}
+
+#endif // !_SCORE_LINE_GENERATOR_HPP_
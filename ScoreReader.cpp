@@ -0,0 +1,270 @@
+﻿#include "ScoreReader.hpp"
+
+#include <cstring>
+#include <cstdint>
+#include <charconv>
+
+
+namespace miditoscore {
+
+    namespace {
+
+        bool startsWith(const char *first, const char *last, const char *prefix) {
+            const size_t length = std::strlen(prefix);
+            return static_cast<size_t>(last - first) >= length && std::memcmp(first, prefix, length) == 0;
+        }
+
+        const char *findChar(const char *first, const char *last, char ch) {
+            const void *p = std::memchr(first, ch, static_cast<size_t>(last - first));
+            return p ? static_cast<const char*>(p) : last;
+        }
+
+        // skip '0' characters 8 bytes at a time
+        const char *skipZero(const char *first, const char *last) {
+            constexpr uint64_t zeros = 0x3030303030303030ull;
+
+            while (last - first >= 8) {
+                uint64_t word;
+                std::memcpy(&word, first, 8);
+                if (word != zeros)
+                    break;
+                first += 8;
+            }
+
+            while (first != last && *first == '0') first++;
+
+            return first;
+        }
+
+        template<class T>
+        bool parseNumber(const char *&first, const char *last, T &value) {
+            const auto result = std::from_chars(first, last, value);
+            if (result.ec != std::errc())
+                return false;
+
+            first = result.ptr;
+            return true;
+        }
+
+        bool parseFraction(const char *&first, const char *last, math::Fraction &frac) {
+            int numer, denom;
+            if (!parseNumber(first, last, numer))
+                return false;
+            if (first == last || *first != '/')
+                return false;
+            first++;
+            if (!parseNumber(first, last, denom) || denom == 0)
+                return false;
+
+            frac.set(numer, denom);
+            return true;
+        }
+
+        bool expect(const char *&first, const char *last, char ch) {
+            if (first == last || *first != ch)
+                return false;
+
+            first++;
+            return true;
+        }
+
+    }
+
+
+    ScoreReader::ScoreReader() : errorLine(0) {}
+
+    ScoreReader::~ScoreReader() {}
+
+    bool ScoreReader::open(const std::string & fileName) {
+        clear();
+
+        if (!file.open(fileName))
+            return false;
+
+        const bool ret = read(file.data(), file.size());
+
+        file.close();
+
+        return ret;
+    }
+
+    bool ScoreReader::read(const char * data, size_t size) {
+        clear();
+
+        const char *p = data;
+        const char *end = data + size;
+
+        // skip BOM
+        if (size >= 3 && std::memcmp(p, "\xEF\xBB\xBF", 3) == 0)
+            p += 3;
+
+        ScoreSection *section = nullptr;
+        bool inHeader = false;
+        size_t lineNumber = 0;
+
+        while (p < end) {
+            const char *lineEnd = findChar(p, end, '\n');
+            const char *next = (lineEnd == end) ? end : lineEnd + 1;
+            if (lineEnd != p && *(lineEnd - 1) == '\r') lineEnd--;
+
+            lineNumber++;
+
+            bool ok = true;
+            if (p == lineEnd) {
+                // empty line
+            } else if (startsWith(p, lineEnd, "begin:")) {
+                std::string name(p + 6, lineEnd);
+
+                if (name.compare(0, 6, "header") == 0) {
+                    inHeader = true;
+                    section = nullptr;
+                } else {
+                    inHeader = false;
+                    sections.push_back({ name, {} });
+                    section = &sections.back();
+                }
+            } else if (lineEnd - p == 3 && std::memcmp(p, "end", 3) == 0) {
+                inHeader = false;
+                section = nullptr;
+            } else if (inHeader) {
+                ok = readHeaderLine(p, lineEnd);
+            } else if (section) {
+                ok = readNoteLine(p, lineEnd, *section);
+            } else {
+                ok = false;
+            }
+
+            if (!ok) {
+                errorLine = lineNumber;
+                return false;
+            }
+
+            p = next;
+        }
+
+        return true;
+    }
+
+    void ScoreReader::clear() {
+        header.clear();
+        tempo.clear();
+        beat.clear();
+        sections.clear();
+        errorLine = 0;
+    }
+
+    const ScoreSection * ScoreReader::findSection(const std::string & name) const {
+        for (const auto &s : sections) {
+            if (s.name == name)
+                return &s;
+        }
+
+        return nullptr;
+    }
+
+    bool ScoreReader::readHeaderLine(const char * first, const char * last) {
+        if (startsWith(first, last, "tempo:")) {
+            // ex. tempo:001:1/0:120.000
+            const char *p = first + 6;
+            ScoreTempo t;
+            if (!parseNumber(p, last, t.bar) || !expect(p, last, ':') ||
+                !parseFraction(p, last, t.posInBar) || !expect(p, last, ':') ||
+                !parseNumber(p, last, t.tempo) || p != last)
+                return false;
+
+            tempo.push_back(t);
+            return true;
+        }
+
+        if (startsWith(first, last, "beat:")) {
+            // ex. beat:001:4/4
+            const char *p = first + 5;
+            ScoreBeat b;
+            if (!parseNumber(p, last, b.bar) || !expect(p, last, ':') ||
+                !parseFraction(p, last, b.beat) || p != last)
+                return false;
+
+            beat.push_back(b);
+            return true;
+        }
+
+        const char *colon = findChar(first, last, ':');
+        if (colon == last)
+            return false;
+
+        header.emplace_back(std::string(first, colon), std::string(colon + 1, last));
+
+        return true;
+    }
+
+    bool ScoreReader::readNoteLine(const char * first, const char * last, ScoreSection & section) {
+        // ex. 0:020:0000100000000000
+        const char *p = first;
+        size_t lane;
+        int bar;
+
+        if (!parseNumber(p, last, lane) || !expect(p, last, ':') ||
+            !parseNumber(p, last, bar) || !expect(p, last, ':'))
+            return false;
+
+        if (p == last)
+            return false;
+
+        // the lane number is not trusted before the lanes are allocated
+        if (lane >= MaxLanes)
+            return false;
+
+        if (section.lanes.size() <= lane)
+            section.lanes.resize(lane + 1);
+
+        auto &notes = section.lanes[lane];
+
+        // sparse form. ex. 0:020:192:5=1,97=2
+        if (findChar(p, last, '=') != last) {
+            int denom;
+            if (!parseNumber(p, last, denom) || denom <= 0)
+                return false;
+
+            bool firstNote = true;
+            while (p != last) {
+                int offset, value;
+                if (!expect(p, last, firstNote ? ':' : ','))
+                    return false;
+                firstNote = false;
+
+                if (!parseNumber(p, last, offset) || !expect(p, last, '=') || !parseNumber(p, last, value))
+                    return false;
+                if (offset < 0 || offset >= denom || value < 0)
+                    return false;
+
+                math::Fraction pos(offset, denom);
+                pos.reduce();
+                if (pos == 0)
+                    pos.set(0);
+
+                notes.push_back({ bar, pos, static_cast<NoteType>(value & 0b111), value >> 3 });
+            }
+
+            return true;
+        }
+
+        const int length = static_cast<int>(last - p);
+
+        for (const char *it = skipZero(p, last); it != last; it = skipZero(it + 1, last)) {
+            // the channel 10 and above is written in the bytes over 0x7f, so they are read as unsigned
+            const int value = static_cast<unsigned char>(*it) - '0';
+            if (value < 0)
+                return false;
+
+            math::Fraction pos(static_cast<int>(it - p), length);
+            pos.reduce();
+            if (pos == 0)
+                pos.set(0);
+
+            notes.push_back({ bar, pos, static_cast<NoteType>(value & 0b111), value >> 3 });
+        }
+
+        return true;
+    }
+
+}
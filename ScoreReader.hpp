@@ -0,0 +1,98 @@
+﻿//
+// ScoreReader
+// This class reads the score file written by MIDItoScore (see the format in MIDItoScore.hpp).
+// The file is mapped into memory and all sections are parsed in one pass.
+//
+// --- score file ----------------
+// begin:header
+// id:1
+// tempo:001:0/1:120.000
+// beat:001:4/4
+// end
+//
+// begin:easy
+// 0:001:1000
+// end
+// -------------------------------
+//
+
+
+#ifndef _SCORE_READER_HPP_
+#define _SCORE_READER_HPP_
+
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "MIDItoScore.hpp"
+#include "MappedFile.hpp"
+
+
+namespace miditoscore {
+
+    struct ScoreTempo {
+        int bar;
+        math::Fraction posInBar;
+        float tempo;
+    };
+
+    struct ScoreBeat {
+        int bar;
+        math::Fraction beat;
+    };
+
+    struct ScoreReaderNote {
+        int bar;
+        math::Fraction posInBar;
+        NoteType type;
+        int channel;
+    };
+
+    struct ScoreSection {
+        std::string name;
+        // notes of each lane, sorted by position
+        std::vector<std::vector<ScoreReaderNote>> lanes;
+    };
+
+
+    class ScoreReader {
+    public:
+        // the lines whose lane is this or above are errors
+        static constexpr size_t MaxLanes = 64;
+
+        ScoreReader();
+        ~ScoreReader();
+
+        bool open(const std::string &fileName);
+        bool read(const char *data, size_t size);
+        void clear();
+
+        // key and value pairs in the header sections (ex. "id", "1")
+        const std::vector<std::pair<std::string, std::string>> &getHeader() const { return header; }
+        const std::vector<ScoreTempo> &getTempo() const { return tempo; }
+        const std::vector<ScoreBeat> &getBeat() const { return beat; }
+        const std::vector<ScoreSection> &getSections() const { return sections; }
+        // return nullptr if there is no section which has the name
+        const ScoreSection *findSection(const std::string &name) const;
+
+        // line number (1 origin) where the last error occurred. 0 if no error.
+        size_t getErrorLine() const { return errorLine; }
+
+    private:
+        fileio::MappedFile file;
+
+        std::vector<std::pair<std::string, std::string>> header;
+        std::vector<ScoreTempo> tempo;
+        std::vector<ScoreBeat> beat;
+        std::vector<ScoreSection> sections;
+        size_t errorLine;
+
+        bool readHeaderLine(const char *first, const char *last);
+        bool readNoteLine(const char *first, const char *last, ScoreSection &section);
+
+    };
+
+}
+
+#endif // !_SCORE_READER_HPP_
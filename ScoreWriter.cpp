@@ -0,0 +1,110 @@
+﻿#include "ScoreWriter.hpp"
+
+#include <iomanip>
+
+#include "Trace.hpp"
+
+
+namespace miditoscore {
+
+    namespace {
+
+        template<class T, size_t N>
+        void resizeLanes(std::array<T, N> &, size_t) {}
+
+        template<class T>
+        void resizeLanes(std::vector<T> &lanes, size_t size) {
+            lanes.resize(size);
+        }
+
+    }
+
+
+    template<size_t Lanes>
+    BasicScoreWriter<Lanes>::BasicScoreWriter(MIDItoScore & owner) : owner(owner) {}
+
+    template<size_t Lanes>
+    BasicScoreWriter<Lanes>::~BasicScoreWriter() {}
+
+    template<size_t Lanes>
+    int BasicScoreWriter<Lanes>::write(std::ostream & stream, const NoteFormat & format) {
+        using namespace midireader;
+
+        int ret = Status::S_OK;
+
+        const auto& laneNotes = owner.scratch.laneNotes;
+        auto& scoreNotes = owner.scratch.scoreNotes;
+        auto& scoreString = owner.scratch.scoreString;
+
+        const size_t numofLanes = (Lanes != 0) ? Lanes : laneNotes.size();
+
+        resizeLanes(beginIterators, numofLanes);
+        resizeLanes(endIterators, numofLanes);
+        resizeLanes(holdStarted, numofLanes);
+        resizeLanes(noteAggregate, numofLanes);
+
+        for (size_t i = 0; i < numofLanes; i++) {
+            beginIterators[i] = laneNotes[i].cbegin();
+            endIterators[i] = laneNotes[i].cbegin();
+            holdStarted[i] = false;
+            noteAggregate[i] = MIDItoScore::NoteAggregate();
+        }
+
+        size_t currentBar = 1;
+
+        while (true) {
+            TRACE_SCOPE_ARG("writeBar", "bar", currentBar);
+
+            for (size_t lane = 0; lane < numofLanes; lane++) {
+                auto& beginIt = beginIterators[lane];
+                auto& endIt = endIterators[lane];
+
+                // calculate range of current bar
+                endIt = owner.barEnd(lane, currentBar, beginIt);
+
+                // enumerate useable events to write score
+                bool started = holdStarted[lane];
+                owner.collectScoreNotes(format, lane, currentBar, beginIt, endIt, started, scoreNotes, &noteAggregate[lane]);
+                holdStarted[lane] = started;
+
+                if (scoreNotes.size() > 0) {
+                    ret |= owner.createScoreLine(format, lane, currentBar, scoreNotes, scoreString);
+
+                    // write the score data to file.
+                    using namespace std;
+                    stream << lane << ':'
+                        << setfill('0') << setw(3) << currentBar << ':'
+                        << scoreString << endl;
+                }
+
+                // ready for next bar
+                beginIt = endIt;
+            }
+
+            // check loop condition
+            size_t numofEndedLanes = 0;
+            for (size_t lane = 0; lane < numofLanes; lane++) {
+                if (beginIterators[lane] == laneNotes[lane].cend()) numofEndedLanes++;
+            }
+            if (numofEndedLanes == numofLanes) {
+                break;
+            }
+
+            currentBar++;
+        }
+
+        owner.noteAggregate.assign(noteAggregate.cbegin(), noteAggregate.cend());
+
+        return ret;
+    }
+
+
+
+    template class BasicScoreWriter<0>;
+    template class BasicScoreWriter<4>;
+    template class BasicScoreWriter<5>;
+    template class BasicScoreWriter<6>;
+    template class BasicScoreWriter<7>;
+    template class BasicScoreWriter<8>;
+
+}
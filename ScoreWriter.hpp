@@ -0,0 +1,61 @@
+﻿//
+// BasicScoreWriter
+// This class writes the score lines of the notes grouped by lane.
+// The state of each lane is held in std::array when the number of lanes is known at compile time,
+// and BasicScoreWriter<0> is the fallback which decides the number of lanes at runtime.
+//
+
+
+#ifndef _SCORE_WRITER_HPP_
+#define _SCORE_WRITER_HPP_
+
+
+#include <array>
+#include <vector>
+#include <ostream>
+
+#include "MIDItoScore.hpp"
+
+
+namespace miditoscore {
+
+    template<size_t Lanes, class T>
+    struct LaneArray {
+        using type = std::array<T, Lanes>;
+    };
+
+    template<class T>
+    struct LaneArray<0, T> {
+        using type = std::vector<T>;
+    };
+
+
+    template<size_t Lanes>
+    class BasicScoreWriter {
+        template<class T>
+        using lane_array_t = typename LaneArray<Lanes, T>::type;
+
+        using noteevent_const_itr_t = std::vector<midireader::NoteEvent>::const_iterator;
+
+    public:
+        BasicScoreWriter(MIDItoScore &owner);
+        ~BasicScoreWriter();
+
+        // write the notes grouped in the scratch of owner.
+        // the number of lanes must be equal to Lanes, if Lanes is not 0.
+        int write(std::ostream &stream, const NoteFormat &format);
+
+    private:
+        MIDItoScore &owner;
+
+        lane_array_t<noteevent_const_itr_t> beginIterators;
+        lane_array_t<noteevent_const_itr_t> endIterators;
+        lane_array_t<bool> holdStarted;
+        lane_array_t<MIDItoScore::NoteAggregate> noteAggregate;
+
+    };
+
+
+}
+
+#endif // !_SCORE_WRITER_HPP_
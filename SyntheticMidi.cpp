@@ -0,0 +1,211 @@
+﻿#include "SyntheticMidi.hpp"
+
+#include <random>
+#include <algorithm>
+
+
+namespace midireader {
+
+    namespace {
+
+        struct Event {
+            long time;
+            // the order of the events at the same time (meta event, note off, note on)
+            int priority;
+            std::string bytes;
+        };
+
+        struct TimeSignature {
+            int numer;
+            // power of 2
+            int denomPower;
+        };
+
+        void writeBigEndian(std::string &out, uint32_t value, int bytes) {
+            for (int i = bytes - 1; i >= 0; i--) {
+                out += static_cast<char>((value >> (8 * i)) & 0xff);
+            }
+        }
+
+        void writeVariableLenNumber(std::string &out, uint32_t value) {
+            char buffer[5];
+            int length = 0;
+
+            buffer[length++] = static_cast<char>(value & 0x7f);
+            while (value >>= 7) {
+                buffer[length++] = static_cast<char>((value & 0x7f) | 0x80);
+            }
+
+            while (length > 0) {
+                out += buffer[--length];
+            }
+        }
+
+        std::string metaEvent(unsigned char type, const std::string &data) {
+            std::string bytes;
+            bytes += static_cast<char>(0xff);
+            bytes += static_cast<char>(type);
+            writeVariableLenNumber(bytes, static_cast<uint32_t>(data.size()));
+            bytes += data;
+
+            return bytes;
+        }
+
+        std::string makeTrack(std::vector<Event> &events, bool runningStatus) {
+            std::stable_sort(
+                events.begin(),
+                events.end(),
+                [](const Event &a, const Event &b) { return a.time != b.time ? a.time < b.time : a.priority < b.priority; }
+            );
+
+            std::string data;
+            long lastTime = 0;
+            unsigned char lastStatus = 0;
+
+            for (const auto &e : events) {
+                writeVariableLenNumber(data, static_cast<uint32_t>(e.time - lastTime));
+                lastTime = e.time;
+
+                const unsigned char status = static_cast<unsigned char>(e.bytes[0]);
+                if (runningStatus && status < 0xf0 && status == lastStatus)
+                    data.append(e.bytes, 1, std::string::npos);
+                else
+                    data += e.bytes;
+
+                lastStatus = status < 0xf0 ? status : 0;
+            }
+
+            // end of track
+            writeVariableLenNumber(data, 0);
+            data += metaEvent(0x2f, std::string());
+
+            std::string track = "MTrk";
+            writeBigEndian(track, static_cast<uint32_t>(data.size()), 4);
+            track += data;
+
+            return track;
+        }
+
+    }
+
+
+    std::string generateSyntheticMidi(const SyntheticMidiOptions & options) {
+        std::mt19937 random(options.seed);
+        auto uniform = [&](int min, int max) {
+            return std::uniform_int_distribution<int>(min, max)(random);
+        };
+
+        const int numofBars = std::max(options.numofBars, 1);
+        const int resolution = std::max(options.resolution, 1);
+
+        // the bars where the time signature and tempo are changed
+        auto changedBars = [&](int count) {
+            std::vector<int> bars;
+            for (int bar = 2; bar <= numofBars; bar++) {
+                bars.push_back(bar);
+            }
+            std::shuffle(bars.begin(), bars.end(), random);
+            bars.resize(std::min<size_t>(bars.size(), std::max(count, 0)));
+            std::sort(bars.begin(), bars.end());
+
+            return bars;
+        };
+
+        const TimeSignature signatures[] = { { 4, 2 }, { 3, 2 }, { 6, 3 }, { 7, 3 }, { 5, 2 } };
+
+        std::vector<TimeSignature> barSignature(numofBars + 1, signatures[0]);
+        for (int bar : changedBars(options.numofTimeSignatureChanges)) {
+            const auto signature = signatures[uniform(0, 4)];
+            std::fill(barSignature.begin() + bar, barSignature.end(), signature);
+        }
+
+        // the first tick of each bar
+        std::vector<long> barStart(numofBars + 2, 0);
+        for (int bar = 1; bar <= numofBars; bar++) {
+            const auto &s = barSignature[bar];
+            barStart[bar + 1] = barStart[bar] + 4L * resolution * s.numer / (1 << s.denomPower);
+        }
+
+        // conductor track
+        std::vector<Event> conductor;
+        conductor.push_back({ 0, 0, metaEvent(0x03, "Synthetic") });
+
+        for (int bar = 1; bar <= numofBars; bar++) {
+            const auto &s = barSignature[bar];
+            if (bar > 1 && s.numer == barSignature[bar - 1].numer && s.denomPower == barSignature[bar - 1].denomPower)
+                continue;
+
+            std::string data;
+            data += static_cast<char>(s.numer);
+            data += static_cast<char>(s.denomPower);
+            data += static_cast<char>(24);
+            data += static_cast<char>(8);
+            conductor.push_back({ barStart[bar], 0, metaEvent(0x58, data) });
+        }
+
+        auto tempoEvent = [&](long time, int bpm) {
+            std::string data;
+            writeBigEndian(data, static_cast<uint32_t>(60'000'000 / bpm), 3);
+            return Event{ time, 0, metaEvent(0x51, data) };
+        };
+        conductor.push_back(tempoEvent(0, 120));
+        for (int bar : changedBars(options.numofTempoChanges)) {
+            conductor.push_back(tempoEvent(barStart[bar], uniform(90, 200)));
+        }
+
+        std::vector<std::string> tracks;
+        tracks.push_back(makeTrack(conductor, options.runningStatus));
+
+        // note tracks
+        const std::vector<int> intervals = options.intervals.empty() ? std::vector<int>{ 60 } : options.intervals;
+        const int notesPerBar = std::max(options.notesPerBar, 0);
+
+        for (int t = 1; t <= options.numofTracks; t++) {
+            std::vector<Event> events;
+            events.push_back({ 0, 0, metaEvent(0x03, std::to_string(t)) });
+
+            for (int bar = 1; bar <= numofBars; bar++) {
+                const long length = barStart[bar + 1] - barStart[bar];
+
+                for (int i = 0; i < notesPerBar; i++) {
+                    const long spacing = std::max(length / notesPerBar, 1L);
+                    long time = barStart[bar] + length * i / notesPerBar;
+                    if (options.jitter > 0)
+                        time = std::max(time + uniform(-options.jitter, options.jitter), 0L);
+
+                    const int interval = intervals[uniform(0, static_cast<int>(intervals.size()) - 1)];
+                    const int velocity = uniform(0, 3) == 0 ? 115 : 100;
+                    const long duration = uniform(0, 7) == 0 ? spacing * 2 : std::max(spacing / 2, 1L);
+
+                    std::string noteOn;
+                    noteOn += static_cast<char>(0x90);
+                    noteOn += static_cast<char>(interval);
+                    noteOn += static_cast<char>(velocity);
+                    events.push_back({ time, 2, noteOn });
+
+                    std::string noteOff;
+                    noteOff += static_cast<char>(options.runningStatus ? 0x90 : 0x80);
+                    noteOff += static_cast<char>(interval);
+                    noteOff += static_cast<char>(options.runningStatus ? 0 : 64);
+                    events.push_back({ time + duration, 1, noteOff });
+                }
+            }
+
+            tracks.push_back(makeTrack(events, options.runningStatus));
+        }
+
+        // header
+        std::string midi = "MThd";
+        writeBigEndian(midi, 6, 4);
+        writeBigEndian(midi, 1, 2);
+        writeBigEndian(midi, static_cast<uint32_t>(tracks.size()), 2);
+        writeBigEndian(midi, static_cast<uint32_t>(resolution), 2);
+
+        for (const auto &track : tracks) {
+            midi += track;
+        }
+
+        return midi;
+    }
+
+}
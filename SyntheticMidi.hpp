@@ -0,0 +1,46 @@
+﻿//
+// SyntheticMidi
+// This module generates a standard midi file for the benchmarks.
+// The first track has the title, time signatures and tempos, and the following tracks named "1", "2", ... have the notes.
+// The same options and seed always generate the same file.
+//
+
+
+#ifndef _SYNTHETIC_MIDI_HPP_
+#define _SYNTHETIC_MIDI_HPP_
+
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+namespace midireader {
+
+    struct SyntheticMidiOptions {
+        int numofTracks = 3;
+        int numofBars = 64;
+        // notes of each track in a bar
+        int notesPerBar = 8;
+        int resolution = 480;
+
+        // the time signature and tempo are changed at random bars
+        int numofTimeSignatureChanges = 0;
+        int numofTempoChanges = 0;
+
+        // the timing of each note is shifted randomly in [-jitter, +jitter] ticks, like a recorded performance
+        int jitter = 0;
+
+        // omit the repeated status bytes. note off is written as note on with velocity 0.
+        bool runningStatus = false;
+
+        std::vector<int> intervals = { 60, 62, 64, 65 };
+        uint32_t seed = 1;
+    };
+
+    // return the bytes of the midi file
+    std::string generateSyntheticMidi(const SyntheticMidiOptions &options);
+
+}
+
+#endif // !_SYNTHETIC_MIDI_HPP_
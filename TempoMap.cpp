@@ -0,0 +1,66 @@
+﻿#include "TempoMap.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+
+namespace midireader {
+
+    namespace {
+
+        constexpr int64_t DefaultTempo = 500000; // 120 BPM
+
+        int64_t toMicrosecondsPerQuarter(float bpm) {
+            if (bpm <= 0)
+                return DefaultTempo;
+
+            return std::llround(60.0 * 1e6 / bpm);
+        }
+
+    }
+
+
+    TempoMap::TempoMap() : resolutionUnit(480) {}
+
+    TempoMap::TempoMap(const std::vector<TempoEvent>& tempoEvent, int resolutionUnit) : TempoMap() {
+        build(tempoEvent, resolutionUnit);
+    }
+
+    TempoMap::~TempoMap() {}
+
+    void TempoMap::build(const std::vector<TempoEvent>& tempoEvent, int resolutionUnit) {
+        this->resolutionUnit = (resolutionUnit > 0) ? resolutionUnit : 480;
+
+        // tempo events in format 1 may be in different tracks
+        std::vector<TempoEvent> sorted(tempoEvent);
+        std::stable_sort(sorted.begin(), sorted.end(), [](const TempoEvent &a, const TempoEvent &b) { return a.time < b.time; });
+
+        segments.clear();
+        segments.push_back({ 0, 0, DefaultTempo });
+
+        for (const auto &e : sorted) {
+            const auto &prev = segments.back();
+            const int64_t microseconds = prev.microseconds + (e.time - prev.time) * prev.tempo / this->resolutionUnit;
+
+            if (e.time == prev.time)
+                segments.back().tempo = toMicrosecondsPerQuarter(e.tempo);
+            else
+                segments.push_back({ e.time, microseconds, toMicrosecondsPerQuarter(e.tempo) });
+        }
+    }
+
+    int64_t TempoMap::toMicroseconds(tick_t midiTime) const {
+        // find the last segment which begins at or before midiTime
+        auto it = std::upper_bound(
+            segments.cbegin(),
+            segments.cend(),
+            midiTime,
+            [](tick_t time, const Segment &s) { return time < s.time; }
+        );
+        if (it != segments.cbegin())
+            it--;
+
+        return it->microseconds + (midiTime - it->time) * it->tempo / resolutionUnit;
+    }
+
+}
@@ -0,0 +1,46 @@
+﻿//
+// TempoMap
+// This class converts the midi time (tick) to the real time by the tempo events.
+//
+
+
+#ifndef _TEMPO_MAP_HPP_
+#define _TEMPO_MAP_HPP_
+
+
+#include <vector>
+#include <cstdint>
+
+#include "MIDIReader.hpp"
+
+
+namespace midireader {
+
+    class TempoMap {
+    public:
+        TempoMap();
+        TempoMap(const std::vector<TempoEvent> &tempoEvent, int resolutionUnit);
+        ~TempoMap();
+
+        // notice: 120 BPM is used before the first tempo event
+        void build(const std::vector<TempoEvent> &tempoEvent, int resolutionUnit);
+
+        int64_t toMicroseconds(tick_t midiTime) const;
+        double toSeconds(tick_t midiTime) const { return toMicroseconds(midiTime) * 1e-6; }
+
+    private:
+        struct Segment {
+            tick_t time;
+            int64_t microseconds;
+            // microseconds per quarter note
+            int64_t tempo;
+        };
+
+        std::vector<Segment> segments;
+        int resolutionUnit;
+
+    };
+
+}
+
+#endif // !_TEMPO_MAP_HPP_
@@ -0,0 +1,180 @@
+﻿#include "Trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace trace {
+
+    namespace {
+
+        struct ThreadBuffer {
+            uint32_t id = 0;
+            // guarded by the mutex of the registry
+            std::string name;
+
+            std::unique_ptr<Span[]> spans;
+            // written by the owner thread only, and read by writeChromeTrace()
+            std::atomic<size_t> size{ 0 };
+            std::atomic<size_t> dropped{ 0 };
+        };
+
+        // the buffers are kept after the threads finished, until the process ends
+        struct Registry {
+            std::mutex mutex;
+            std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+        };
+
+        Registry & registry() {
+            static Registry r;
+            return r;
+        }
+
+        std::atomic<bool> enabledFlag(false);
+
+        const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+        ThreadBuffer & threadBuffer() {
+            thread_local std::shared_ptr<ThreadBuffer> buffer = []() {
+                auto b = std::make_shared<ThreadBuffer>();
+                b->spans.reset(new Span[BufferCapacity]);
+
+                auto &r = registry();
+                std::lock_guard<std::mutex> lock(r.mutex);
+                b->id = static_cast<uint32_t>(r.buffers.size() + 1);
+                r.buffers.push_back(b);
+
+                return b;
+            }();
+
+            return *buffer;
+        }
+
+        void writeString(std::ostream &stream, const char *str) {
+            stream << '"';
+            for (; *str; str++) {
+                if (*str == '"' || *str == '\\')
+                    stream << '\\';
+                if (static_cast<unsigned char>(*str) >= 0x20)
+                    stream << *str;
+            }
+            stream << '"';
+        }
+
+    }
+
+
+    bool isEnabled() {
+        return enabledFlag.load(std::memory_order_relaxed);
+    }
+
+    void enable(bool enabled) {
+        enabledFlag.store(enabled, std::memory_order_relaxed);
+    }
+
+    int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void record(const char * name, const char * argName, int64_t arg, int64_t begin, int64_t end) {
+        auto &buffer = threadBuffer();
+
+        const size_t n = buffer.size.load(std::memory_order_relaxed);
+        if (n >= BufferCapacity) {
+            buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        buffer.spans[n] = Span{ name, argName, arg, begin, end - begin };
+        // publish the span to writeChromeTrace()
+        buffer.size.store(n + 1, std::memory_order_release);
+    }
+
+    void setThreadName(const char * name) {
+        auto &buffer = threadBuffer();
+
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        buffer.name = name;
+    }
+
+    void writeChromeTrace(std::ostream & stream) {
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+        std::vector<std::string> names;
+        {
+            auto &r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            buffers = r.buffers;
+            for (const auto &b : buffers) {
+                names.push_back(b->name.empty() ? "thread " + std::to_string(b->id) : b->name);
+            }
+        }
+
+        const auto flags = stream.flags();
+        const auto precision = stream.precision();
+        stream << std::fixed << std::setprecision(3);
+
+        stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+        bool first = true;
+        auto separator = [&]() {
+            if (!first)
+                stream << ",\n";
+            first = false;
+        };
+
+        for (size_t i = 0; i < buffers.size(); i++) {
+            const auto &b = *buffers[i];
+
+            separator();
+            stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b.id << ",\"args\":{\"name\":";
+            writeString(stream, names[i].c_str());
+            stream << "}}";
+
+            const size_t size = b.size.load(std::memory_order_acquire);
+            for (size_t j = 0; j < size; j++) {
+                const auto &span = b.spans[j];
+
+                separator();
+                stream << "{\"name\":";
+                writeString(stream, span.name);
+                stream << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << b.id
+                    << ",\"ts\":" << span.begin / 1000.0
+                    << ",\"dur\":" << span.duration / 1000.0;
+                if (span.argName) {
+                    stream << ",\"args\":{";
+                    writeString(stream, span.argName);
+                    stream << ':' << span.arg << '}';
+                }
+                stream << '}';
+            }
+
+            const size_t dropped = b.dropped.load(std::memory_order_relaxed);
+            if (dropped > 0) {
+                separator();
+                stream << "{\"name\":\"dropped spans\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << b.id
+                    << ",\"ts\":" << (size > 0 ? b.spans[size - 1].begin / 1000.0 : 0.0)
+                    << ",\"args\":{\"count\":" << dropped << "}}";
+            }
+        }
+
+        stream << "\n]}\n";
+
+        stream.flags(flags);
+        stream.precision(precision);
+    }
+
+    void clear() {
+        auto &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (auto &b : r.buffers) {
+            b->size.store(0, std::memory_order_relaxed);
+            b->dropped.store(0, std::memory_order_relaxed);
+        }
+    }
+
+}
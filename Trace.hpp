@@ -0,0 +1,102 @@
+﻿//
+// Trace
+// Scoped spans of the conversion, exported as Chrome trace JSON (chrome://tracing, Perfetto).
+// The spans are compiled only when MIDITOSCORE_ENABLE_TRACE is defined,
+// and recorded only between trace::enable(true) and trace::enable(false).
+// Each thread appends the spans to its own buffer without any lock.
+//
+// --- example -----------------------------
+// void MIDIReader::readTrack(int trackNum) {
+//     TRACE_SCOPE_ARG("readTrack", "track", trackNum);
+//     ...
+// }
+//
+// trace::enable(true);
+// convert();
+// trace::enable(false);
+// trace::writeChromeTrace(file);
+// ------------------------------------------
+//
+
+
+#ifndef _TRACE_HPP_
+#define _TRACE_HPP_
+
+
+#include <cstdint>
+#include <ostream>
+
+
+namespace trace {
+
+    struct Span {
+        // string literal
+        const char *name;
+        // optional argument of the span. argName is nullptr if the span has no argument.
+        const char *argName;
+        int64_t arg;
+        // nanoseconds from the start of the process
+        int64_t begin;
+        int64_t duration;
+    };
+
+    // the spans of a thread are kept up to this number, and the later spans are dropped
+    constexpr size_t BufferCapacity = 1 << 16;
+
+    bool isEnabled();
+    void enable(bool enabled);
+
+    // nanoseconds from the start of the process
+    int64_t now();
+
+    // append the span to the buffer of the calling thread
+    void record(const char *name, const char *argName, int64_t arg, int64_t begin, int64_t end);
+
+    // name of the calling thread shown in the viewer
+    void setThreadName(const char *name);
+
+    // write the spans of all threads, including the finished threads.
+    // the spans which are being recorded at the same time may be omitted.
+    void writeChromeTrace(std::ostream &stream);
+
+    // discard the recorded spans. this must not be called while the spans are recorded.
+    void clear();
+
+
+    class Scope {
+    public:
+        Scope(const char *name, const char *argName = nullptr, int64_t arg = 0)
+            : name(name), argName(argName), arg(arg), begin(isEnabled() ? now() : -1) {}
+
+        ~Scope() {
+            if (begin >= 0)
+                record(name, argName, arg, begin, now());
+        }
+
+        Scope(const Scope&) = delete;
+        Scope &operator=(const Scope&) = delete;
+
+    private:
+        const char *name;
+        const char *argName;
+        int64_t arg;
+        int64_t begin;
+    };
+
+}
+
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+#ifdef MIDITOSCORE_ENABLE_TRACE
+#define TRACE_SCOPE(name) ::trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#define TRACE_SCOPE_ARG(name, argName, arg) ::trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(name, argName, static_cast<int64_t>(arg))
+#define TRACE_THREAD_NAME(name) ::trace::setThreadName(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_ARG(name, argName, arg) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+#endif // !_TRACE_HPP_
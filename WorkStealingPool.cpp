@@ -0,0 +1,95 @@
+﻿#include "WorkStealingPool.hpp"
+
+#include <thread>
+#include <algorithm>
+#include <string>
+
+#include "Trace.hpp"
+
+
+namespace miditoscore {
+
+    WorkStealingPool::WorkStealingPool(size_t numofThreads)
+        : numofThreads(numofThreads) {
+
+        if (this->numofThreads == 0) {
+            this->numofThreads = std::max(1u, std::thread::hardware_concurrency());
+        }
+    }
+
+    WorkStealingPool::~WorkStealingPool() {}
+
+    void WorkStealingPool::run(std::vector<Task> tasks) {
+        if (tasks.empty())
+            return;
+
+        const size_t numofWorkers = std::min(numofThreads, tasks.size());
+
+        workers.clear();
+        for (size_t i = 0; i < numofWorkers; i++) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+
+        // deal the tasks in round robin
+        for (size_t i = 0; i < tasks.size(); i++) {
+            workers[i % numofWorkers]->tasks.push_back(std::move(tasks[i]));
+        }
+
+        // the calling thread works as the first worker
+        std::vector<std::thread> threads;
+        for (size_t id = 1; id < numofWorkers; id++) {
+            threads.emplace_back(&WorkStealingPool::work, this, id);
+        }
+        work(0);
+
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        workers.clear();
+    }
+
+    bool WorkStealingPool::pop(size_t id, Task & task) {
+        auto &worker = *workers[id];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+
+        if (worker.tasks.empty())
+            return false;
+
+        task = std::move(worker.tasks.front());
+        worker.tasks.pop_front();
+
+        return true;
+    }
+
+    bool WorkStealingPool::steal(size_t id, Task & task) {
+        for (size_t i = 1; i < workers.size(); i++) {
+            auto &victim = *workers[(id + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+
+            if (victim.tasks.empty())
+                continue;
+
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+
+            return true;
+        }
+
+        return false;
+    }
+
+    void WorkStealingPool::work(size_t id) {
+        // the first worker is the calling thread, which keeps its name
+        if (id > 0)
+            TRACE_THREAD_NAME(("worker " + std::to_string(id)).c_str());
+
+        Task task;
+
+        // no task is added while running, so the worker can quit when all queues are empty
+        while (pop(id, task) || steal(id, task)) {
+            task();
+        }
+    }
+
+}
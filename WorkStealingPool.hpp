@@ -0,0 +1,57 @@
+﻿//
+// WorkStealingPool
+// This class runs a set of tasks on several threads.
+// Each worker has its own queue, and an idle worker steals the tasks from the back of the other queues,
+// so that the threads are kept busy even if the costs of the tasks are uneven.
+//
+
+
+#ifndef _WORK_STEALING_POOL_HPP_
+#define _WORK_STEALING_POOL_HPP_
+
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+namespace miditoscore {
+
+    class WorkStealingPool {
+    public:
+        using Task = std::function<void()>;
+
+        // if numofThreads is 0, the number of hardware threads is used
+        explicit WorkStealingPool(size_t numofThreads = 0);
+        ~WorkStealingPool();
+
+        size_t size() const { return numofThreads; }
+
+        // run all tasks and wait for them.
+        // the tasks are dealt to the workers in order, so pass the heavier tasks first.
+        // notice: the tasks must not throw
+        void run(std::vector<Task> tasks);
+
+    private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        // take the task from the front of own queue
+        bool pop(size_t id, Task &task);
+        // take the task from the back of the other queues
+        bool steal(size_t id, Task &task);
+
+        void work(size_t id);
+
+        size_t numofThreads;
+        std::vector<std::unique_ptr<Worker>> workers;
+
+    };
+
+}
+
+#endif // !_WORK_STEALING_POOL_HPP_
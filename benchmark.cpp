@@ -0,0 +1,346 @@
+﻿#include "MIDItoScore.hpp"
+#include "SyntheticMidi.hpp"
+#include "MergedNoteView.hpp"
+#include "AllocationCounter.hpp"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+// microbenchmark of each stage of the conversion, on the synthetic midi files.
+// build this file with the sources except createScore.cpp, corpusBench.cpp and regressionTest.cpp.
+// the allocations are counted when MIDITOSCORE_COUNT_ALLOCATIONS is defined.
+//
+// usage: benchmark [--scenario <name>] [--min-time <sec>] [--alloc-check]
+// --alloc-check fails if any stage allocates after the warm up.
+
+
+namespace midireader {
+
+    struct ReaderBenchmark {
+        // read the header and tracks without quantizing the notes
+        static Status readTracks(MIDIReader &reader, const std::string &midi) {
+            reader.close();
+            reader.memoryBuffer.assign(midi.data(), midi.size());
+            reader.memoryStream.clear();
+            reader.input = &reader.memoryStream;
+
+            Status ret = reader.readHeader();
+            if (Success(ret)) {
+                reader.resizeTracks(reader.header.numofTrack);
+                for (int i = 1; i < reader.header.numofTrack + 1; i++) {
+                    if (Failed(ret = reader.readTrack(i)))
+                        break;
+                }
+            }
+
+            reader.memoryBuffer.assign(nullptr, 0);
+            reader.input = &reader.midi;
+
+            return ret;
+        }
+
+        static long calcScoreTime(MIDIReader &reader) {
+            long sum = 0;
+            for (const auto &events : reader.noteEvent) {
+                for (const auto &e : events) {
+                    sum += reader.calcScoreTime(e.time).bar;
+                }
+            }
+
+            return sum;
+        }
+
+        static long calcBestScoreTime(MIDIReader &reader, size_t threshold) {
+            long sum = 0;
+            for (const auto &events : reader.noteEvent) {
+                for (const auto &e : events) {
+                    tick_t time = e.time;
+                    sum += reader.calcBestScoreTime(time, threshold).bar;
+                }
+            }
+
+            return sum;
+        }
+    };
+
+}
+
+
+// discard the output of writeScore
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+};
+
+
+struct Scenario {
+    const char *name;
+    midireader::SyntheticMidiOptions options;
+};
+
+std::vector<Scenario> makeScenarios() {
+    std::vector<Scenario> scenarios;
+
+    midireader::SyntheticMidiOptions basic;
+    scenarios.push_back({ "basic", basic });
+
+    midireader::SyntheticMidiOptions dense;
+    dense.numofTracks = 4;
+    dense.numofBars = 256;
+    dense.notesPerBar = 32;
+    scenarios.push_back({ "dense", dense });
+
+    midireader::SyntheticMidiOptions changes;
+    changes.numofBars = 128;
+    changes.numofTimeSignatureChanges = 16;
+    changes.numofTempoChanges = 16;
+    scenarios.push_back({ "changes", changes });
+
+    midireader::SyntheticMidiOptions jitter;
+    jitter.jitter = 5;
+    scenarios.push_back({ "jitter", jitter });
+
+    midireader::SyntheticMidiOptions running;
+    running.runningStatus = true;
+    scenarios.push_back({ "running", running });
+
+    midireader::SyntheticMidiOptions longSong;
+    longSong.numofBars = 1024;
+    longSong.notesPerBar = 4;
+    scenarios.push_back({ "long", longSong });
+
+    return scenarios;
+}
+
+
+// the stages which allocated after the warm up
+int numofAllocatingStages = 0;
+
+// run the stage repeatedly for minTime, and print the throughput.
+// the stage returns the number of the processed events.
+template<class F>
+void measure(const char *stage, double minTime, F &&run) {
+    using clock = std::chrono::steady_clock;
+
+    // warm up
+    size_t events = run();
+
+    size_t totalEvents = 0;
+    size_t iterations = 0;
+    const alloc::ThreadAllocations allocations;
+    const auto start = clock::now();
+    double elapsed = 0;
+
+    do {
+        totalEvents += run();
+        iterations++;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed < minTime);
+
+    if (allocations.count() > 0)
+        numofAllocatingStages++;
+
+    using namespace std;
+    cout << "  " << left << setw(20) << stage << right
+        << setw(14) << fixed << setprecision(0) << totalEvents / elapsed
+        << setw(12) << setprecision(1) << elapsed * 1e9 / max<size_t>(totalEvents, 1);
+    if (alloc::isAvailable())
+        cout << setw(14) << setprecision(3) << static_cast<double>(allocations.count()) / max<size_t>(totalEvents, 1);
+    else
+        cout << setw(14) << "-";
+    cout << setw(10) << events
+        << setw(8) << iterations
+        << (allocations.count() > 0 ? "  (!)" : "")
+        << '\n';
+}
+
+void runScenario(const Scenario &scenario, double minTime) {
+    using namespace midireader;
+
+    const std::string midi = generateSyntheticMidi(scenario.options);
+
+    MIDIReader reader;
+    reader.setAdjustmentAmplitude(2, 1024);
+    if (Failed(reader.readFromMemory(midi.data(), midi.size()))) {
+        std::cout << "[!] " << scenario.name << ": 生成したMIDIファイルを読み込めません\n";
+        return;
+    }
+
+    size_t numofNotes = 0;
+    for (const auto &events : reader.getNoteEvent()) {
+        numofNotes += events.size();
+    }
+
+    std::cout << scenario.name << " (" << midi.size() << " bytes, " << numofNotes << " note events)\n";
+    std::cout << "  " << std::left << std::setw(20) << "stage" << std::right
+        << std::setw(14) << "events/s"
+        << std::setw(12) << "ns/event"
+        << std::setw(14) << "allocs/event"
+        << std::setw(10) << "events"
+        << std::setw(8) << "iter"
+        << '\n';
+
+    MIDIReader stageReader;
+    stageReader.setAdjustmentAmplitude(2, 1024);
+
+    measure("readTrack", minTime, [&]() {
+        ReaderBenchmark::readTracks(stageReader, midi);
+        return numofNotes;
+    });
+
+    volatile long sink = 0;
+
+    measure("calcScoreTime", minTime, [&]() {
+        sink += ReaderBenchmark::calcScoreTime(stageReader);
+        return numofNotes;
+    });
+
+    measure("calcBestScoreTime", minTime, [&]() {
+        sink += ReaderBenchmark::calcBestScoreTime(stageReader, stageReader.getAdjustmentThreshold());
+        return numofNotes;
+    });
+
+    measure("readFromMemory", minTime, [&]() {
+        stageReader.readFromMemory(midi.data(), midi.size());
+        return numofNotes;
+    });
+
+    // the positions of the notes as the operands
+    std::vector<math::Fraction> positions;
+    for (const auto &events : reader.getNoteEvent()) {
+        for (const auto &e : events) {
+            positions.push_back(e.posInBar);
+        }
+    }
+
+    measure("Fraction", minTime, [&]() {
+        int count = 0;
+        for (size_t i = 1; i < positions.size(); i++) {
+            const auto &a = positions[i - 1];
+            const auto &b = positions[i];
+
+            count += (a + b).get().d;
+            count += (a - b).get().d;
+            count += (a * b).get().d;
+            count += a < b;
+            count += a == b;
+        }
+        sink += count;
+
+        return positions.empty() ? 0 : (positions.size() - 1) * 5;
+    });
+
+    // the notes of each bar as hit notes
+    std::vector<std::vector<miditoscore::ScoreNote>> bars;
+    for (const auto &events : reader.getNoteEvent()) {
+        for (const auto &e : events) {
+            if (e.type != MidiEvent::NoteOn)
+                continue;
+
+            if (bars.size() <= static_cast<size_t>(e.bar))
+                bars.resize(e.bar + 1);
+            bars[e.bar].emplace_back(miditoscore::NoteType::HIT, &e);
+        }
+    }
+
+    miditoscore::NoteFormat format;
+    format.holdMinLength = math::Fraction(1, 4);
+    format.laneAllocation = scenario.options.intervals;
+    format.allowedLineLength = 1024;
+
+    NullBuffer nullBuffer;
+    std::ostream nullStream(&nullBuffer);
+
+    miditoscore::MIDItoScore toscore;
+    std::string line;
+    const std::vector<NoteEvent> noNotes;
+
+    measure("createScoreString", minTime, [&]() {
+        // drop the concurrent notes found in the previous run
+        toscore.writeScore(nullStream, format, noNotes);
+
+        size_t count = 0;
+        for (const auto &notes : bars) {
+            if (notes.empty())
+                continue;
+            toscore.createScoreString(notes, line);
+            count += notes.size();
+        }
+
+        return count;
+    });
+
+    measure("writeScore", minTime, [&]() {
+        size_t count = 0;
+        for (size_t track = 2; track <= reader.getTracks().size(); track++) {
+            toscore.writeScore(nullStream, format, reader.getNoteEvent(track));
+            count += reader.getNoteEvent(track).size();
+        }
+
+        return count;
+    });
+
+    MergedNoteView merged(reader);
+    measure("mergedNotes", minTime, [&]() {
+        merged.reset();
+
+        MergedNote note;
+        size_t count = 0;
+        while (merged.next(note)) {
+            sink += note.evt->time;
+            count++;
+        }
+
+        return count;
+    });
+
+    std::cout << '\n';
+}
+
+int main(int argc, char* argv[]) {
+    std::string scenarioName;
+    double minTime = 0.3;
+    bool allocCheck = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+            scenarioName = argv[++i];
+        } else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            minTime = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--alloc-check") == 0) {
+            allocCheck = true;
+        } else {
+            std::cout << "usage: benchmark [--scenario <name>] [--min-time <sec>] [--alloc-check]\n";
+            return 1;
+        }
+    }
+
+    if (allocCheck && !alloc::isAvailable()) {
+        std::cout << "[!] --alloc-check にはMIDITOSCORE_COUNT_ALLOCATIONSを定義してビルドしてください\n";
+        return 1;
+    }
+
+    bool found = false;
+    for (const auto &scenario : makeScenarios()) {
+        if (!scenarioName.empty() && scenarioName != scenario.name)
+            continue;
+
+        runScenario(scenario, minTime);
+        found = true;
+    }
+
+    if (!found) {
+        std::cout << "[!] 不明なシナリオです: " << scenarioName << '\n';
+        return 1;
+    }
+
+    if (allocCheck && numofAllocatingStages > 0) {
+        std::cout << "[!] ウォームアップ後にメモリを確保した段階があります: " << numofAllocatingStages << '\n';
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,347 @@
+﻿#include "MIDItoScore.hpp"
+#include "ScoreExporter.hpp"
+#include "BatchConverter.hpp"
+#include "BinaryScore.hpp"
+#include "WorkStealingPool.hpp"
+#include "Checksum.hpp"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// end-to-end benchmark of the conversion on a directory of midi files.
+// each file is converted in the same way as createScore (read, quantize, header and all sections of the profiles)
+// without writing the files, and the outputs are checked against the golden hashes.
+// build this file with the sources except createScore.cpp, benchmark.cpp and regressionTest.cpp.
+//
+// --- config -------------------------------
+// [0]                      <- song id written to the header
+// lanes=F3,E3,D3,C3
+// hold=1/4
+// chobeg=1.5
+// choend=10.0
+// profile=all
+// ------------------------------------------
+// the keys are the same as the manifest of BatchConverter. midi, music and jacket are not needed.
+
+
+namespace fs = std::filesystem;
+
+
+struct SongResult {
+    fs::path file;
+    bool succeeded = false;
+    double seconds = 0;
+    // hash of the text and binary score of each profile
+    std::vector<std::pair<std::string, uint64_t>> hashes;
+    std::string log;
+};
+
+
+void printUsage() {
+    std::cout << "usage: corpusBench <midi directory> --config <file> [--golden <file>] [--update-golden] [--jobs <n>] [--repeat <n>]\n";
+}
+
+// peak resident set size of the process in bytes
+size_t peakRSS() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+std::string toHex(uint64_t value) {
+    std::ostringstream str;
+    str << std::hex << std::setfill('0') << std::setw(16) << value;
+    return str.str();
+}
+
+SongResult convert(const fs::path &file, const miditoscore::SongSettings &song, const std::vector<miditoscore::OutputProfile> &profiles) {
+    SongResult result;
+    result.file = file;
+
+    std::ostringstream log;
+    std::vector<std::pair<std::string, std::string>> outputs;
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    midireader::MIDIReader midi;
+    midi.setAdjustmentAmplitude(2, 1024);
+    const auto ret = midi.openAndRead(file.string());
+
+    log << "MIDIファイルを読み込んでいます... ";
+    if (miditoscore::printReadStatus(log, ret, midi)) {
+        for (const auto &profile : profiles) {
+            std::ostringstream score;
+            std::vector<miditoscore::CompiledChart> charts;
+            miditoscore::writeProfileScore(score, log, midi, song, profile, &charts);
+
+            std::ostringstream binary(std::ios::binary);
+            miditoscore::writeBinaryScore(binary, midi, charts);
+
+            outputs.emplace_back(score.str(), binary.str());
+        }
+        result.succeeded = true;
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    // the hashing is not measured
+    for (size_t i = 0; i < outputs.size(); i++) {
+        const uint64_t hash = checksum::combine(checksum::hash64(outputs[i].first), checksum::hash64(outputs[i].second));
+        result.hashes.emplace_back(profiles[i].name, hash);
+    }
+    result.log = log.str();
+
+    return result;
+}
+
+// key: "<relative path>\t<profile>"
+bool readGolden(const fs::path &fileName, std::map<std::string, uint64_t> &golden) {
+    std::ifstream file(fileName);
+    if (!file.is_open())
+        return false;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line.front() == '#')
+            continue;
+
+        const auto tabPos = line.rfind('\t');
+        if (tabPos == std::string::npos)
+            continue;
+
+        try {
+            golden[line.substr(0, tabPos)] = std::stoull(line.substr(tabPos + 1), nullptr, 16);
+        } catch (const std::exception&) {
+            continue;
+        }
+    }
+
+    return true;
+}
+
+bool writeGolden(const fs::path &fileName, const std::map<std::string, uint64_t> &hashes) {
+    std::ofstream file(fileName);
+    if (!file.is_open())
+        return false;
+
+    file << "# corpusBench golden hashes (<file>\\t<profile>\\t<hash>)\n";
+    for (const auto &h : hashes) {
+        file << h.first << '\t' << toHex(h.second) << '\n';
+    }
+
+    return static_cast<bool>(file);
+}
+
+double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty())
+        return 0;
+
+    const size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+int main(int argc, char* argv[]) {
+    using std::cout;
+
+    fs::path corpusDir;
+    fs::path configFile;
+    fs::path goldenFile;
+    bool updateGolden = false;
+    int numofJobs = 1;
+    int repeat = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            configFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+            goldenFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--update-golden") == 0) {
+            updateGolden = true;
+        } else if (std::strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            numofJobs = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = std::max(std::atoi(argv[++i]), 1);
+        } else if (argv[i][0] != '-' && corpusDir.empty()) {
+            corpusDir = argv[i];
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (corpusDir.empty() || configFile.empty() || numofJobs < 0 || (updateGolden && goldenFile.empty())) {
+        printUsage();
+        return 1;
+    }
+
+    // read the settings
+    std::ifstream config(configFile);
+    if (!config.is_open()) {
+        cout << "[!] 設定ファイルが開けません: " << configFile.string() << '\n';
+        return 1;
+    }
+
+    std::vector<miditoscore::BatchEntry> entries;
+    if (!miditoscore::readManifest(config, configFile.parent_path(), { miditoscore::buttonProfile() }, entries, cout, false)) {
+        return 1;
+    }
+    if (entries.size() != 1) {
+        cout << "[!] 設定ファイルには曲を1つだけ指定してください\n";
+        return 1;
+    }
+    const auto &entry = entries.front();
+
+    // collect the midi files
+    std::vector<fs::path> files;
+    std::error_code ec;
+    for (const auto &item : fs::recursive_directory_iterator(corpusDir, ec)) {
+        if (!item.is_regular_file())
+            continue;
+
+        auto extension = item.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char ch) { return static_cast<char>(std::tolower(ch)); });
+        if (extension == ".mid" || extension == ".midi")
+            files.push_back(item.path());
+    }
+    std::sort(files.begin(), files.end());
+
+    if (files.empty()) {
+        cout << "[!] MIDIファイルが見つかりません: " << corpusDir.string() << '\n';
+        return 1;
+    }
+
+    // convert all files repeat times
+    std::vector<SongResult> results(files.size() * repeat);
+    std::vector<miditoscore::WorkStealingPool::Task> tasks;
+    for (size_t i = 0; i < results.size(); i++) {
+        tasks.push_back([&, i]() {
+            try {
+                results[i] = convert(files[i % files.size()], entry.song, entry.profiles);
+            } catch (const std::exception &e) {
+                results[i].file = files[i % files.size()];
+                results[i].log = std::string("[!] ") + e.what() + "\n";
+            }
+        });
+    }
+
+    miditoscore::WorkStealingPool pool(numofJobs);
+    const auto startTime = std::chrono::steady_clock::now();
+    pool.run(std::move(tasks));
+    const double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    // statistics
+    std::vector<double> latencies;
+    size_t numofFailed = 0;
+    for (const auto &r : results) {
+        latencies.push_back(r.seconds);
+        if (!r.succeeded)
+            numofFailed++;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    // the hashes of the first run. the following runs must have the same hashes.
+    std::map<std::string, uint64_t> hashes;
+    size_t numofUnstable = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto &r = results[i];
+        const std::string name = fs::relative(r.file, corpusDir, ec).generic_string();
+
+        if (!r.succeeded && i < files.size()) {
+            cout << "[!] " << name << "\n" << r.log;
+            continue;
+        }
+
+        for (const auto &h : r.hashes) {
+            const std::string key = name + '\t' + h.first;
+            if (i < files.size())
+                hashes[key] = h.second;
+            else if (hashes[key] != h.second)
+                numofUnstable++;
+        }
+    }
+
+    cout << std::fixed;
+    cout << "songs        : " << files.size() << " x " << repeat << " (failed: " << numofFailed << ")\n";
+    cout << "threads      : " << pool.size() << '\n';
+    cout << "songs/s      : " << std::setprecision(2) << results.size() / totalSeconds << '\n';
+    cout << "latency p50  : " << std::setprecision(3) << percentile(latencies, 0.50) * 1000 << " ms\n";
+    cout << "latency p99  : " << percentile(latencies, 0.99) * 1000 << " ms\n";
+    cout << "latency max  : " << latencies.back() * 1000 << " ms\n";
+    cout << "peak RSS     : " << std::setprecision(1) << peakRSS() / (1024.0 * 1024.0) << " MiB\n";
+
+    bool succeeded = numofFailed == 0;
+
+    if (numofUnstable > 0) {
+        cout << "[!] 同じファイルの出力が実行ごとに異なります: " << numofUnstable << '\n';
+        succeeded = false;
+    }
+
+    if (goldenFile.empty())
+        return succeeded ? 0 : 1;
+
+    if (updateGolden) {
+        if (!writeGolden(goldenFile, hashes)) {
+            cout << "[!] ゴールデンファイルを書き込めません: " << goldenFile.string() << '\n';
+            return 1;
+        }
+        cout << "golden       : " << hashes.size() << " 件を更新しました\n";
+        return succeeded ? 0 : 1;
+    }
+
+    std::map<std::string, uint64_t> golden;
+    if (!readGolden(goldenFile, golden)) {
+        cout << "[!] ゴールデンファイルが開けません: " << goldenFile.string() << '\n';
+        return 1;
+    }
+
+    size_t numofMatched = 0;
+    for (const auto &h : hashes) {
+        const auto it = golden.find(h.first);
+        if (it == golden.end()) {
+            cout << "[!] ゴールデンにありません: " << h.first << '\n';
+            succeeded = false;
+        } else if (it->second != h.second) {
+            cout << "[!] 出力が異なります: " << h.first << '\n';
+            succeeded = false;
+        } else {
+            numofMatched++;
+        }
+    }
+    for (const auto &g : golden) {
+        if (hashes.count(g.first) == 0) {
+            cout << "[!] 出力がありません: " << g.first << '\n';
+            succeeded = false;
+        }
+    }
+
+    cout << "golden       : " << numofMatched << " / " << golden.size() << " 一致\n";
+
+    return succeeded ? 0 : 1;
+}
@@ -1,16 +1,27 @@
 ﻿#include "MIDItoScore.hpp"
+#include "ScoreExporter.hpp"
+#include "BinaryScore.hpp"
+#include "BatchConverter.hpp"
+#include "FileWatcher.hpp"
+#include "ConversionDaemon.hpp"
+#include "ConversionStats.hpp"
+#include "Trace.hpp"
+#include "AllocationCounter.hpp"
 #include <iomanip>
 #include <sstream>
+#include <fstream>
 #include <algorithm>
 #include <array>
 #include <filesystem>
+#include <future>
+#include <cstring>
+#include <chrono>
+#include <csignal>
 
+// the profile used when --profile is not given.
+// define WII_VERSION to keep the behavior of the former wii build.
 // #define WII_VERSION
 
-#ifndef WII_VERSION
-#define BUTTON_VERSION
-#endif
-
 
 bool isNumber(char ch) {
     return '0' <= ch && ch <= '9';
@@ -20,23 +31,6 @@ bool isIntervalAlphabet(char ch) {
     return ('a' <= ch && ch <= 'g') || ('A' <= ch && ch <= 'G');
 }
 
-int searchTrack(const std::vector<midireader::Track>& tracks, const std::string searchName) {
-    int trackNum = -1;
-
-    for (const auto t : tracks) {
-        if (t.name == searchName) {
-            trackNum = t.trackNum;
-            break;
-        }
-    }
-
-    return trackNum;
-}
-
-bool isInclude(int val, int flag) {
-    return (val & flag) == flag;
-}
-
 bool toNumber(const std::string& str, int* number = nullptr) {
     size_t numEndedPos;
     int n;
@@ -144,7 +138,137 @@ void stop() {
     std::cin.ignore();
 }
 
-int main() {
+
+// read the midi file (or the parsed midi file)
+midireader::Status readMidiFile(midireader::MIDIReader& midir, const std::string& filePath) {
+    // the parsed midi file (.mts) is loaded without quantizing again
+    if (std::filesystem::path(filePath).extension() == ".mts")
+        return midir.load(filePath);
+    else
+        return midir.openAndRead(filePath);
+}
+
+// write the stats of the conversion as json
+void writeStatsFile(const std::filesystem::path& fileName, const stats::ConversionStats& conversionStats) {
+    std::ofstream file(fileName);
+    stats::writeJson(file, conversionStats);
+
+    if (!file)
+        std::cout << "[!] 統計情報を書き込めません: " << fileName.string() << '\n';
+}
+
+// write the analytics of the charts of each profile as json
+void writeAnalyticsFile(
+    const std::filesystem::path& fileName,
+    const std::vector<miditoscore::OutputProfile>& profiles,
+    const std::vector<std::vector<miditoscore::CompiledChart>>& charts) {
+
+    std::ofstream file(fileName);
+    file << '{';
+    for (size_t i = 0; i < profiles.size(); i++) {
+        file << (i > 0 ? ",\n\"" : "\n\"") << profiles[i].name << "\": ";
+        miditoscore::writeChartAnalyticsJson(file, charts[i]);
+    }
+    file << "\n}\n";
+
+    if (!file)
+        std::cout << "[!] 譜面の分析結果を書き込めません: " << fileName.string() << '\n';
+}
+
+// write the spans recorded until now as chrome trace json
+void writeTraceFile(const std::filesystem::path& fileName) {
+    std::ofstream file(fileName);
+    trace::writeChromeTrace(file);
+
+    if (!file)
+        std::cout << "[!] トレースを書き込めません: " << fileName.string() << '\n';
+}
+
+// convert the midi file again whenever it is saved, with the same settings.
+// the watcher is opened and the line caches in states are filled by the first conversion.
+// if statsFile and traceFile are not empty, the stats and the spans of each conversion are written to them.
+void watchMidiFile(
+    fileio::FileWatcher& watcher,
+    const std::string& midiFilePath,
+    midireader::MIDIReader& midir,
+    const miditoscore::SongSettings& song,
+    const std::vector<miditoscore::OutputProfile>& profiles,
+    std::vector<miditoscore::ExportState>& states,
+    const std::filesystem::path& statsFile,
+    const std::filesystem::path& traceFile) {
+
+    using namespace midireader;
+    using std::cout;
+    using Clock = std::chrono::steady_clock;
+
+    cout << "\n[i] MIDIファイルの変更を監視しています (終了するにはCtrl+Cを押してください)" << std::endl;
+
+    while (watcher.wait()) {
+        stats::reset();
+        trace::clear();
+        const auto beginTime = Clock::now();
+
+        const Status ret = readMidiFile(midir, midiFilePath);
+        const auto readTime = Clock::now();
+
+        cout << "\n[i] MIDIファイルが更新されました\n";
+
+        if (Failed(ret)) {
+            cout << "[!] MIDIファイルを読み込めません.書き出し中の場合は保存が終わるまでお待ちください\n";
+            continue;
+        }
+        if (ret == Status::S_NO_EMBED_TIMESIGNATURE) {
+            cout << "[!] MIDIファイルに拍子情報が埋め込まれていません.\n";
+            continue;
+        }
+        if (midir.getTempoEvent().empty()) {
+            cout << "[!] MIDIファイルにテンポ情報が埋め込まれていません.\n";
+            continue;
+        }
+
+        std::ostringstream log;
+        for (size_t i = 0; i < profiles.size(); i++) {
+            miditoscore::exportProfile(".", log, midir, song, profiles[i], &states[i]);
+        }
+        const auto endTime = Clock::now();
+
+        size_t numofUpdatedLines = 0;
+        for (const auto& state : states) {
+            for (const auto& section : state.sections) {
+                numofUpdatedLines += section->getNumofUpdatedLines();
+            }
+        }
+
+        using Milliseconds = std::chrono::duration<double, std::milli>;
+        cout << log.str();
+        cout << "\n[i] 再変換しました  読み込み: " << std::fixed << std::setprecision(1) << Milliseconds(readTime - beginTime).count() << "ms"
+            << "  変換: " << Milliseconds(endTime - readTime).count() << "ms"
+            << "  更新した行: " << numofUpdatedLines << std::endl;
+
+        if (!statsFile.empty())
+            writeStatsFile(statsFile, stats::current());
+        if (!traceFile.empty())
+            writeTraceFile(traceFile);
+    }
+
+    cout << "[!] MIDIファイルの監視に失敗しました\n";
+}
+
+// the daemon stopped by SIGINT and SIGTERM
+miditoscore::ConversionDaemon *runningDaemon = nullptr;
+
+extern "C" void stopDaemon(int) {
+    if (runningDaemon)
+        runningDaemon->stop();
+}
+
+void printUsage() {
+    std::cout << "usage: createScore [--profile button|wii|all]... [--parallel] [--save-parsed <file.mts>] [--watch] [--stats <file.json>] [--trace <file.json>] [--alloc-report] [--analytics <file.json>]\n"
+        << "       createScore --batch <manifest> [--output <dir>] [--jobs <n>] [--cache <dir>] [--profile button|wii|all]... [--stats <file.json>] [--trace <file.json>] [--alloc-report]\n"
+        << "       createScore --daemon <socket> [--jobs <n>] [--profile button|wii]\n";
+}
+
+int main(int argc, char* argv[]) {
     using namespace midireader;
     namespace fs = std::filesystem;
     using std::cin;
@@ -152,6 +276,169 @@ int main() {
     using std::string;
     using std::wstring;
 
+    // parse command line options
+    std::vector<miditoscore::OutputProfile> profiles;
+    bool parallel = false;
+    string manifestFile;
+    fs::path outputDir = ".";
+    int numofJobs = 0;
+    fs::path cacheDir;
+    string parsedFile;
+    bool watch = false;
+    string socketPath;
+    fs::path statsFile;
+    fs::path traceFile;
+    fs::path analyticsFile;
+    bool allocReport = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            const string name = argv[++i];
+            miditoscore::OutputProfile profile;
+            if (name == "all") {
+                profiles.push_back(miditoscore::buttonProfile());
+                profiles.push_back(miditoscore::wiiProfile());
+            } else if (miditoscore::findProfile(name, profile)) {
+                profiles.push_back(profile);
+            } else {
+                cout << "[!] 不明なプロファイルです: " << name << '\n';
+                printUsage();
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--parallel") == 0) {
+            parallel = true;
+        } else if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            manifestFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputDir = argv[++i];
+        } else if (std::strcmp(argv[i], "--watch") == 0) {
+            watch = true;
+        } else if (std::strcmp(argv[i], "--save-parsed") == 0 && i + 1 < argc) {
+            parsedFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--daemon") == 0 && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            statsFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            traceFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--analytics") == 0 && i + 1 < argc) {
+            analyticsFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--alloc-report") == 0) {
+            allocReport = true;
+        } else if (std::strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cacheDir = argv[++i];
+        } else if (std::strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            if (!toNumber(argv[++i], &numofJobs) || numofJobs < 0) {
+                printUsage();
+                return 1;
+            }
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (profiles.empty()) {
+#ifdef WII_VERSION
+        profiles.push_back(miditoscore::wiiProfile());
+#else
+        profiles.push_back(miditoscore::buttonProfile());
+#endif
+    }
+
+    // the counters of the reader and writer on the main thread
+    stats::enable(!statsFile.empty());
+
+#ifndef MIDITOSCORE_ENABLE_TRACE
+    if (!traceFile.empty()) {
+        cout << "[i] トレースを記録するにはMIDITOSCORE_ENABLE_TRACEを定義してビルドしてください\n";
+        traceFile.clear();
+    }
+#endif
+    trace::enable(!traceFile.empty());
+
+    if (allocReport && !alloc::isAvailable()) {
+        cout << "[i] メモリ確保を数えるにはMIDITOSCORE_COUNT_ALLOCATIONSを定義してビルドしてください\n";
+        allocReport = false;
+    }
+    alloc::reset();
+
+    // convert the songs in the manifest without any prompt
+    if (!manifestFile.empty()) {
+        std::vector<miditoscore::BatchEntry> entries;
+        if (!miditoscore::readManifest(manifestFile, profiles, entries, cout)) {
+            return 1;
+        }
+
+        std::error_code ec;
+        fs::create_directories(outputDir, ec);
+
+        const miditoscore::BuildCache cache(cacheDir);
+        const auto results = miditoscore::convertBatch(entries, outputDir, numofJobs, cacheDir.empty() ? nullptr : &cache, !statsFile.empty());
+        miditoscore::printBatchSummary(cout, results);
+
+        // the stats of the songs keyed by the song id
+        if (!statsFile.empty()) {
+            std::ofstream file(statsFile);
+            file << "{\n";
+            for (size_t i = 0; i < results.size(); i++) {
+                std::string json = results[i].stats.empty() ? "null" : results[i].stats;
+                if (json.back() == '\n')
+                    json.pop_back();
+
+                file << '"' << results[i].id << "\": " << json << (i + 1 < results.size() ? ",\n" : "\n");
+            }
+            file << "}\n";
+
+            if (!file)
+                cout << "[!] 統計情報を書き込めません: " << statsFile.string() << '\n';
+        }
+
+        if (!traceFile.empty())
+            writeTraceFile(traceFile);
+        if (allocReport) {
+            cout << "\n--メモリ確保-----\n";
+            alloc::writeReport(cout, alloc::snapshot());
+        }
+
+        const bool succeeded = std::all_of(
+            results.cbegin(),
+            results.cend(),
+            [](const miditoscore::BatchResult& r) { return r.succeeded; }
+        );
+
+        return succeeded ? 0 : 1;
+    }
+
+    // serve the conversion on the socket until the process is interrupted
+    if (!socketPath.empty()) {
+        miditoscore::ConversionDaemon daemon;
+        if (!daemon.open(socketPath, profiles, numofJobs, 0, cout)) {
+            return 1;
+        }
+
+        runningDaemon = &daemon;
+        std::signal(SIGINT, stopDaemon);
+        std::signal(SIGTERM, stopDaemon);
+
+        cout << "[i] " << socketPath << " で変換を受け付けています (Ctrl+Cで終了)" << std::endl;
+        daemon.run();
+
+        runningDaemon = nullptr;
+        cout << "[i] 終了しました" << std::endl;
+
+        return 0;
+    }
+
+    const bool needSongDirectory = std::any_of(
+        profiles.cbegin(),
+        profiles.cend(),
+        [](const miditoscore::OutputProfile& p) { return p.songDirectory; }
+    );
+
+    miditoscore::SongSettings song;
+    song.chorusBegSec = 0;
+    song.chorusEndSec = 0;
+
     bool loopFlag = true;
 
     // get class number
@@ -171,9 +458,12 @@ int main() {
             cout << "[!] 0以上の半角数字で入力してください\n";
         }
     }
+    song.id = musicIDPath.u8string();
 
     // get the midi file path
     MIDIReader midir;
+    string midiFilePath;
+    fileio::FileWatcher watcher;
     loopFlag = true;
     Status ret;
 
@@ -191,8 +481,13 @@ int main() {
                 filePath.erase(filePath.end() - 1);
         }
 
+        // the watcher is opened before the file is read, so a save during the first conversion is not missed
+        if (watch)
+            watcher.open(filePath);
+
         midir.setAdjustmentAmplitude(2, 1024);
-        ret = midir.openAndRead(filePath);
+        ret = readMidiFile(midir, filePath);
+        midiFilePath = filePath;
 
         if (ret == Status::E_CANNOT_OPEN_FILE) {
             cout << "[!] ファイルが開けません.パスを確認して下さい\n";
@@ -203,6 +498,11 @@ int main() {
         }
     }
 
+    if (watch && !watcher.is_open()) {
+        cout << "[!] MIDIファイルを監視できません\n";
+        watch = false;
+    }
+
     cout << "\nMIDIファイルを読み込んでいます... ";
 
     // print result of reading the midi file
@@ -228,6 +528,13 @@ int main() {
         stop();
     }
 
+    if (!parsedFile.empty()) {
+        if (midir.save(parsedFile) == Status::S_OK)
+            cout << "[i] 読み込んだMIDIファイルを" << parsedFile << "に保存しました\n\n";
+        else
+            cout << "[!] 読み込んだMIDIファイルを保存できません\n\n";
+    }
+
     // get interval
     cout << "打ち込みに使った音程を入力してください\n"
         << "(例: 音名で入力する場合:C3, D#3  番号で入力する場合:60, 63)\n";
@@ -267,7 +574,7 @@ int main() {
 
     cout << '\n';
 
-    PitchNotation pitchNotation;
+    PitchNotation pitchNotation = PitchNotation::A3_440Hz;
     if (givedIntervalAsStr) {
         cout << "DAWの一番低い音程を入力してください [C-2, C-1, C0のどれか]\n";
 
@@ -323,56 +630,54 @@ int main() {
         }
     }
 
-#ifdef BUTTON_VERSION
-    // get chorus timing
-    cout << "\n選曲時に，曲をプレビューするときの再生位置を入力してください (例: 12.3)\n"
-        << "ループ再生したときに，なるべく違和感のないようにお願いします\n";
 
-    double chorusBegSec;
-    double chorusEndSec;
-    for (int i = 0; i < 2; i++) {
-        while (true) {
-            if (i == 0)
-                cout << "再生開始位置 [s] >";
-            else
-                cout << "再生終了位置 [s] >";
-
-            string input;
-            std::getline(cin, input);
-
-            double d;
-            if (toDouble(input, &d) && d >= 0) {
+    // get chorus timing
+    if (needSongDirectory) {
+        cout << "\n選曲時に，曲をプレビューするときの再生位置を入力してください (例: 12.3)\n"
+            << "ループ再生したときに，なるべく違和感のないようにお願いします\n";
+
+        double chorusBegSec = 0;
+        double chorusEndSec = 0;
+        for (int i = 0; i < 2; i++) {
+            while (true) {
                 if (i == 0)
-                    chorusBegSec = d;
+                    cout << "再生開始位置 [s] >";
                 else
-                    chorusEndSec = d;
+                    cout << "再生終了位置 [s] >";
 
-                break;
-            } else {
-                cout << "[!] 0以上の小数を入力してください\n";
+                string input;
+                std::getline(cin, input);
+
+                double d;
+                if (toDouble(input, &d) && d >= 0) {
+                    if (i == 0)
+                        chorusBegSec = d;
+                    else
+                        chorusEndSec = d;
+
+                    break;
+                } else {
+                    cout << "[!] 0以上の小数を入力してください\n";
+                }
             }
-        }
 
-        if (i == 1) {
-            if (chorusBegSec >= chorusEndSec) {
-                cout << "[!] 無効な範囲です\n";
-                i = -1; // loop counter reset
-                continue;
+            if (i == 1) {
+                if (chorusBegSec >= chorusEndSec) {
+                    cout << "[!] 無効な範囲です\n";
+                    i = -1; // loop counter reset
+                    continue;
+                }
             }
         }
+
+        song.chorusBegSec = chorusBegSec;
+        song.chorusEndSec = chorusEndSec;
     }
-#endif // BUTTON_VERSION
-
-    // set note format
-    miditoscore::MIDItoScore toscore;
-    miditoscore::NoteFormat format;
-    format.holdMinLength = holdMinLen;
-    format.laneAllocation = intervalNumbers;
-    format.allowedLineLength = 1024;
-    format.exNoteDecider = [] (const midireader::NoteEvent* note) { return note->velocity >= 110; };
-#ifdef WII_VERSION
-    format.parallelsLimit = 2;
-#endif // WII_VERSION
+
+    song.holdMinLength = holdMinLen;
+    song.laneAllocation = intervalNumbers;
+    song.intervalAsName = givedIntervalAsStr;
+    song.pitchNotation = pitchNotation;
 
 
     // ---------------------------------------------------
@@ -380,383 +685,137 @@ int main() {
 
     cout << "\n譜面データを作成します\n";
 
-#ifdef BUTTON_VERSION
-    // create empty directory
-    while (true) {
-        if (!fs::exists(musicIDPath)) {
-            try {
-                fs::create_directory(musicIDPath);
-            } catch (std::exception e) {
-                cout << "[!] ディレクトリ作成に失敗しました\n";
-                stop();
-            }
-            break;
-        } else {
-            try {
-                fs::remove_all(musicIDPath);
-            } catch (std::exception e) {
-                cout << "[!] ディレクトリの削除に失敗しました\n";
-                stop();
-            }
+    // the compiled charts of each profile, for the analytics
+    std::vector<std::vector<miditoscore::CompiledChart>> profileCharts(profiles.size());
+    auto chartsOf = [&](size_t i) { return analyticsFile.empty() ? nullptr : &profileCharts[i]; };
+
+    // the line caches of each profile, reused by the conversions in the watch mode
+    std::vector<miditoscore::ExportState> states(watch ? profiles.size() : 0);
+    auto stateOf = [&](size_t i) { return watch ? &states[i] : nullptr; };
+
+    // the midi file is parsed once and shared by all profiles
+    if (parallel && profiles.size() > 1) {
+        std::vector<std::ostringstream> logs(profiles.size());
+        std::vector<stats::ConversionStats> profileStats(profiles.size());
+        std::vector<std::future<int>> results;
+
+        for (size_t i = 0; i < profiles.size(); i++) {
+            results.push_back(std::async(
+                std::launch::async,
+                [&, i]() {
+                    // the stats are recorded on this thread, and added to the main thread later
+                    stats::enable(!statsFile.empty());
+                    const int ret = miditoscore::exportProfile(".", logs[i], midir, song, profiles[i], stateOf(i), chartsOf(i));
+                    profileStats[i] = stats::current();
+                    return ret;
+                }
+            ));
         }
-    }
-
-    const auto scoreFilePath = musicIDPath / "score.txt";
-#else
-    const auto scoreFilePath = musicIDPath.generic_string() + "_wii.txt";
-#endif // BUTTON_VERSION
-
-
-    std::ofstream score;
-    score.open(scoreFilePath);
-
-    score << u8"begin:header\n\n";
-    score << u8"id:" << musicIDPath.u8string() << '\n';
 
-#ifdef BUTTON_VERSION
-    score << u8"title:曲名" << '\n';
-    score << u8"artist:アーティスト名" << '\n';
-    score << std::fixed << std::setprecision(3);
-    score << u8"chobeg:" << chorusBegSec << "\n";
-    score << u8"choend:" << chorusEndSec << "\n";
-#endif
-
-    // write tempo
-    cout << "テンポ情報\n";
-    score << '\n';
-
-    const auto tempo = midir.getTempoEvent();
-    for (const auto t : tempo) {
-        using namespace std;
-
-        // ex. tempo:001:1/0:120.000
-        score << "tempo:"
-            << setfill('0') << setw(3) << t.bar
-            << ':'
-            << t.posInBar.get_str()
-            << ':'
-            << setw(6) << fixed << setprecision(3) << t.tempo
-            << '\n';
-
-        cout << "小節:"
-            << setfill('0') << setw(3) << t.bar
-            << " 小節内位置:"
-            << t.posInBar.get_str()
-            << " テンポ:"
-            << setw(6) << fixed << setprecision(3) << t.tempo
-            << '\n';
-    }
-
-    // write time signature
-    cout << "\n拍子情報\n";
-
-    const auto beat = midir.getBeatEvent();
-    for (const auto b : beat) {
-        using namespace std;
-
-        // ex. beat:001:4/4
-        score << "beat:"
-            << setfill('0') << setw(3) << b.bar
-            << ':'
-            << b.beat.get_str()
-            << '\n';
-
-        cout << "小節:"
-            << setfill('0') << setw(3) << b.bar
-            << " 拍子:"
-            << b.beat.get_str()
-            << '\n';
-    }
-
-    score << u8"\nend\n\n";
-
-#ifdef WII_VERSION
-    score << u8"begin:header-wii\n\n";
-    score << u8"level:0:0:0" << "\n";
-    score << u8"\nend\n\n";
-#endif
-
-#ifdef BUTTON_VERSION
-    char firstTrackName = '1';
-#else
-    char firstTrackName = '4';
-#endif
-
-    // write note position
-    for (char targetTrackName = firstTrackName; targetTrackName < firstTrackName + 3; targetTrackName++) {
-
-        int trackNum = -1;
-        const auto tracks = midir.getTracks();
-        trackNum = searchTrack(tracks, std::string(1, targetTrackName));
-        if (trackNum < 0) {
-            continue;
+        // print the logs in the order of the profiles
+        for (size_t i = 0; i < profiles.size(); i++) {
+            results[i].get();
+            cout << logs[i].str();
+            stats::accumulate(stats::current(), profileStats[i]);
         }
-
-        cout << '\n';
-        switch (targetTrackName) {
-#ifdef BUTTON_VERSION
-        case '1':
-            cout << "easy譜面を作成中です... ";
-            score << "begin:easy" << "\n\n";
-            break;
-        case '2':
-            cout << "normal譜面を作成中です... ";
-            score << "begin:normal" << "\n\n";
-            break;
-        case '3':
-            cout << "hard譜面を作成中です... ";
-            score << "begin:hard" << "\n\n";
-            break;
-#else
-        case '4':
-            cout << "easy(wii)譜面を作成中です... ";
-            score << "begin:easy-wii" << "\n\n";
-            break;
-        case '5':
-            cout << "normal(wii)譜面を作成中です... ";
-            score << "begin:normal-wii" << "\n\n";
-            break;
-        case '6':
-            cout << "hard(wii)譜面を作成中です... ";
-            score << "begin:hard-wii" << "\n\n";
-            break;
-#endif
+    } else {
+        for (size_t i = 0; i < profiles.size(); i++) {
+            miditoscore::exportProfile(".", cout, midir, song, profiles[i], stateOf(i), chartsOf(i));
         }
+    }
 
-        auto ret = toscore.writeScore(score, format, midir.getNoteEvent(trackNum));
-
-        score << "\nend\n\n";
-
-        // print return value
-        if (ret == miditoscore::Status::S_OK)
-            cout << "完了\n";
-        else {
-            cout << "エラー\n";
-
-            if (isInclude(ret, miditoscore::Status::E_EXIST_CONCURRENTNOTES)) {
-                cout << "[!] 同じタイミングのノーツが存在しています．\n";
-                cout << "  ->長押しの後にあるノーツと繋がっていないかチェックしてください\n";
-                cout << "  ->ノーツが重なっていないかチェックしてください\n";
-                cout << "-- 問題のあるノーツ --\n";
-
-                int cnt = 0;
-                const auto notes = toscore.getConcurrentNotes();
-                for (auto n : notes) {
-                    using namespace std;
-                    cout << "小節:"
-                        << setfill('0') << setw(3) << n.bar
-                        << " 小節内位置:"
-                        << n.posInBar.get_str()
-                        << " 音程:"
-                        << (givedIntervalAsStr ?
-                            midireader::toNoteName(n.interval, pitchNotation) : std::to_string(n.interval))
-                        << '\n';
-
-                    if (++cnt >= 10)
-                        break;
-                }
+    midir.close();
 
-                if (notes.size() > 10)
-                    cout << "...他" << notes.size() - 10 << "コ\n";
+    if (!statsFile.empty())
+        writeStatsFile(statsFile, stats::current());
+    if (!traceFile.empty())
+        writeTraceFile(traceFile);
+    if (!analyticsFile.empty())
+        writeAnalyticsFile(analyticsFile, profiles, profileCharts);
+    if (allocReport) {
+        cout << "\n--メモリ確保-----\n";
+        alloc::writeReport(cout, alloc::snapshot());
+    }
 
-                cout << '\n';
-            }
-            if (isInclude(ret, miditoscore::Status::E_MANY_PARALLELS)) {
-                cout << "[!] 3レーン以上の同時ノーツが存在しています．\n";
-                cout << "-- 問題のあるノーツ --\n";
-
-                int cnt = 0;
-                const auto notes = toscore.getParallelNotes();
-                for (auto n : notes) {
-                    using namespace std;
-                    cout << "小節:"
-                        << setfill('0') << setw(3) << n.bar
-                        << " 小節内位置:"
-                        << n.posInBar.get_str()
-                        << " 音程:"
-                        << (givedIntervalAsStr ?
-                            midireader::toNoteName(n.interval, pitchNotation) : std::to_string(n.interval))
-                        << '\n';
-
-                    if (++cnt >= 10)
-                        break;
-                }
 
-                if (notes.size() > 10)
-                    cout << "...他" << notes.size() - 10 << "コ\n";
+    if (needSongDirectory) {
+        // ----------------------------------
+        // create ini file
 
-                cout << '\n';
+        // get music file path, copy music file
+        cout << "\n書き出した音源へのパスを入力して下さい(\"や\'がついたままでもOKです)\n";
+        fs::path musicFilePath;
+        while (true) {
+            cout << ">";
+            std::string input;
+            std::getline(std::cin, input);
+
+            // erase ' or "
+            if (!input.empty()) {
+                if (input.front() == '\'' || input.front() == '\"')
+                    input.erase(input.begin());
+                if (input.back() == '\'' || input.back() == '\"')
+                    input.erase(input.end() - 1);
             }
-            if (isInclude(ret, miditoscore::Status::S_EXIST_DEVIATEDNOTES)) {
-                cout << "[!] 指定された音程に当てはまらないノーツが存在しています.\n";
-                cout << "-- 問題のあるノーツ --\n";
-
-                int cnt = 0;
-                auto notes = toscore.getDeviatedNotes();
-                for (auto n : notes) {
-                    using namespace std;
-                    cout << "小節:"
-                        << setfill('0') << setw(3) << n.bar
-                        << " 小節内位置:"
-                        << n.posInBar.get_str()
-                        << " 音程:"
-                        << (givedIntervalAsStr ?
-                            midireader::toNoteName(n.interval, pitchNotation) : std::to_string(n.interval))
-                        << '\n';
-
-                    if (++cnt >= 10)
-                        break;
-                }
 
-                if (notes.size() > 10)
-                    cout << "...他" << notes.size() - 10 << "コ\n";
+            try {
+                musicFilePath = input;
 
-                cout << '\n';
+                fs::copy_file(
+                    musicFilePath,
+                    musicIDPath / musicFilePath.filename(),
+                    fs::copy_options::overwrite_existing
+                );
+            } catch (std::exception e) {
+                cout << "[i] " << e.what() << "\n";
+                continue;
             }
-            if (isInclude(ret, miditoscore::Status::E_EXIST_LONGLINES)) {
-                cout << "[!] 譜面データの1行がとても長くなっています.\n";
-                cout << "  -> 許容できる1行の文字数は" << format.allowedLineLength << "です\n";
-                cout << "  -> 該当する箇所のノーツをDAW上でクォンタイズしてください．\n";
-                cout << "-- 該当する箇所 --\n";
-
-                int cnt = 0;
-                auto lines = toscore.getLongLines();
-                for (auto l : lines) {
-                    using namespace std;
-                    cout << "小節:"
-                        << setfill('0') << setw(3) << l.bar
-                        << " 音程:"
-                        << (givedIntervalAsStr ?
-                            midireader::toNoteName(l.interval, pitchNotation) : std::to_string(l.interval))
-                        << '\n';
-
-                    if (++cnt >= 10)
-                        break;
-                }
+            break;
+        }
 
-                if (lines.size() > 10)
-                    cout << "...他" << lines.size() - 10 << "コ\n";
+        // get image file path, copy image file
+        cout << "\nジャケット写真へのパスを入力して下さい(\"や\'がついたままでもOKです)\n";
+        fs::path imageFilePath;
+        while (true) {
+            cout << ">";
+            std::string input;
+            std::getline(cin, input);
 
-                cout << '\n';
+            // erase ' or "
+            if (!input.empty()) {
+                if (input.front() == '\'' || input.front() == '\"')
+                    input.erase(input.begin());
+                if (input.back() == '\'' || input.back() == '\"')
+                    input.erase(input.end() - 1);
             }
-        }
 
-        cout << "--ノーツ内訳-----\n";
-        cout << "lane |";
-        for (size_t lane = 0; lane < 4; lane++) {
-            cout << std::setfill(' ') << std::setw(4) << lane << '|';
-        }
-        cout << '\n';
-        cout << "hit  |";
-        for (auto i : intervalNumbers) {
-            cout << std::setfill(' ') << std::setw(4) << toscore.getNoteAggregate(i).hit << '|';
-        }
-        cout << '\n';
-        cout << "exhit|";
-        for (auto i : intervalNumbers) {
-            cout << std::setfill(' ') << std::setw(4) << toscore.getNoteAggregate(i).exhit << '|';
-        }
-        cout << '\n';
-        cout << "hold |";
-        for (auto i : intervalNumbers) {
-            cout << std::setfill(' ') << std::setw(4) << toscore.getNoteAggregate(i).hold << '|';
-        }
-        cout << '\n';
+            try {
+                imageFilePath = fs::path(input);
 
-        size_t totalNoteCnt = 0;
-        cout << "all  |";
-        for (auto i : intervalNumbers) {
-            cout << std::setfill(' ') << std::setw(4) << toscore.getNoteAggregate(i).total() << '|';
-            totalNoteCnt += toscore.getNoteAggregate(i).total();
+                fs::copy_file(
+                    imageFilePath,
+                    musicIDPath / imageFilePath.filename(),
+                    fs::copy_options::overwrite_existing
+                );
+            } catch (std::exception e) {
+                cout << "[i] " << e.what() << "\n";
+                continue;
+            }
+            break;
         }
-        cout << '\n';
-        cout << "total:" << totalNoteCnt << '\n';
-    }
 
-    score.close();
-    midir.close();
-
-
-#ifdef BUTTON_VERSION
-    // ----------------------------------
-    // create ini file
-
-    // get music file path, copy music file
-    cout << "\n書き出した音源へのパスを入力して下さい(\"や\'がついたままでもOKです)\n";
-    fs::path musicFilePath;
-    while (true) {
-        cout << ">";
-        std::string input;
-        std::getline(std::cin, input);
-
-        // erase ' or "
-        if (!input.empty()) {
-            if (input.front() == '\'' || input.front() == '\"')
-                input.erase(input.begin());
-            if (input.back() == '\'' || input.back() == '\"')
-                input.erase(input.end() - 1);
+        // write to ini file
+        if (!miditoscore::writeIniFile(musicIDPath, musicFilePath, imageFilePath)) {
+            cout << "[!] iniファイルを作成できません\n";
         }
 
-        try {
-            musicFilePath = input;
-
-            fs::copy_file(
-                musicFilePath,
-                musicIDPath / musicFilePath.filename(),
-                fs::copy_options::overwrite_existing
-            );
-        } catch (std::exception e) {
-            cout << "[i] " << e.what() << "\n";
-            continue;
-        }
-        break;
+        cout << "\n譜面データのディレクトリを作成しました\n";
     }
 
-    // get image file path, copy image file
-    cout << "\nジャケット写真へのパスを入力して下さい(\"や\'がついたままでもOKです)\n";
-    fs::path imageFilePath;
-    while (true) {
-        cout << ">";
-        std::string input;
-        std::getline(cin, input);
-
-        // erase ' or "
-        if (!input.empty()) {
-            if (input.front() == '\'' || input.front() == '\"')
-                input.erase(input.begin());
-            if (input.back() == '\'' || input.back() == '\"')
-                input.erase(input.end() - 1);
-        }
-
-        try {
-            imageFilePath = fs::path(input);
-
-            fs::copy_file(
-                imageFilePath,
-                musicIDPath / imageFilePath.filename(),
-                fs::copy_options::overwrite_existing
-            );
-        } catch (std::exception e) {
-            cout << "[i] " << e.what() << "\n";
-            continue;
-        }
-        break;
+    if (watch) {
+        watchMidiFile(watcher, midiFilePath, midir, song, profiles, states, statsFile, traceFile);
     }
 
-    // write to ini file
-    std::basic_ofstream<char32_t> ini;
-    ini.open(musicIDPath / "score.ini");
-
-    ini << U"jacket=\"" << imageFilePath.filename().u32string() << U"\"\n";
-    ini << U"music=\"" << musicFilePath.filename().u32string() << U"\"\n";
-    ini << U"score=\"" << U"score.txt" << U"\"\n";
-    ini << U"musicEx=\"" << U"\"\n";
-
-    ini.close();
-
-    cout << "\n譜面データのディレクトリを作成しました\n";
-#endif // BUTTON_VERSION
-
     stop();
 
     return 0;
@@ -0,0 +1,370 @@
+﻿#include "MIDItoScore.hpp"
+#include "ScoreReader.hpp"
+#include "BatchConverter.hpp"
+#include "IncrementalScore.hpp"
+#include "SyntheticMidi.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <cstdint>
+
+// regression tests of the conversion, on the synthetic midi files and the small inputs.
+// build this file with the sources except createScore.cpp, benchmark.cpp and corpusBench.cpp.
+//
+// usage: regressionTest
+// the exit code is 0 if all tests passed.
+
+
+namespace {
+
+    int numofFailures = 0;
+
+    void check(bool condition, const char *test, const char *message) {
+        if (!condition) {
+            std::cout << "失敗 " << test << ": " << message << '\n';
+            numofFailures++;
+        }
+    }
+
+    miditoscore::NoteFormat makeFormat(const std::vector<int> &lanes) {
+        miditoscore::NoteFormat format;
+        format.holdMinLength = math::Fraction(1, 4);
+        format.laneAllocation = lanes;
+        format.allowedLineLength = 1024;
+        return format;
+    }
+
+    // the section of the score written by writeScore
+    std::string writeSection(miditoscore::MIDItoScore &toscore, const miditoscore::NoteFormat &format, const std::vector<midireader::NoteEvent> &notes) {
+        std::ostringstream score;
+        score << "begin:easy\n\n";
+        toscore.writeScore(score, format, notes);
+        score << "end\n";
+        return score.str();
+    }
+
+}
+
+
+// running status and note on with velocity 0 are read as the same events as the full status bytes
+void testRunningStatus() {
+    const char *test = "running status";
+
+    midireader::SyntheticMidiOptions options;
+    options.numofTracks = 2;
+    options.numofBars = 16;
+    options.numofTempoChanges = 4;
+
+    options.runningStatus = false;
+    const std::string plain = midireader::generateSyntheticMidi(options);
+    options.runningStatus = true;
+    const std::string running = midireader::generateSyntheticMidi(options);
+
+    midireader::MIDIReader plainReader, runningReader;
+    if (!midireader::Success(plainReader.readFromMemory(plain.data(), plain.size())) ||
+        !midireader::Success(runningReader.readFromMemory(running.data(), running.size()))) {
+        check(false, test, "MIDIファイルを読み込めません");
+        return;
+    }
+
+    const auto &expected = plainReader.getNoteEvent();
+    const auto &actual = runningReader.getNoteEvent();
+    check(expected.size() == actual.size(), test, "トラック数が一致しません");
+
+    bool same = expected.size() == actual.size();
+    size_t numofNoteOn = 0, numofNoteOff = 0;
+    for (size_t t = 0; same && t < expected.size(); t++) {
+        same = expected[t].size() == actual[t].size();
+        for (size_t i = 0; same && i < expected[t].size(); i++) {
+            const auto &a = expected[t][i];
+            const auto &b = actual[t][i];
+            same = a.type == b.type && a.time == b.time && a.channel == b.channel && a.interval == b.interval;
+            (b.type == midireader::MidiEvent::NoteOn ? numofNoteOn : numofNoteOff)++;
+        }
+    }
+
+    check(same, test, "ノーツが一致しません");
+    check(numofNoteOn > 0 && numofNoteOn == numofNoteOff, test, "ベロシティ0のノートオンがノートオフになっていません");
+}
+
+// the sparse form of AUTO is read back as the same notes as the dense form
+void testSparseLineEncoding() {
+    const char *test = "sparse line encoding";
+
+    // the jitter makes the long dense lines, which are written in the sparse form
+    midireader::SyntheticMidiOptions options;
+    options.numofTracks = 2;
+    options.numofBars = 16;
+    options.jitter = 5;
+
+    const std::string midi = midireader::generateSyntheticMidi(options);
+    midireader::MIDIReader reader;
+    reader.setAdjustmentAmplitude(0);
+    if (!midireader::Success(reader.readFromMemory(midi.data(), midi.size()))) {
+        check(false, test, "MIDIファイルを読み込めません");
+        return;
+    }
+
+    auto format = makeFormat(options.intervals);
+    format.allowedLineLength = std::numeric_limits<size_t>::max();
+
+    for (size_t track = 2; track <= reader.getTracks().size(); track++) {
+        miditoscore::MIDItoScore toscore;
+        format.lineEncoding = miditoscore::LineEncoding::DENSE;
+        const std::string dense = writeSection(toscore, format, reader.getNoteEvent(track));
+        format.lineEncoding = miditoscore::LineEncoding::AUTO;
+        const std::string sparse = writeSection(toscore, format, reader.getNoteEvent(track));
+
+        check(sparse.find('=') != std::string::npos, test, "疎な形式の行がありません");
+
+        miditoscore::ScoreReader denseReader, sparseReader;
+        if (!denseReader.read(dense.data(), dense.size()) || !sparseReader.read(sparse.data(), sparse.size())) {
+            check(false, test, "書き出した譜面を読み込めません");
+            return;
+        }
+
+        const auto &expected = denseReader.getSections().front().lanes;
+        const auto &actual = sparseReader.getSections().front().lanes;
+
+        bool same = expected.size() == actual.size();
+        size_t numofNotes = 0;
+        for (size_t lane = 0; same && lane < expected.size(); lane++) {
+            same = expected[lane].size() == actual[lane].size();
+            for (size_t i = 0; same && i < expected[lane].size(); i++) {
+                const auto &a = expected[lane][i];
+                const auto &b = actual[lane][i];
+                same = a.bar == b.bar && a.posInBar == b.posInBar && a.type == b.type && a.channel == b.channel;
+                numofNotes++;
+            }
+        }
+
+        check(numofNotes > 0, test, "ノーツがありません");
+        check(same, test, "疎な形式と密な形式のノーツが一致しません");
+    }
+}
+
+// the update after an edit gives the same output and status as the conversion from scratch
+void testIncrementalScoreEdit() {
+    const char *test = "IncrementalScore edit";
+
+    midireader::SyntheticMidiOptions options;
+    options.numofTracks = 1;
+    options.numofBars = 16;
+
+    const std::string midi = midireader::generateSyntheticMidi(options);
+    midireader::MIDIReader reader;
+    if (!midireader::Success(reader.readFromMemory(midi.data(), midi.size()))) {
+        check(false, test, "MIDIファイルを読み込めません");
+        return;
+    }
+
+    const auto format = makeFormat(options.intervals);
+    std::vector<midireader::NoteEvent> notes = reader.getNoteEvent(2);
+
+    miditoscore::IncrementalScore incremental;
+    incremental.update(format, notes);
+
+    // move a note of the bar 3 to another lane, and remove a note of the bar 10
+    auto findNote = [&notes](int bar) {
+        for (size_t i = 0; i < notes.size(); i++) {
+            if (notes[i].bar == bar && notes[i].type == midireader::MidiEvent::NoteOn)
+                return i;
+        }
+        return notes.size();
+    };
+    auto findNoteOff = [&notes](size_t on) {
+        for (size_t i = on + 1; i < notes.size(); i++) {
+            if (notes[i].interval == notes[on].interval && notes[i].type == midireader::MidiEvent::NoteOff)
+                return i;
+        }
+        return notes.size();
+    };
+
+    const size_t moved = findNote(3), movedOff = findNoteOff(moved);
+    const size_t removed = findNote(10), removedOff = findNoteOff(removed);
+    if (movedOff >= notes.size() || removedOff >= notes.size()) {
+        check(false, test, "編集するノーツがありません");
+        return;
+    }
+
+    const int interval = notes[moved].interval == options.intervals.front() ? options.intervals.back() : options.intervals.front();
+    notes[moved].interval = interval;
+    notes[movedOff].interval = interval;
+    notes.erase(notes.begin() + removedOff);
+    notes.erase(notes.begin() + removed);
+
+    const int incrementalStatus = incremental.update(format, notes);
+    std::ostringstream incrementalScore;
+    incremental.write(incrementalScore);
+
+    miditoscore::MIDItoScore toscore;
+    std::ostringstream freshScore;
+    const int freshStatus = toscore.writeScore(freshScore, format, notes);
+
+    check(incremental.getNumofUpdatedLines() < incremental.getNumofLines(), test, "変更のない行が再利用されていません");
+    check(incrementalScore.str() == freshScore.str(), test, "出力が一致しません");
+    check(incrementalStatus == freshStatus, test, "ステータスが一致しません");
+}
+
+// the channels 10-15 are written in the bytes over 0x7f, and must be read back
+void testScoreReaderHighChannels() {
+    const char *test = "ScoreReader channel 10-15";
+
+    midireader::SyntheticMidiOptions options;
+    options.numofTracks = 1;
+    options.numofBars = 8;
+
+    const std::string midi = midireader::generateSyntheticMidi(options);
+    midireader::MIDIReader reader;
+    if (!midireader::Success(reader.readFromMemory(midi.data(), midi.size()))) {
+        check(false, test, "MIDIファイルを読み込めません");
+        return;
+    }
+
+    // the channel of each note depends on its lane
+    std::vector<midireader::NoteEvent> notes = reader.getNoteEvent(2);
+    for (auto &e : notes) {
+        for (size_t lane = 0; lane < options.intervals.size(); lane++) {
+            if (options.intervals[lane] == e.interval)
+                e.channel = 10 + static_cast<int>(lane);
+        }
+    }
+
+    const auto format = makeFormat(options.intervals);
+    miditoscore::MIDItoScore toscore;
+    const std::string score = writeSection(toscore, format, notes);
+
+    miditoscore::ScoreReader scoreReader;
+    if (!scoreReader.read(score.data(), score.size())) {
+        check(false, test, "書き出した譜面を読み込めません");
+        return;
+    }
+
+    size_t numofNotes = 0;
+    bool sameChannels = true;
+    const auto &lanes = scoreReader.getSections().front().lanes;
+    for (size_t lane = 0; lane < lanes.size(); lane++) {
+        for (const auto &note : lanes[lane]) {
+            sameChannels = sameChannels && note.channel == 10 + static_cast<int>(lane);
+            numofNotes++;
+        }
+    }
+
+    check(numofNotes > 0, test, "ノーツがありません");
+    check(sameChannels, test, "チャンネルが一致しません");
+}
+
+// the lane of a malformed line is rejected before the lanes are allocated
+void testScoreReaderLaneBound() {
+    const char *test = "ScoreReader lane bound";
+
+    const std::string score = "begin:easy\n99999999999:001:1\nend\n";
+    miditoscore::ScoreReader scoreReader;
+    check(!scoreReader.read(score.data(), score.size()), test, "不正なレーン番号を読み込みました");
+    check(scoreReader.getErrorLine() == 2, test, "エラーの行番号が違います");
+}
+
+// the notes on the lanes over parallelsLimit are reported, even if a lane within the limit has two notes
+void testParallelsLimitSameLane() {
+    const char *test = "parallels limit";
+
+    using midireader::MidiEvent;
+    auto note = [](MidiEvent type, midireader::tick_t time, int interval) {
+        midireader::NoteEvent e;
+        e.type = type;
+        e.channel = 0;
+        e.time = time;
+        e.bar = 1;
+        e.posInBar = math::Fraction(static_cast<int64_t>(time), 1920);
+        e.interval = interval;
+        e.velocity = 100;
+        return e;
+    };
+
+    // the lane 0 has two notes at the same tick, and the lane 2 is over the limit
+    const std::vector<midireader::NoteEvent> notes = {
+        note(MidiEvent::NoteOn, 0, 60),
+        note(MidiEvent::NoteOn, 0, 60),
+        note(MidiEvent::NoteOn, 0, 62),
+        note(MidiEvent::NoteOn, 0, 64),
+        note(MidiEvent::NoteOff, 240, 60),
+        note(MidiEvent::NoteOff, 240, 60),
+        note(MidiEvent::NoteOff, 240, 62),
+        note(MidiEvent::NoteOff, 240, 64),
+    };
+
+    auto format = makeFormat({ 60, 62, 64, 65 });
+    format.parallelsLimit = 2;
+
+    miditoscore::MIDItoScore toscore;
+    std::ostringstream score;
+    const int ret = toscore.writeScore(score, format, notes);
+
+    const auto &parallels = toscore.getParallelNotes();
+    check((ret & miditoscore::Status::E_MANY_PARALLELS) != 0, test, "同時押しの上限を超えていません");
+    check(parallels.size() == 1 && parallels.front().interval == 64, test, "上限を超えたレーンのノーツが報告されていません");
+}
+
+// -INT64_MIN does not fit in 64 bit, so the negation throws instead of overflowing
+void testFractionNegation() {
+    const char *test = "Fraction negation";
+
+    auto throwsOverflow = [](const std::function<void()> &f) {
+        try {
+            f();
+        } catch (const std::overflow_error&) {
+            return true;
+        }
+        return false;
+    };
+
+    check(throwsOverflow([] { math::Fraction(INT64_MIN, -1); }), test, "負の分母で分子の符号を反転できません");
+    check(throwsOverflow([] { math::Fraction(1, INT64_MIN); }), test, "分母の符号を反転できません");
+    check(throwsOverflow([] { -math::Fraction(INT64_MIN); }), test, "単項マイナスで符号を反転できません");
+
+    const auto frac = -math::Fraction(3, -4);
+    check(frac.get().n == 3 && frac.get().d == 4, test, "符号の反転が正しくありません");
+}
+
+// the songs of the same id would write to the same temporary directory at the same time
+void testManifestDuplicateId() {
+    const char *test = "manifest duplicate id";
+
+    std::istringstream manifest(
+        "[7]\nlanes=60,62,64,65\nhold=1/4\nprofile=wii\n"
+        "[8]\nlanes=60,62,64,65\nhold=1/4\nprofile=wii\n"
+        "[7]\nlanes=60,62,64,65\nhold=1/8\nprofile=wii\n");
+    std::vector<miditoscore::BatchEntry> entries;
+    std::ostringstream err;
+
+    check(!miditoscore::readManifest(manifest, ".", { miditoscore::wiiProfile() }, entries, err, false), test, "重複した曲IDを読み込みました");
+    check(err.str().find("9行目") != std::string::npos, test, "重複した行が報告されていません");
+}
+
+
+int main() {
+    const std::vector<std::pair<const char*, std::function<void()>>> tests = {
+        { "running status", testRunningStatus },
+        { "sparse line encoding", testSparseLineEncoding },
+        { "IncrementalScore edit", testIncrementalScoreEdit },
+        { "ScoreReader channel 10-15", testScoreReaderHighChannels },
+        { "ScoreReader lane bound", testScoreReaderLaneBound },
+        { "parallels limit", testParallelsLimitSameLane },
+        { "manifest duplicate id", testManifestDuplicateId },
+        { "Fraction negation", testFractionNegation },
+    };
+
+    for (const auto &test : tests) {
+        const int before = numofFailures;
+        test.second();
+        std::cout << (numofFailures == before ? "成功 " : "失敗 ") << test.first << '\n';
+    }
+
+    std::cout << (numofFailures == 0 ? "すべてのテストに成功しました\n" : "失敗したテストがあります\n");
+
+    return numofFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}